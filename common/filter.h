@@ -14,20 +14,42 @@
 #include <list>
 #include <common/log.h>
 #include <common/buffer.h>
+#include <common/flight_recorder.h>
+#include <common/memory_account.h>
+
+// flush flag of a filter that cannot go on, the owner of the chain closes it
+#define FILTER_ABORT		0x100000
+
+class FilterStage;
 
 class Filter
 {
 private:
    Filter* recipient_;
+   FilterStage* stage_;
+   FlightRecorder* recorder_;
+   MemoryAccount* account_;
    
 public:
-   Filter ()														{ recipient_ = 0; }
+   Filter ()														{ recipient_ = 0; stage_ = 0; recorder_ = 0; account_ = 0; }
    virtual ~Filter ()											{ }
    
    void chain (Filter* nxt)									{ recipient_ = nxt; }
+   void measure (FilterStage* stg)							{ stage_ = stg; }
+   void record (FlightRecorder* rec)						{ recorder_ = rec; }
+   FlightRecorder* recorder () const						{ return recorder_; }
+   void charge (MemoryAccount* acc)							{ account_ = acc; }
+   MemoryAccount* account () const							{ return account_; }
    virtual bool consume (Buffer& buf, int flg = 0)		{ return produce (buf, flg); }
-   virtual bool produce (Buffer& buf, int flg = 0)		{ return (recipient_ && recipient_->consume (buf, flg)); }
+   virtual bool produce (Buffer& buf, int flg = 0)		{ return (recipient_ && (recipient_->stage_ ? recipient_->timed (buf, flg) : recipient_->consume (buf, flg))); }
    virtual void flush (int flg)								{ if (recipient_) recipient_->flush (flg); }
+
+protected:
+   void trace (TraceEvent ev, uint32_t val = 0, uint8_t flg = 0)	{ if (recorder_) recorder_->add (ev, val, flg); }
+   void hold (intmax_t& held, intmax_t now)						{ if (account_ && now != held) account_->add (now - held); held = now; }
+
+private:
+   bool timed (Buffer& buf, int flg);
 };
 
 class BufferedFilter : public Filter
@@ -63,10 +85,13 @@ public:
    virtual ~FilterChain ()			{ while (! nodes_.empty ()) { delete nodes_.front (); nodes_.pop_front (); }}
   
    void prepend (Filter* f)  		{ Filter* act = (nodes_.empty () ? holder_ : nodes_.front ()); 
-											  if (f && act) nodes_.push_front (f), chain (f), f->chain (act); }
+											  if (f && act) nodes_.push_front (f), chain (f), f->chain (act), f->measure (stage (f)), f->record (recorder ()), f->charge (account ()); }
    void append (Filter* f)  		{ Filter* act = (nodes_.empty () ? this : nodes_.front ()); 
-											  if (f && act) nodes_.push_front (f), act->chain (f), f->chain (holder_); }
+											  if (f && act) nodes_.push_front (f), act->chain (f), f->chain (holder_), f->measure (stage (f)), f->record (recorder ()), f->charge (account ()); }
    virtual void flush (int flg)	{ if (nodes_.empty ()) chain (holder_); Filter::flush (flg); }
+
+private:
+   static FilterStage* stage (Filter* f);
 };
 
 #endif /* !COMMON_FILTER_H */
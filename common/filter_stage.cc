@@ -0,0 +1,97 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// File:           filter_stage.cc                                            //
+// Description:    latency and size histograms of the filters of a chain      //
+// Project:        WANProxy XTech                                             //
+// Author:         Andreu Vidal Bramfeld-Software                             //
+// Last modified:  2026-10-19                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+#include <stdlib.h>
+#include <typeinfo>
+#include <cxxabi.h>
+#include "filter_stage.h"
+
+std::map<std::string, FilterStage*> FilterStage::stages_;
+std::vector<Timer> FilterStage::timers_;
+unsigned FilterStage::depth_ = 0;
+uintmax_t FilterStage::nested_ = 0;
+
+FilterStage::FilterStage (const std::string& name) : name_(name)
+{
+	calls_ = time_ = bytes_ = 0;
+	memset (time_buckets_, 0, sizeof time_buckets_);
+	memset (size_buckets_, 0, sizeof size_buckets_);
+}
+
+/*
+ * The data is counted before the call since filters are free to consume
+ * the buffer they receive. The timers are kept by depth of nesting, which
+ * is all the filters of the calling chain take, and reused from call to
+ * call.
+ */
+
+bool FilterStage::pass (Filter* f, Buffer& buf, int flg)
+{
+	size_t len = buf.length ();
+	uintmax_t outer = nested_, us, own;
+	unsigned d = depth_++;
+	bool rv;
+
+	if (timers_.size () <= d)
+		timers_.resize (d + 1);
+	nested_ = 0;
+	timers_[d].start ();
+	rv = f->consume (buf, flg);
+	timers_[d].stop ();
+	us = timers_[d].sample ();
+	timers_[d].reset ();
+
+	own = (us > nested_ ? us - nested_ : 0);
+	record (own, len);
+	nested_ = outer + us;
+	depth_--;
+	return rv;
+}
+
+void FilterStage::record (uintmax_t us, size_t len)
+{
+	int i;
+
+	calls_++;
+	time_ += us;
+	bytes_ += len;
+	for (i = 0; i < FILTER_STAGE_TIME_BUCKETS - 1 && us > time_limit (i); ++i);
+	time_buckets_[i]++;
+	for (i = 0; i < FILTER_STAGE_SIZE_BUCKETS - 1 && len > size_limit (i); ++i);
+	size_buckets_[i]++;
+}
+
+FilterStage* FilterStage::find (const std::string& name)
+{
+	FilterStage*& stg = stages_[name];
+	if (! stg)
+		stg = new FilterStage (name);
+	return stg;
+}
+
+bool Filter::timed (Buffer& buf, int flg)
+{
+	return stage_->pass (this, buf, flg);
+}
+
+// stages are named after the class of the filter
+FilterStage* FilterChain::stage (Filter* f)
+{
+	const char* type = typeid (*f).name ();
+	char* name;
+	int status;
+
+	if (! (name = abi::__cxa_demangle (type, 0, 0, &status)))
+		return FilterStage::find (type);
+	FilterStage* stg = FilterStage::find (name);
+	free (name);
+	return stg;
+}
@@ -0,0 +1,65 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// File:           filter_stage.h                                             //
+// Description:    latency and size histograms of the filters of a chain      //
+// Project:        WANProxy XTech                                             //
+// Author:         Andreu Vidal Bramfeld-Software                             //
+// Last modified:  2026-10-19                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef	COMMON_FILTER_STAGE_H
+#define	COMMON_FILTER_STAGE_H
+
+#include <map>
+#include <vector>
+#include <common/filter.h>
+#include <common/timer/timer.h>
+
+#define FILTER_STAGE_TIME_BUCKETS	18		// up to 2^16 us, then the rest
+#define FILTER_STAGE_SIZE_BUCKETS	10		// 16 bytes to 1 MB by powers of 4, then the rest
+
+/*
+ * Gathers the calls to all filters of one type, each of them timed by the
+ * filter handing it the data. The time of the filters further down the
+ * chain, which run within the call, is discounted, so that every stage is
+ * charged only with its own work.
+ */
+
+class FilterStage
+{
+	std::string name_;
+	uintmax_t calls_;
+	uintmax_t time_;
+	uintmax_t bytes_;
+	uintmax_t time_buckets_[FILTER_STAGE_TIME_BUCKETS];
+	uintmax_t size_buckets_[FILTER_STAGE_SIZE_BUCKETS];
+
+	static std::map<std::string, FilterStage*> stages_;
+	static std::vector<Timer> timers_;
+	static unsigned depth_;
+	static uintmax_t nested_;
+
+public:
+	FilterStage (const std::string& name);
+
+	bool pass (Filter* f, Buffer& buf, int flg);
+
+	const std::string& name () const   { return name_; }
+	uintmax_t calls () const   { return calls_; }
+	uintmax_t time () const   { return time_; }
+	uintmax_t bytes () const   { return bytes_; }
+	uintmax_t time_bucket (int i) const   { return time_buckets_[i]; }
+	uintmax_t size_bucket (int i) const   { return size_buckets_[i]; }
+
+	static uintmax_t time_limit (int i)   { return ((uintmax_t) 1 << i); }
+	static uintmax_t size_limit (int i)   { return ((uintmax_t) 16 << (2 * i)); }
+
+	static FilterStage* find (const std::string& name);
+	static const std::map<std::string, FilterStage*>& stages ()   { return stages_; }
+
+private:
+	void record (uintmax_t us, size_t len);
+};
+
+#endif /* !COMMON_FILTER_STAGE_H */
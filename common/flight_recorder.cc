@@ -0,0 +1,62 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// File:           flight_recorder.cc                                         //
+// Description:    ring of the last trace events of a connection              //
+// Project:        WANProxy XTech                                             //
+// Author:         Andreu Vidal Bramfeld-Software                             //
+// Last modified:  2026-10-19                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include "flight_recorder.h"
+
+static const char* trace_names[TraceEvents] =
+{
+	"?", "read", "eos", "write", "written", "write-error", "encode", "decode",
+	"ask", "learn", "answer", "flush", "timer", "close"
+};
+
+std::set<FlightRecorder*> FlightRecorder::recorders_;
+
+FlightRecorder::FlightRecorder ()
+{
+	count_ = 0;
+	recorders_.insert (this);
+}
+
+FlightRecorder::~FlightRecorder ()
+{
+	recorders_.erase (this);
+}
+
+/*
+ * Times are given in milliseconds before the dump, oldest event first.
+ */
+
+void FlightRecorder::dump (std::ostream& os) const
+{
+	struct timespec ts;
+	unsigned n, i;
+	char line[96];
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	uint64_t now = (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+
+	n = (count_ < FLIGHT_RECORDER_EVENTS ? count_ : FLIGHT_RECORDER_EVENTS);
+	os << "connection " << label_ << " (" << count_ << " events)\n";
+	for (i = count_ - n; i != count_; ++i)
+	{
+		const Entry& e = entries_[i & (FLIGHT_RECORDER_EVENTS - 1)];
+		snprintf (line, sizeof line, "  -%.3f %s %u %u\n", (now - e.time_) / 1e6,
+					 (e.event_ < TraceEvents ? trace_names[e.event_] : "?"), (unsigned) e.flag_, (unsigned) e.value_);
+		os << line;
+	}
+}
+
+void FlightRecorder::dump_all (std::ostream& os)
+{
+	std::set<FlightRecorder*>::const_iterator it;
+	for (it = recorders_.begin (); it != recorders_.end (); ++it)
+		(*it)->dump (os);
+}
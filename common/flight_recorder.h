@@ -0,0 +1,85 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// File:           flight_recorder.h                                          //
+// Description:    ring of the last trace events of a connection              //
+// Project:        WANProxy XTech                                             //
+// Author:         Andreu Vidal Bramfeld-Software                             //
+// Last modified:  2026-10-19                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef	COMMON_FLIGHT_RECORDER_H
+#define	COMMON_FLIGHT_RECORDER_H
+
+#include <set>
+#include <string>
+#include <ostream>
+#include <time.h>
+#include <common/types.h>
+
+#define FLIGHT_RECORDER_EVENTS	256		// must be binary
+
+enum TraceEvent
+{
+	TraceRead = 1,			// data read from a socket, flag tells the chain
+	TraceEOS,				// end of stream read
+	TraceWrite,				// data handed to a socket, flag set if queued
+	TraceWritten,			// socket write completed
+	TraceWriteError,		// socket write failed
+	TraceEncode,			// encoder output
+	TraceDecode,			// decoder output
+	TraceAsk,				// <ASK> sent
+	TraceLearn,				// <LEARN> received
+	TraceAnswer,			// <ASK> answered with <LEARN>
+	TraceFlush,				// chain flush started, value holds the flags
+	TraceTimer,				// delayed flush fired
+	TraceClose,				// connection concluded
+	TraceEvents
+};
+
+/*
+ * Each connection keeps its last events in binary form, which only takes
+ * a clock reading and a few stores, so that it can be left always on and
+ * turned into text just when someone asks for a dump. Recorders register
+ * themselves so that all those alive can be dumped at once.
+ */
+
+class FlightRecorder
+{
+	struct Entry
+	{
+		uint64_t time_;
+		uint32_t value_;
+		uint8_t event_;
+		uint8_t flag_;
+	};
+
+	std::string label_;
+	Entry entries_[FLIGHT_RECORDER_EVENTS];
+	unsigned count_;
+
+	static std::set<FlightRecorder*> recorders_;
+
+public:
+	FlightRecorder ();
+	~FlightRecorder ();
+
+	void label (const std::string& s)   { label_ = s; }
+
+	void add (TraceEvent event, uint32_t value = 0, uint8_t flag = 0)
+	{
+		struct timespec ts;
+		Entry& e = entries_[count_++ & (FLIGHT_RECORDER_EVENTS - 1)];
+		clock_gettime (CLOCK_MONOTONIC, &ts);
+		e.time_ = (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+		e.value_ = value;
+		e.event_ = event;
+		e.flag_ = flag;
+	}
+
+	void dump (std::ostream& os) const;
+
+	static void dump_all (std::ostream& os);
+};
+
+#endif /* !COMMON_FLIGHT_RECORDER_H */
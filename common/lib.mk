@@ -3,5 +3,8 @@ VPATH+=	${TOPDIR}/common
 SRCS+=	buffer.cc
 SRCS+=	log.cc
 SRCS+=	count_filter.cc
+SRCS+=	filter_stage.cc
+SRCS+=	flight_recorder.cc
+SRCS+=	memory_account.cc
 
 CXXFLAGS+=-include common/common.h
@@ -24,102 +24,383 @@
  */
 
 #include <sys/time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <regex.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 #ifdef	USE_SYSLOG
 #include <syslog.h>
 #endif
 
 #include <iostream>
 #include <list>
+#include <map>
 #include <sstream>
 
+#include <common/thread/atomic.h>
+#include <common/thread/thread.h>
+
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// File:           log.cc                                                     //
+// Description:    message logging through a background writer thread         //
+// Project:        WANProxy XTech                                             //
+// Adapted by:     Andreu Vidal Bramfeld-Software                             //
+// Last modified:  2026-10-19                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#define	LOG_QUEUE_SIZE	4096	// must be binary
+
 struct LogMask {
 	regex_t regex_;
 	enum Log::Priority priority_;
 };
 
+struct LogRecord {
+	struct timeval time_;
+	Log::Priority priority_;
+	std::string handle_;
+	std::string message_;
+};
+
+/*
+ * Messages are handed to a thread of their own, so that whoever logs never
+ * waits for the terminal or syslog. Any thread may post to the queue at
+ * the same time without locks, each one taking a slot by its ticket, and
+ * the writer is only woken through its pipe when it has gone to sleep.
+ * When the queue is full the message is dropped and counted instead,
+ * unless its poster would rather wait for room, as bulk output does.
+ */
+class LogWriter : public Thread {
+	struct Slot {
+		Atomic<unsigned> sequence_;
+		LogRecord* record_;
+	};
+
+	Slot slots_[LOG_QUEUE_SIZE];
+	Atomic<unsigned> tail_;
+	unsigned head_;
+	Atomic<int> state_;
+	Atomic<int> sleeping_;
+	Atomic<unsigned> dropped_;
+	int rfd_, wfd_;
+
+	enum { Idle, Starting, Running, Stopped };
+
+public:
+	LogWriter(void);
+	~LogWriter();
+
+	bool post(LogRecord*, bool wait = false);
+	virtual void main(void);
+
+private:
+	bool launch(void);
+	LogRecord* next(void);
+	void wakeup(void);
+};
+
 static std::list<LogMask> log_masks;
+static std::map<std::string, int> log_levels;
+static pthread_mutex_t log_masks_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t log_output_mutex = PTHREAD_MUTEX_INITIALIZER;
+static volatile unsigned log_generation = 1;
+static LogWriter log_writer;
 
 #ifdef	USE_SYSLOG
 static int syslog_priority(const Log::Priority&);
 #endif
 static std::ostream& operator<< (std::ostream&, const Log::Priority&);
 static std::ostream& operator<< (std::ostream&, const struct timeval&);
+static void log_write(const LogRecord&);
+
+int
+LogHandle::level(void) const
+{
+	unsigned generation = Log::generation();
+
+	if (generation_ != generation) {
+		level_ = Log::level(string_);
+		__sync_synchronize();
+		generation_ = generation;
+	}
+	return (level_);
+}
 
 void
 Log::log(const Priority& priority, const LogHandle& handle,
-	 const std::string& message)
+	 const std::string& message, bool wait)
 {
-	std::list<LogMask>::const_iterator it;
-	std::string handle_string = (std::string)handle;
+	if (priority > handle.level())
+		return;
+
+	LogRecord* record = new LogRecord;
+	if (gettimeofday(&record->time_, NULL) == -1)
+		memset(&record->time_, 0, sizeof record->time_);
+	record->priority_ = priority;
+	record->handle_ = (std::string)handle;
+	record->message_ = message;
 
 	/*
-	 * XXX
-	 * Skip this all if we're in a HALT or NOTREACHED, since we can
-	 * generate those here.  Critical logs cannot ever be masked, right?
+	 * Critical messages are written at once, since a HALT aborts right
+	 * after them.
 	 */
+	if (priority <= Critical || !log_writer.post(record, wait)) {
+		log_write(*record);
+		delete record;
+	}
+}
+
+bool
+Log::mask(const std::string& handle_regex, const Log::Priority& priority)
+{
+	LogMask mask;
+
+	if (::regcomp(&mask.regex_, handle_regex.c_str(),
+		      REG_NOSUB | REG_EXTENDED) != 0) {
+		return (false);
+	}
+	mask.priority_ = priority;
+
+	pthread_mutex_lock(&log_masks_mutex);
+	log_masks.push_back(mask);
+	log_levels.clear();
+	log_generation++;
+	pthread_mutex_unlock(&log_masks_mutex);
+
+	return (true);
+}
+
+/*
+ * The first mask matching the handle decides, and without any one matching
+ * everything is let through. Results are kept by handle string, which also
+ * serves the handles built on the fly for a single message.
+ */
+int
+Log::level(const std::string& handle)
+{
+	std::list<LogMask>::const_iterator it;
+	int level = Debug;
+
+	pthread_mutex_lock(&log_masks_mutex);
+	std::map<std::string, int>::const_iterator lv = log_levels.find(handle);
+	if (lv != log_levels.end()) {
+		level = lv->second;
+		pthread_mutex_unlock(&log_masks_mutex);
+		return (level);
+	}
+
 	for (it = log_masks.begin(); it != log_masks.end(); ++it) {
-		const LogMask& mask = *it;
-		int rv;
-
-		rv = regexec(&mask.regex_, handle_string.c_str(), 0, NULL, 0);
-		switch (rv) {
-		case 0:
-			if (priority <= mask.priority_)
-				goto done;
-			return;
-		case REG_NOMATCH:
-			continue;
-		default:
-			HALT("/log") << "Could not match regex: " << rv;
-			return;
+		int rv = regexec(&it->regex_, handle.c_str(), 0, NULL, 0);
+		if (rv == 0) {
+			level = it->priority_;
+			break;
+		}
+		if (rv != REG_NOMATCH) {
+			/* Not through HALT, which would come back here.  */
+			std::cerr << "Could not match regex: " << rv << std::endl;
+			abort();
 		}
-		NOTREACHED("/log");
 	}
+	log_levels[handle] = level;
+	pthread_mutex_unlock(&log_masks_mutex);
 
-done:
-#ifdef	USE_SYSLOG
-	std::string syslog_message;
+	return (level);
+}
 
-	syslog_message += "[";
-	syslog_message += (std::string)handle;
-	syslog_message += "] ";
-	syslog_message += message;
+unsigned
+Log::generation(void)
+{
+	return (log_generation);
+}
 
-	syslog(syslog_priority(priority), "%s", syslog_message.c_str());
-#endif
+LogWriter::LogWriter(void)
+: Thread("LogWriter"),
+  tail_(0),
+  head_(0),
+  state_(Idle),
+  sleeping_(0),
+  dropped_(0),
+  rfd_(-1),
+  wfd_(-1)
+{
+	for (unsigned i = 0; i < LOG_QUEUE_SIZE; ++i) {
+		slots_[i].sequence_ = Atomic<unsigned>(i);
+		slots_[i].record_ = NULL;
+	}
+}
 
-	struct timeval now;
-	int rv;
+LogWriter::~LogWriter()
+{
+	LogRecord* record;
 
-	rv = gettimeofday(&now, NULL);
-	if (rv == -1)
-		memset(&now, 0, sizeof now);
+	if (state_.cmpset(Running, Stopped)) {
+		stop_ = true;
+		wakeup();
+		Thread::stop();
+	}
+	state_.cmpset(Idle, Stopped);
 
-	std::cerr << now << " [" << handle_string << "] " <<
-		priority << ": " <<
-		message <<
-		std::endl;
+	while ((record = next()) != NULL) {
+		log_write(*record);
+		delete record;
+	}
+	if (rfd_ != -1)
+		::close(rfd_), ::close(wfd_);
 }
 
 bool
-Log::mask(const std::string& handle_regex, const Log::Priority& priority)
+LogWriter::post(LogRecord* record, bool wait)
 {
-	LogMask mask;
-
-	if (::regcomp(&mask.regex_, handle_regex.c_str(),
-		      REG_NOSUB | REG_EXTENDED) != 0) {
+	if (state_ != Running && !launch())
 		return (false);
+
+	unsigned pos = tail_.val();
+	for (;;) {
+		Slot& slot = slots_[pos & (LOG_QUEUE_SIZE - 1)];
+		int dif = (int)(slot.sequence_.val() - pos);
+		if (dif == 0) {
+			if (tail_.cmpset(pos, pos + 1))
+				break;
+		} else if (dif < 0) {
+			if (!wait) {
+				dropped_.add(1);
+				delete record;
+				return (true);
+			}
+			if (state_ != Running)
+				return (false);
+			if (sleeping_.cmpset(1, 0))
+				wakeup();
+			::usleep(1000);
+		}
+		pos = tail_.val();
 	}
-	mask.priority_ = priority;
 
-	log_masks.push_back(mask);
+	Slot& slot = slots_[pos & (LOG_QUEUE_SIZE - 1)];
+	slot.record_ = record;
+	slot.sequence_.cmpset(pos, pos + 1);
 
+	if (sleeping_.cmpset(1, 0))
+		wakeup();
 	return (true);
 }
 
+/*
+ * Whoever logs while the thread is being started, the starter included if
+ * it fails, writes by itself.
+ */
+bool
+LogWriter::launch(void)
+{
+	int fd[2];
+
+	if (!state_.cmpset(Idle, Starting))
+		return (state_ == Running);
+
+	if (::pipe(fd) == 0) {
+		rfd_ = fd[0], wfd_ = fd[1];
+		::fcntl(wfd_, F_SETFL, O_NONBLOCK);
+		if (start()) {
+			state_.cmpset(Starting, Running);
+			return (true);
+		}
+	}
+	state_.cmpset(Starting, Stopped);
+	return (false);
+}
+
+LogRecord*
+LogWriter::next(void)
+{
+	Slot& slot = slots_[head_ & (LOG_QUEUE_SIZE - 1)];
+	if (slot.sequence_.val() != head_ + 1)
+		return (NULL);
+
+	LogRecord* record = slot.record_;
+	slot.sequence_.cmpset(head_ + 1, head_ + LOG_QUEUE_SIZE);
+	head_++;
+	return (record);
+}
+
+void
+LogWriter::wakeup(void)
+{
+	char c = 0;
+	if (::write(wfd_, &c, 1) < 0) {
+		/* A full pipe already holds a wakeup.  */
+	}
+}
+
+void
+LogWriter::main(void)
+{
+	LogRecord* record;
+	unsigned dropped;
+	char buf[64];
+
+	for (;;) {
+		while ((record = next()) != NULL) {
+			log_write(*record);
+			delete record;
+		}
+
+		if ((dropped = dropped_.val()) != 0) {
+			dropped_.subtract(dropped);
+			LogRecord note;
+			gettimeofday(&note.time_, NULL);
+			note.priority_ = Log::Warning;
+			note.handle_ = "/log";
+			snprintf(buf, sizeof buf, "%u messages dropped.", dropped);
+			note.message_ = buf;
+			log_write(note);
+		}
+
+		if (stop_)
+			break;
+
+		/*
+		 * Look at the queue once more after saying we sleep, a message
+		 * posted in between would not wake us up otherwise.
+		 */
+		sleeping_.cmpset(0, 1);
+		if (slots_[head_ & (LOG_QUEUE_SIZE - 1)].sequence_.val() == head_ + 1) {
+			sleeping_.cmpset(1, 0);
+			continue;
+		}
+		if (::read(rfd_, buf, sizeof buf) < 0 && errno != EINTR)
+			break;
+	}
+}
+
+static void
+log_write(const LogRecord& record)
+{
+	pthread_mutex_lock(&log_output_mutex);
+
+#ifdef	USE_SYSLOG
+	std::string syslog_message;
+
+	syslog_message += "[";
+	syslog_message += record.handle_;
+	syslog_message += "] ";
+	syslog_message += record.message_;
+
+	syslog(syslog_priority(record.priority_), "%s", syslog_message.c_str());
+#endif
+
+	std::cerr << record.time_ << " [" << record.handle_ << "] " <<
+		record.priority_ << ": " <<
+		record.message_ <<
+		std::endl;
+
+	pthread_mutex_unlock(&log_output_mutex);
+}
+
 #ifdef	USE_SYSLOG
 static int
 syslog_priority(const Log::Priority& priority)
@@ -51,15 +51,25 @@ public:
 	}
 };
 
+/*
+ * A handle remembers the highest priority its masks let through, and only
+ * looks at them again once they have changed.
+ */
 class LogHandle {
 	std::string string_;
+	mutable unsigned generation_;
+	mutable int level_;
 public:
 	LogHandle(const char *s)
-	: string_(s)
+	: string_(s),
+	  generation_(0),
+	  level_(0)
 	{ }
 
 	LogHandle(const std::string& s)
-	: string_(s)
+	: string_(s),
+	  generation_(0),
+	  level_(0)
 	{ }
 
 	~LogHandle()
@@ -75,8 +85,11 @@ public:
 	{
 		LogHandle appended = *this;
 		appended.string_ += x;
+		appended.generation_ = 0;
 		return (appended);
 	}
+
+	int level(void) const;
 };
 
 class Log {
@@ -103,19 +116,30 @@ public:
 	};
 
 private:
-	LogHandle handle_;
+	const LogHandle& handle_;
 	Priority priority_;
 	std::ostringstream str_;
 	bool pending_;
 	bool halted_;
+	bool enabled_;
 public:
 	Log(const LogHandle& handle, const Priority& priority, const std::string function)
 	: handle_(handle),
 	  priority_(priority),
 	  str_(),
 	  pending_(false),
-	  halted_(false)
+	  halted_(false),
+	  enabled_(priority <= handle.level())
 	{
+		/*
+		 * A message masked out is not even formatted, the stream
+		 * ignores anything written to it once it is marked bad.
+		 */
+		if (!enabled_) {
+			str_.setstate(std::ios::badbit);
+			return;
+		}
+
 		/*
 		 * Print the function name for non-routine messages.
 		 */
@@ -161,13 +185,15 @@ public:
 	void
 	flush(void)
 	{
-		if (!pending_)
+		if (!pending_ || !enabled_)
 			return;
 		Log::log(priority_, handle_, str_.str());
 	}
 
-	static void log(const Priority&, const LogHandle&, const std::string&);
+	static void log(const Priority&, const LogHandle&, const std::string&, bool wait = false);
 	static bool mask(const std::string&, const Priority&);
+	static int level(const std::string&);
+	static unsigned generation(void);
 };
 
 	/* A panic condition.  */
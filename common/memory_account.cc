@@ -0,0 +1,68 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// File:           memory_account.cc                                          //
+// Description:    bytes held in buffers by a connection, with its limits     //
+// Project:        WANProxy XTech                                             //
+// Author:         Andreu Vidal Bramfeld-Software                             //
+// Last modified:  2026-10-19                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include "memory_account.h"
+
+intmax_t MemoryAccount::total_ = 0;
+intmax_t MemoryAccount::peak_ = 0;
+
+MemoryAccount::~MemoryAccount ()
+{
+	if (paused_ && pool_)
+		pool_->waiting_.remove (this);
+	paused_ = false;
+	if (held_)
+		add (-held_);
+}
+
+void MemoryAccount::add (intmax_t n)
+{
+	held_ += n;
+	if (pool_)
+		pool_->add (n);
+	else if ((total_ += n) > peak_)
+		peak_ = total_;
+	if (n < 0)
+		relieve ();
+}
+
+bool MemoryAccount::pause ()
+{
+	if (awaiting_ > 0 || ! exceeded ())
+		return false;
+	if (! paused_ && pool_)
+		pool_->waiting_.push_back (this);
+	paused_ = true;
+	return true;
+}
+
+void MemoryAccount::relieve ()
+{
+	if (paused_ && ! exceeded ())
+	{
+		paused_ = false;
+		if (pool_)
+			pool_->waiting_.remove (this);
+		relieved ();
+	}
+	
+	if (! waiting_.empty () && ! exceeded ())
+	{
+		std::list<MemoryAccount*> lst;
+		lst.swap (waiting_);
+		for (std::list<MemoryAccount*>::iterator it = lst.begin (); it != lst.end (); ++it)
+		{
+			if ((*it)->exceeded ())
+				waiting_.push_back (*it);
+			else
+				(*it)->paused_ = false, (*it)->relieved ();
+		}
+	}
+}
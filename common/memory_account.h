@@ -0,0 +1,62 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// File:           memory_account.h                                           //
+// Description:    bytes held in buffers by a connection, with its limits     //
+// Project:        WANProxy XTech                                             //
+// Author:         Andreu Vidal Bramfeld-Software                             //
+// Last modified:  2026-10-19                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef	COMMON_MEMORY_ACCOUNT_H
+#define	COMMON_MEMORY_ACCOUNT_H
+
+#include <list>
+#include <common/types.h>
+
+/*
+ * Filters charge what they keep buffered to the account of their chain,
+ * which passes it on to the pool of its proxy. The owner of the chain asks
+ * whether to pause reading after handing it data, and is told when it may
+ * read again, be it because its own bytes went out or because the pool,
+ * over its budget before, is now back under it. A chain awaiting data from
+ * its peer to make progress with what it holds, as a decoder waiting for
+ * the segments it asked for, is never paused.
+ */
+
+class MemoryAccount
+{
+private:
+	MemoryAccount* pool_;
+	std::list<MemoryAccount*> waiting_;
+	intmax_t held_;
+	intmax_t limit_;
+	int awaiting_;
+	bool paused_;
+	
+	static intmax_t total_;
+	static intmax_t peak_;
+
+public:
+	MemoryAccount ()											{ pool_ = 0; held_ = limit_ = 0; awaiting_ = 0; paused_ = false; }
+	virtual ~MemoryAccount ();
+	
+	void join (MemoryAccount* pool)						{ pool_ = pool; }
+	void limit (intmax_t n)									{ limit_ = n; }
+	intmax_t held () const									{ return held_; }
+	bool exceeded () const									{ return ((limit_ > 0 && held_ > limit_) || (pool_ && pool_->exceeded ())); }
+	void await (bool on)										{ awaiting_ += (on ? 1 : -1); }
+	void add (intmax_t n);
+	bool pause ();
+	
+	static intmax_t total ()								{ return total_; }
+	static intmax_t peak ()									{ return peak_; }
+
+protected:
+	virtual void relieved ()								{ }
+
+private:
+	void relieve ();
+};
+
+#endif /* !COMMON_MEMORY_ACCOUNT_H */
@@ -42,6 +42,14 @@ struct NanoTime {
 	  nanoseconds_(src.nanoseconds_)
 	{ }
 
+	NanoTime& operator= (const NanoTime& src)
+	{
+		seconds_ = src.seconds_;
+		nanoseconds_ = src.nanoseconds_;
+
+		return (*this);
+	}
+
 	bool operator< (const NanoTime& b) const
 	{
 		if (seconds_ == b.seconds_)
@@ -23,7 +23,7 @@
  * SUCH DAMAGE.
  */
 
-#include <sys/time.h>
+#include <time.h>
 
 #include <vector>
 
@@ -32,25 +32,25 @@
 void
 Timer::start(void)
 {
-	struct timeval tv;
+	struct timespec ts;
 	int rv;
 
-	rv = gettimeofday(&tv, NULL);
+	rv = clock_gettime(CLOCK_MONOTONIC, &ts);
 	if (rv == -1)
-		HALT("/timer") << "Could not gettimeofday.";
-	start_ = (tv.tv_sec * 1000 * 1000) + tv.tv_usec;
+		HALT("/timer") << "Could not clock_gettime.";
+	start_ = (ts.tv_sec * 1000 * 1000) + (ts.tv_nsec / 1000);
 }
 
 void
 Timer::stop(void)
 {
-	struct timeval tv;
+	struct timespec ts;
 	int rv;
 
-	rv = gettimeofday(&tv, NULL);
+	rv = clock_gettime(CLOCK_MONOTONIC, &ts);
 	if (rv == -1)
-		HALT("/timer") << "Could not gettimeofday.";
-	stop_ = (tv.tv_sec * 1000 * 1000) + tv.tv_usec;
+		HALT("/timer") << "Could not clock_gettime.";
+	stop_ = (ts.tv_sec * 1000 * 1000) + (ts.tv_nsec / 1000);
 
 	samples_.push_back(stop_ - start_);
 }
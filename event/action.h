@@ -26,6 +26,8 @@
 #ifndef	EVENT_ACTION_H
 #define	EVENT_ACTION_H
 
+#include <event/object_pool.h>
+
 ////////////////////////////////////////////////////////////////////////////////
 //                                                                            //
 // File:           action.h                                                   //
@@ -60,7 +62,7 @@ public:
 };
 
 
-template<class S, class C> class CallbackAction : public Action
+template<class S, class C> class CallbackAction : public Action, public PoolObject<CallbackAction<S, C> >
 {
 	typedef void (S::*const method_t)(void);
 
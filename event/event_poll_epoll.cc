@@ -45,6 +45,7 @@ void IoService::open_resources ()
 {
 	handle_ = ::epoll_create (IO_POLL_EVENT_COUNT);
 	ASSERT(log_, handle_ != -1);
+	edge_ = true;
 }
 
 void IoService::close_resources ()
@@ -57,6 +58,33 @@ void IoService::set_fd (int fd, int rd, int wr, IoNode* node)
 {
 	struct epoll_event eev;
 	int rv;
+	
+	/*
+	 * Stream descriptors are registered once for both directions in edge
+	 * triggered mode and stay so until closed, so that requests come and
+	 * go without touching the kernel. Listening sockets and the wakeup
+	 * pipe are added and removed as before.
+	 */
+	if (node && ! node->level)
+	{
+		if (rd <= 0 && wr <= 0)
+		{
+			if (node->registered)
+				::epoll_ctl (handle_, EPOLL_CTL_DEL, fd, &eev);
+			node->registered = false;
+		}
+		else if (! node->registered)
+		{
+			eev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+			eev.data.ptr = node;
+			if (::epoll_ctl (handle_, EPOLL_CTL_ADD, fd, &eev) < 0)
+				CRITICAL(log_) << "Could not add event to epoll.";
+			else
+				node->registered = true;
+		}
+		return;
+	}
+	
 	eev.events = ((rd > 0 ? EPOLLIN : 0) | (wr > 0 ? EPOLLOUT : 0));
 	eev.data.ptr = node;
 	if (eev.events)
@@ -83,6 +111,12 @@ void IoService::poll (int ms)
 		EventAction* act;
 		Event ok;
 		
+		if (node && ! node->level)
+		{
+			poll_edge (node, flg);
+			continue;
+		}
+		
 		if ((flg & EPOLLIN)) 
 		{
 			if (node && (act = node->read_action))
@@ -150,3 +184,47 @@ void IoService::poll (int ms)
 		}
 	}
 }
+
+void IoService::poll_edge (IoNode* node, int flg)
+{
+	EventAction* act;
+	Event ok;
+	
+	// an edge only tells that something changed, the channels find out what
+	if ((flg & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)))
+		node->readable = true;
+	if ((flg & (EPOLLOUT | EPOLLHUP | EPOLLERR)))
+		node->writable = true;
+	
+	if (node->reading && node->readable && (act = node->read_action))
+	{
+		Event& ev = (act->callback_ ? act->callback_->param () : ok);
+		if (read_channel (node->fd, ev, 1))
+			schedule (act), node->reading = false;
+		else
+			node->readable = false;
+	}
+	
+	if (node->writing && node->writable && (act = node->write_action))
+	{
+		Event& ev = (act->callback_ ? act->callback_->param () : ok);
+		bool done = false;
+		switch (act->mode_)
+		{
+		case StreamModeConnect:
+			ev.type_ = ((flg & EPOLLOUT) ? Event::Done : Event::Error);
+			done = true;
+			break;
+		case StreamModeWrite:
+			done = write_channel (node->fd, ev);
+			break;
+		case StreamModeEnd:
+			done = close_channel (node->fd, ev);
+			break;
+		}
+		if (done)
+			schedule (act), node->writing = false;
+		else
+			node->writable = false;
+	}
+}
@@ -17,12 +17,14 @@ namespace
 {
 	static void signal_reload (int)   { event_system.reload (); }
 	static void signal_stop (int)     { event_system.stop (); }
+	static void signal_dump (int)     { event_system.dump (); }
 }
 
-EventSystem::EventSystem () : log_ ("/event/system"), reload_ (false), stop_ (false)
+EventSystem::EventSystem () : log_ ("/event/system"), reload_ (false), stop_ (false), dump_ (false)
 {
 	::signal (SIGHUP, signal_reload);
 	::signal (SIGINT, signal_stop);
+	::signal (SIGUSR1, signal_dump);
 	::signal (SIGPIPE, SIG_IGN);
 	
 	struct rlimit rlim;
@@ -74,6 +76,13 @@ void EventSystem::run ()
 			::signal (SIGHUP, signal_reload);
 		}
 
+		if (dump_) 
+		{
+			interest_queue_[EventInterestDump].drain ();
+			dump_ = false;
+			::signal (SIGUSR1, signal_dump);
+		}
+
 		if (stop_) 
 		{
 			if (! interest_queue_[EventInterestStop].empty ()) 
@@ -96,6 +105,13 @@ void EventSystem::reload ()
 	gateway_.wakeup ();
 }
 
+void EventSystem::dump ()
+{
+	::signal (SIGUSR1, SIG_IGN);
+	dump_ = true;
+	gateway_.wakeup ();
+}
+
 void EventSystem::stop ()
 {
 	::signal (SIGINT, SIG_IGN);
@@ -18,6 +18,7 @@
 #include <event/object_callback.h>
 #include <event/callback_queue.h>
 #include <event/event_message.h>
+#include <event/object_pool.h>
 #include <event/io_service.h>
 
 class EventAction;
@@ -26,6 +27,7 @@ enum EventInterest
 {
 	EventInterestReload,
 	EventInterestStop,
+	EventInterestDump,
 	EventInterests
 };
 
@@ -46,7 +48,7 @@ private:
 	IoService io_service_;
 	WaitBuffer<EventMessage> gateway_;
 	CallbackQueue interest_queue_[EventInterests];
-	bool reload_, stop_;
+	bool reload_, stop_, dump_;
 	
 public:
 	EventSystem ();
@@ -54,6 +56,7 @@ public:
 	void run ();
 	void reload ();
 	void stop ();
+	void dump ();
 	
 	Action* register_interest (EventInterest interest, Callback* cb);
 	Action* track (int fd, StreamMode mode, EventCallback* cb);
@@ -62,7 +65,7 @@ public:
 	int take_message (const EventMessage& msg)   { return gateway_.write (msg); }
 };
 
-class EventAction : public Action 
+class EventAction : public Action, public PoolObject<EventAction>
 {
 public:
 	EventSystem& system_;
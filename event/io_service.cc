@@ -20,6 +20,7 @@
 IoService::IoService () : Thread ("IoService"), log_ ("/io/thread")
 {
 	timeout_ = handle_ = rfd_ = wfd_ = -1;
+	edge_ = false;
 	
 	int fd[2];
 	if (::pipe (fd) == 0)
@@ -41,7 +42,7 @@ void IoService::main ()
 	INFO(log_) << "Starting IO thread.";
 	
 	open_resources ();
-	IoNode node = {rfd_, true, false, 0, 0};
+	IoNode node = {rfd_, true, false, 0, 0, true, false, true, true};
 	set_fd (rfd_, 1, 0, &node);
 	
 	while (! stop_) 
@@ -73,10 +74,18 @@ void IoService::stop ()
 
 void IoService::handle_request (EventAction* act)
 {
+	std::map<int, IoNode>::iterator it;
 	Event ev;
 	
 	if (act)
 	{
+		/*
+		 * With edge triggered polling the readiness last seen for the
+		 * descriptor is kept in its node, so that a request which cannot
+		 * complete yet is just attached to it without any system call.
+		 */
+		it = (edge_ ? fd_map_.find (act->fd_) : fd_map_.end ());
+		
 		switch (act->mode_) 
 		{
 		case StreamModeConnect:
@@ -91,17 +100,21 @@ void IoService::handle_request (EventAction* act)
 			break;
 			
 		case StreamModeRead:
-			if (read_channel (act->fd_, (act->callback_ ? act->callback_->param () : ev), 1))
+			if (it != fd_map_.end () && ! it->second.readable)
+				track (act);
+			else if (read_channel (act->fd_, (act->callback_ ? act->callback_->param () : ev), 1))
 				schedule (act);
 			else
-				track (act);
+				track (act, true);
 			break;
 			
 		case StreamModeWrite:
-			if (write_channel (act->fd_, (act->callback_ ? act->callback_->param () : ev)))
+			if (it != fd_map_.end () && ! it->second.writable)
+				track (act);
+			else if (write_channel (act->fd_, (act->callback_ ? act->callback_->param () : ev)))
 				schedule (act);
 			else
-				track (act);
+				track (act, true);
 			break;
 			
 		case StreamModeWait:
@@ -186,16 +199,19 @@ bool IoService::read_channel (int fd, Event& ev, int flg)
 bool IoService::write_channel (int fd, Event& ev)
 {
 	struct iovec iov[IOV_MAX];
-	size_t iovcnt;
+	size_t iovcnt, want, i;
 	ssize_t len;
 	
-	if (ev.buffer_.empty ()) 
-	{
-		ev.type_ = Event::Done;
-	}
-	else 
+	/*
+	 * A buffer longer than fits in one vector is written in several calls,
+	 * until the kernel takes less than it is offered: with edge triggered
+	 * polling no other event would come for a socket that is not full.
+	 */
+	while (! ev.buffer_.empty ()) 
 	{
 		iovcnt = ev.buffer_.fill_iovec (iov, IOV_MAX);
+		for (want = 0, i = 0; i < iovcnt; ++i)
+			want += iov[i].iov_len;
 		len = ::writev (fd, iov, iovcnt);
 		if (len < 0) 
 		{
@@ -206,20 +222,15 @@ bool IoService::write_channel (int fd, Event& ev)
 			default:
 				ev.type_ = Event::Error;
 				ev.error_ = errno;
-				break;
+				return true;
 			}
 		}
-		else if ((size_t) len < ev.buffer_.length ()) 
-		{
-			ev.buffer_.skip (len);
+		ev.buffer_.skip (len);
+		if ((size_t) len < want) 
 			return false;
-		}
-		else 
-		{
-			ev.type_ = Event::Done;
-		}
 	}
 	
+	ev.type_ = Event::Done;
 	return true;
 }
 
@@ -231,10 +242,25 @@ bool IoService::close_channel (int fd, Event& ev)
 		
 	ev.type_ = Event::Done;
 
+	/*
+	 * Closing took the descriptor out of the poll set, and its number may
+	 * come back for another socket, even a listening one. The node goes
+	 * with it unless some request still waits on it, in which case it is
+	 * dropped when that request ends.
+	 */
+	std::map<int, IoNode>::iterator it = fd_map_.find (fd);
+	if (it != fd_map_.end ())
+	{
+		if (it->second.read_action == 0 && it->second.write_action == 0)
+			fd_map_.erase (it);
+		else
+			it->second.registered = false, it->second.readable = it->second.writable = true;
+	}
+
 	return true;
 }
 
-void IoService::track (EventAction* act)
+void IoService::track (EventAction* act, bool blocked)
 {
 	std::map<int, IoNode>::iterator it;
 	int fd;
@@ -250,8 +276,9 @@ void IoService::track (EventAction* act)
 		case StreamModeRead:
 			if (it == fd_map_.end ()) 
 			{
-				IoNode node = {fd, true, false, act, 0};
-				set_fd (fd, 1, 0, &(fd_map_[fd] = node));
+				IoNode node = {fd, true, false, act, 0, (! edge_ || act->mode_ == StreamModeAccept), false, true, true};
+				it = fd_map_.insert (std::make_pair (fd, node)).first;
+				set_fd (fd, 1, 0, &it->second);
 			}
 			else if (act->mode_ == StreamModeRead)
 			{
@@ -262,7 +289,10 @@ void IoService::track (EventAction* act)
 			{
 				if (act->callback_) act->callback_->param ().type_ = Event::Error;
 				schedule (act);
+				break;
 			}
+			if (blocked)
+				it->second.readable = false;
 			break;
 			
 		case StreamModeConnect:
@@ -270,10 +300,11 @@ void IoService::track (EventAction* act)
 		case StreamModeEnd:
 			if (it == fd_map_.end ()) 
 			{
-				IoNode node = {fd, false, true, 0, act};
-				set_fd (fd, 0, 1, &(fd_map_[fd] = node));
+				IoNode node = {fd, false, true, 0, act, ! edge_, false, true, true};
+				it = fd_map_.insert (std::make_pair (fd, node)).first;
+				set_fd (fd, 0, 1, &it->second);
 			}
-			else if (act->mode_ == StreamModeWrite)
+			else if (! it->second.writing)
 			{
 				it->second.writing = true,	it->second.write_action = act;
 				set_fd (fd, (it->second.reading ? 2 : 0), 1, &it->second);
@@ -282,7 +313,10 @@ void IoService::track (EventAction* act)
 			{
 				if (act->callback_) act->callback_->param ().type_ = Event::Error;
 				schedule (act);
+				break;
 			}
+			if (blocked || act->mode_ == StreamModeConnect)
+				it->second.writable = false;
 			break;
 		}
 	}
@@ -303,9 +337,7 @@ void IoService::cancel (EventAction* act)
 			if (it != fd_map_.end () && it->second.read_action == act) 
 			{
 				it->second.reading = false, it->second.read_action = 0;
-				if (it->second.write_action == 0)
-					fd_map_.erase (it);
-				set_fd (act->fd_, -1, (it->second.writing ? 2 : 0), &it->second);
+				release (it, -1, (it->second.writing ? 2 : 0));
 			}
 			break;
 			
@@ -316,9 +348,7 @@ void IoService::cancel (EventAction* act)
 			if (it != fd_map_.end () && it->second.write_action == act) 
 			{
 				it->second.writing = false, it->second.write_action = 0;
-				if (it->second.read_action == 0)
-					fd_map_.erase (it);
-				set_fd (act->fd_, (it->second.reading ? 2 : 0), -1, &it->second);
+				release (it, (it->second.reading ? 2 : 0), -1, (act->mode_ == StreamModeEnd));
 			}
 			break;
 			
@@ -340,6 +370,29 @@ void IoService::cancel (EventAction* act)
 	}
 }
 
+void IoService::release (std::map<int, IoNode>::iterator it, int rd, int wr, bool closing)
+{
+	IoNode& node = it->second;
+	
+	/*
+	 * Level triggered descriptors are polled only while some request is
+	 * waiting on them. Edge triggered ones stay registered, and their node
+	 * with them, until the descriptor is closed.
+	 */
+	if (node.level)
+	{
+		set_fd (node.fd, rd, wr, &node);
+		if (node.read_action == 0 && node.write_action == 0)
+			fd_map_.erase (it);
+		return;
+	}
+	
+	if (closing && node.registered)
+		set_fd (node.fd, -1, -1, &node);
+	if (! node.registered && node.read_action == 0 && node.write_action == 0)
+		fd_map_.erase (it);
+}
+
 void IoService::wakeup_readers ()
 {
 	std::deque<WaitNode>::iterator w;
@@ -33,6 +33,10 @@ struct IoNode
 	bool writing;
 	EventAction* read_action;
 	EventAction* write_action;
+	bool level;
+	bool registered;
+	bool readable;
+	bool writable;
 };
 
 struct WaitNode
@@ -52,6 +56,7 @@ private:
 	int timeout_;
 	int handle_;
 	int rfd_, wfd_;
+	bool edge_;
 	
 public:
 	IoService ();
@@ -66,8 +71,9 @@ private:
 	bool read_channel (int fd, Event& ev, int flg);
 	bool write_channel (int fd, Event& ev);
 	bool close_channel (int fd, Event& ev);
-	void track (EventAction* act);
+	void track (EventAction* act, bool blocked = false);
 	void cancel (EventAction* act);
+	void release (std::map<int, IoNode>::iterator it, int rd, int wr, bool closing = false);
 	void wakeup_readers ();
 	void schedule (EventAction* act);
 	void terminate (EventAction* act);
@@ -76,6 +82,7 @@ private:
 	void close_resources ();
 	void set_fd (int fd, int rd, int wr, IoNode* node = 0);
 	void poll (int ms);
+	void poll_edge (IoNode* node, int flg);
 
 public:
 	bool idle () const									{ return fd_map_.empty (); }
@@ -27,6 +27,7 @@
 #define	EVENT_OBJECT_CALLBACK_H
 
 #include <event/callback.h>
+#include <event/object_pool.h>
 
 ////////////////////////////////////////////////////////////////////////////////
 //                                                                            //
@@ -39,7 +40,7 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 template<class C>
-class ObjectMethodCallback : public Callback {
+class ObjectMethodCallback : public Callback, public PoolObject<ObjectMethodCallback<C> > {
 public:
 	typedef void (C::*const method_t)(void);
 
@@ -64,7 +65,7 @@ public:
 };
 
 template<class C, typename A>
-class ObjectMethodArgCallback : public Callback {
+class ObjectMethodArgCallback : public Callback, public PoolObject<ObjectMethodArgCallback<C, A> > {
 public:
 	typedef void (C::*const method_t)(A);
 
@@ -0,0 +1,71 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// File:           object_pool.h                                              //
+// Description:    recycling of the small objects used by the event system    //
+// Project:        WANProxy XTech                                             //
+// Author:         Andreu Vidal Bramfeld-Software                             //
+// Last modified:  2026-10-19                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef	EVENT_OBJECT_POOL_H
+#define	EVENT_OBJECT_POOL_H
+
+#include <stddef.h>
+#include <new>
+
+#define	USING_OBJECT_POOL			1
+#define	OBJECT_POOL_LIMIT			256
+
+/*
+ * Every read, write or timer request allocates an action and a callback
+ * which are freed once the request completes. Classes deriving from
+ * PoolObject<T> keep up to OBJECT_POOL_LIMIT freed instances of T aside
+ * and hand them out again instead of going to the heap.
+ *
+ * The pools are not locked: these objects must only be created and
+ * destroyed by the thread running the event system. Derived classes
+ * bigger than T are not pooled.
+ */
+template<class T> class PoolObject
+{
+	struct Node
+	{
+		Node* next_;
+	};
+
+	static Node* spare_;
+	static unsigned count_;
+
+public:
+	static void* operator new (size_t size)
+	{
+#if USING_OBJECT_POOL
+		if (spare_ && size == sizeof (T))
+		{
+			Node* n = spare_;
+			spare_ = n->next_, count_--;
+			return n;
+		}
+#endif
+		return ::operator new (size);
+	}
+
+	static void operator delete (void* p, size_t size)
+	{
+#if USING_OBJECT_POOL
+		if (p && size == sizeof (T) && count_ < OBJECT_POOL_LIMIT)
+		{
+			Node* n = (Node*) p;
+			n->next_ = spare_, spare_ = n, count_++;
+			return;
+		}
+#endif
+		::operator delete (p);
+	}
+};
+
+template<class T> typename PoolObject<T>::Node* PoolObject<T>::spare_ = 0;
+template<class T> unsigned PoolObject<T>::count_ = 0;
+
+#endif /* !EVENT_OBJECT_POOL_H */
@@ -27,6 +27,7 @@
 #define	EVENT_TYPED_CALLBACK_H
 
 #include <event/callback.h>
+#include <event/object_pool.h>
 
 ////////////////////////////////////////////////////////////////////////////////
 //                                                                            //
@@ -70,7 +71,7 @@ public:
 };
 
 template<typename T, class C>
-class ObjectTypedCallback : public TypedCallback<T> {
+class ObjectTypedCallback : public TypedCallback<T>, public PoolObject<ObjectTypedCallback<T, C> > {
 public:
 	typedef void (C::*const method_t)(T);
 
@@ -95,7 +96,7 @@ public:
 };
 
 template<typename T, class C, typename A>
-class ObjectTypedArgCallback : public TypedCallback<T> {
+class ObjectTypedArgCallback : public TypedCallback<T>, public PoolObject<ObjectTypedArgCallback<T, C, A> > {
 public:
 	typedef void (C::*const method_t)(T, A);
 
@@ -27,6 +27,7 @@
 #define	EVENT_TYPED_PAIR_CALLBACK_H
 
 #include <event/callback.h>
+#include <event/object_pool.h>
 
 ////////////////////////////////////////////////////////////////////////////////
 //                                                                            //
@@ -71,7 +72,7 @@ public:
 };
 
 template<typename Ta, typename Tb, class C>
-class ObjectTypedPairCallback : public TypedPairCallback<Ta, Tb> {
+class ObjectTypedPairCallback : public TypedPairCallback<Ta, Tb>, public PoolObject<ObjectTypedPairCallback<Ta, Tb, C> > {
 public:
 	typedef void (C::*const method_t)(Ta, Tb);
 
@@ -97,7 +98,7 @@ public:
 };
 
 template<typename Ta, typename Tb, class C, typename A>
-class ObjectTypedPairArgCallback : public TypedPairCallback<Ta, Tb> {
+class ObjectTypedPairArgCallback : public TypedPairCallback<Ta, Tb>, public PoolObject<ObjectTypedPairArgCallback<Ta, Tb, C, A> > {
 public:
 	typedef void (C::*const method_t)(Ta, Tb, A);
 
@@ -35,29 +35,52 @@
 //                                                                            //
 ////////////////////////////////////////////////////////////////////////////////
 
-bool TCPServer::listen (SocketAddressFamily family, const std::string& name)
+bool TCPServer::listen (SocketAddressFamily family, const std::string& name, int count, int backlog)
 {
-	if (socket_)
+	for (unsigned i = 0; i < sockets_.size (); ++i)
 	{
-		socket_->close (0);
-		delete socket_;
+		sockets_[i]->close (0);
+		delete sockets_[i];
 	}
-	
-	socket_ = Socket::create (family, SocketTypeStream, "tcp", name);
-	if (! socket_) 
-	{
-		ERROR("/tcp/server") << "Unable to create socket.";
-		return false;
-	}
-	if (! socket_->bind (name)) 
+	sockets_.clear ();
+
+	/*
+	 * More than one socket can be opened on the same address, each with its
+	 * own queue of pending connections, so that bursts are shared among them.
+	 */
+	for (int i = 0; i < (count > 1 ? count : 1); ++i)
 	{
-		ERROR("/tcp/server") << "Socket bind failed";
-		return false;
+		Socket* sck = Socket::create (family, SocketTypeStream, "tcp", name);
+		if (! sck) 
+		{
+			ERROR("/tcp/server") << "Unable to create socket.";
+			return false;
+		}
+		sockets_.push_back (sck);
+		if (! sck->bind (name, (count > 1))) 
+		{
+			ERROR("/tcp/server") << "Socket bind failed";
+			return false;
+		}
+		if (! sck->listen (backlog)) 
+		{
+			ERROR("/tcp/server") << "Socket listen failed";
+			return false;
+		}
 	}
-	if (! socket_->listen ()) 
+	
+	return true;
+}
+
+bool TCPServer::relisten (int backlog)
+{
+	for (unsigned i = 0; i < sockets_.size (); ++i)
 	{
-		ERROR("/tcp/server") << "Socket listen failed";
-		return false;
+		if (! sockets_[i]->listen (backlog)) 
+		{
+			ERROR("/tcp/server") << "Socket listen failed";
+			return false;
+		}
 	}
 	
 	return true;
@@ -26,6 +26,7 @@
 #ifndef	IO_NET_TCP_SERVER_H
 #define	IO_NET_TCP_SERVER_H
 
+#include <vector>
 #include <io/socket/socket.h>
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -41,32 +42,40 @@
 class TCPServer 
 {
 	LogHandle log_;
-	Socket* socket_;
+	std::vector<Socket*> sockets_;
 
 public:
-	TCPServer () : log_("/tcp/server"), socket_(0)
+	TCPServer () : log_("/tcp/server")
 	{ }
 
 	~TCPServer ()
 	{
-		delete socket_;
+		for (unsigned i = 0; i < sockets_.size (); ++i)
+			delete sockets_[i];
 	}
 
-	bool listen (SocketAddressFamily family, const std::string& name);
+	bool listen (SocketAddressFamily family, const std::string& name, int count = 1, int backlog = SOCKET_LISTEN_BACKLOG);
+	bool relisten (int backlog);
 	
-	Action* accept (SocketEventCallback* cb)
+	int count () const
 	{
-		return (socket_ ? socket_->accept (cb) : 0);
+		return sockets_.size ();
 	}
 
-	Action* close (EventCallback* cb = 0)
+	Action* accept (SocketEventCallback* cb, int index = 0)
 	{
-		return (socket_ ? socket_->close (cb) : 0);
+		return (index < count () ? sockets_[index]->accept (cb) : 0);
+	}
+
+	void close ()
+	{
+		for (unsigned i = 0; i < sockets_.size (); ++i)
+			sockets_[i]->close (0);
 	}
 
 	std::string getsockname () const
 	{
-		return (socket_ ? socket_->getsockname () : std::string ());
+		return (sockets_.empty () ? std::string () : sockets_[0]->getsockname ());
 	}
 };
 
@@ -14,49 +14,84 @@
 
 SinkFilter::SinkFilter (const LogHandle& log, Socket* sck, bool cln) : BufferedFilter (log)   
 { 
-	sink_ = sck; write_action_ = 0; client_ = cln, down_ = closing_ = false; 
+	sink_ = sck; write_action_ = 0; writing_ = held_ = 0; client_ = cln, down_ = closing_ = false; 
 }
 
 SinkFilter::~SinkFilter ()   
 { 
 	if (write_action_) write_action_->cancel (); 
+	hold (held_, 0);
 }
 
 bool SinkFilter::consume (Buffer& buf, int flg)
 {
-	if (! sink_ || closing_)
+	if (closing_)
 		return false;
+	
+	trace (TraceWrite, buf.length (), (! sink_ ? 2 : write_action_ ? 1 : 0));
+	if (! sink_)
+	{
+		pending_.append (buf);
+		hold (held_, pending_.length ());
+		return true;
+	}
 		
 	if (write_action_)
 		pending_.append (buf);
 	else
-		write_action_ = sink_->write (buf, callback (this, &SinkFilter::write_complete));
+		write (buf);
+	hold (held_, pending_.length () + writing_);
 	
 	return (write_action_ != 0);
 }
 
+void SinkFilter::attach (Socket* sck)
+{
+	if (sink_ || ! sck)
+		return;
+		
+	sink_ = sck;
+	if (! pending_.empty ())
+	{
+		write (pending_);
+		pending_.clear ();
+	}
+	else if (flushing_)
+		flush (0);
+}
+
 void SinkFilter::write_complete (Event e)
 {
 	if (write_action_)
 		write_action_->cancel (), write_action_ = 0;
+	writing_ = 0;
 		
 	switch (e.type_) 
 	{
 	case Event::Done:
+		trace (TraceWritten, pending_.length ());
 		if (! pending_.empty ())
 		{
-			write_action_ = sink_->write (pending_, callback (this, &SinkFilter::write_complete));
+			write (pending_);
 			pending_.clear ();
+			hold (held_, writing_);
+		}
+		else
+		{
+			hold (held_, 0);
+			if (flushing_)
+				flush (0);
 		}
-		else if (flushing_)
-			flush (0);
 		break;
 	case Event::Error:
+		trace (TraceWriteError, e.error_);
 		if (e.error_ == EPIPE && client_)
 			DEBUG(log_) << "Client closed connection";
 		else
 			ERROR(log_) << "Write failed: " << e;
 		closing_ = true;
+		pending_.clear ();
+		hold (held_, 0);
 		break;
 	}
 }
@@ -65,10 +100,18 @@ void SinkFilter::flush (int flg)
 {
 	flushing_ = true;
 	flush_flags_ |= flg;
-	if (flushing_ && ! write_action_)
+	if (flushing_ && ! write_action_ && sink_)
 	{
 		if (! down_)
-			down_ = (sink_->shutdown (false, true) == 0);
+			down_ = (sink_->shutdown (false, true) == 0), trace (TraceClose);
 		Filter::flush (flush_flags_);
 	}
 }
+
+void SinkFilter::write (Buffer& buf)
+{
+	writing_ = buf.length ();
+	write_action_ = sink_->write (buf, callback (this, &SinkFilter::write_complete));
+	if (! write_action_)
+		writing_ = 0;
+}
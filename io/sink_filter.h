@@ -18,6 +18,7 @@ class SinkFilter : public BufferedFilter
 private:
    Socket* sink_;
 	Action* write_action_;
+	intmax_t writing_, held_;
 	bool client_, down_, closing_;
    
 public:
@@ -25,7 +26,12 @@ public:
 	virtual ~SinkFilter ();
    
    virtual bool consume (Buffer& buf, int flg = 0);
+	void attach (Socket* sck);
+	size_t backlog () const   { return pending_.length () + writing_; }
 	void write_complete (Event e);
    virtual void flush (int flg);
+
+private:
+	void write (Buffer& buf);
 };
 
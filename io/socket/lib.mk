@@ -2,6 +2,7 @@ VPATH+=	${TOPDIR}/io/socket
 
 SRCS+=	socket.cc
 SRCS+=	unix_server.cc
+SRCS+=	resolver.cc
 
 ifeq "${OSNAME}" "Haiku"
 # Required for sockets.
@@ -0,0 +1,323 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// File:           resolver.cc                                                //
+// Description:    background name resolution with a cache of answers         //
+// Project:        WANProxy XTech                                             //
+// Author:         Andreu Vidal Bramfeld-Software                             //
+// Last modified:  2026-10-19                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <string.h>
+#include <sys/errno.h>
+#include <sstream>
+#include <event/event_system.h>
+#include <io/socket/resolver.h>
+
+/*
+ * getaddrinfo() may block for as long as the name servers take to answer,
+ * so lookups missing from the cache are done by a helper thread which
+ * signals the answers back through a pipe watched by the event system.
+ * As the answers carry no TTL, they are kept for a fixed time, and go on
+ * serving for a while after it while a fresh one is fetched behind them.
+ */
+
+std::string ResolverQuery::key () const
+{
+	std::ostringstream os;
+	os << family_ << '/' << socktype_ << '/' << protocol_ << '/' << host_ << '/' << service_;
+	return os.str ();
+}
+
+Resolver::Resolver () : Thread ("Resolver"), log_("/io/resolver")
+{
+	pthread_mutex_init (&mutex_, 0);
+	pthread_cond_init (&ready_, 0);
+	running_ = 0;
+	read_action_ = stop_action_ = 0;
+	rfd_ = wfd_ = -1;
+	started_ = false;
+}
+
+Resolver::~Resolver ()
+{
+	pthread_mutex_destroy (&mutex_);
+	pthread_cond_destroy (&ready_);
+	if (rfd_ >= 0)
+		::close (rfd_);
+	if (wfd_ >= 0)
+		::close (wfd_);
+}
+
+bool Resolver::lookup (const ResolverQuery& query, Buffer& address)
+{
+	std::map<std::string, Entry>::iterator it = cache_.find (query.key ());
+	time_t now = ::time (0);
+	if (it == cache_.end () || it->second.error_ || it->second.stale_ < now)
+		return false;
+
+	if (it->second.expiry_ < now && ! it->second.refreshing_ && (started_ || launch ()))
+	{
+		it->second.refreshing_ = true;
+		pthread_mutex_lock (&mutex_);
+		queries_.push_back (query);
+		pthread_cond_signal (&ready_);
+		pthread_mutex_unlock (&mutex_);
+	}
+
+	address = it->second.address_;
+	return true;
+}
+
+bool Resolver::resolve (const ResolverQuery& query, Buffer& address)
+{
+	if (lookup (query, address))
+		return true;
+
+	std::string key = query.key ();
+	std::map<std::string, Entry>::iterator it = cache_.find (key);
+	if (it == cache_.end () || it->second.expiry_ < ::time (0))
+	{
+		struct sockaddr_storage ss;
+		socklen_t len;
+		int rv = fetch (query, ss, len);
+		Buffer found;
+		if (rv == 0)
+			found.append ((uint8_t*) &ss, len);
+		else
+			ERROR(log_) << "Could not look up " << query.host_ << ": " << gai_strerror (rv);
+		store (key, found, rv);
+		it = cache_.find (key);
+	}
+
+	if (it->second.error_)
+		return false;
+	address = it->second.address_;
+	return true;
+}
+
+Action* Resolver::resolve (const ResolverQuery& query, EventCallback* cb)
+{
+	if (! started_ && ! launch ())
+	{
+		delete cb;
+		return 0;
+	}
+
+	std::string key = query.key ();
+	bool queued = (pending_.find (key) != pending_.end ());
+	Request* req = new Request (this, key, cb);
+	pending_.insert (std::make_pair (key, req));
+
+	if (! queued)
+	{
+		std::map<std::string, Entry>::iterator it = cache_.find (key);
+		pthread_mutex_lock (&mutex_);
+		if (it != cache_.end () && it->second.error_ && it->second.expiry_ >= ::time (0))
+		{
+			// a recent failure is answered again without asking
+			Answer a;
+			a.key_ = key, a.host_ = query.host_, a.length_ = 0, a.error_ = it->second.error_, a.cached_ = true;
+			answers_.push_back (a);
+			::write (wfd_, "*", 1);
+		}
+		else
+		{
+			queries_.push_back (query);
+			pthread_cond_signal (&ready_);
+		}
+		pthread_mutex_unlock (&mutex_);
+	}
+
+	return req;
+}
+
+void Resolver::main ()
+{
+	while (1)
+	{
+		pthread_mutex_lock (&mutex_);
+		while (queries_.empty () && ! stop_)
+			pthread_cond_wait (&ready_, &mutex_);
+		if (stop_)
+		{
+			pthread_mutex_unlock (&mutex_);
+			break;
+		}
+		ResolverQuery query = queries_.front ();
+		queries_.pop_front ();
+		pthread_mutex_unlock (&mutex_);
+
+		Answer a;
+		a.key_ = query.key ();
+		a.host_ = query.host_;
+		a.length_ = 0, a.cached_ = false;
+		a.error_ = fetch (query, a.address_, a.length_);
+
+		pthread_mutex_lock (&mutex_);
+		answers_.push_back (a);
+		pthread_mutex_unlock (&mutex_);
+		::write (wfd_, "*", 1);
+	}
+}
+
+void Resolver::stop ()
+{
+	if (! started_)
+		return;
+
+	pthread_mutex_lock (&mutex_);
+	stop_ = true;
+	pthread_cond_signal (&ready_);
+	pthread_mutex_unlock (&mutex_);
+	Thread::stop ();
+	started_ = false;
+}
+
+bool Resolver::launch ()
+{
+	int fd[2];
+	if (rfd_ < 0)
+	{
+		if (::pipe (fd) != 0)
+		{
+			ERROR(log_) << "Could not create resolver pipe: " << strerror (errno);
+			return false;
+		}
+		rfd_ = fd[0], wfd_ = fd[1];
+		::fcntl (rfd_, F_SETFL, ::fcntl (rfd_, F_GETFL) | O_NONBLOCK);
+		::fcntl (wfd_, F_SETFL, ::fcntl (wfd_, F_GETFL) | O_NONBLOCK);
+	}
+
+	stop_ = false;
+	if (! start ())
+		return false;
+
+	started_ = true;
+	read_action_ = event_system.track (rfd_, StreamModeRead, callback (this, &Resolver::on_answers));
+	stop_action_ = event_system.register_interest (EventInterestStop, callback (this, &Resolver::shutdown));
+	return true;
+}
+
+void Resolver::cancel (Request* req)
+{
+	if (req == running_)
+		return;
+
+	std::multimap<std::string, Request*>::iterator it;
+	for (it = pending_.lower_bound (req->key_); it != pending_.end () && it->first == req->key_; ++it)
+	{
+		if (it->second == req)
+		{
+			pending_.erase (it);
+			break;
+		}
+	}
+	delete req;
+}
+
+void Resolver::store (const std::string& key, const Buffer& address, int error)
+{
+	Entry& e = cache_[key];
+	time_t now = ::time (0);
+
+	e.refreshing_ = false;
+	if (error && ! e.error_ && ! e.address_.empty () && e.stale_ >= now)
+	{
+		// the name servers failing, the last answer serves until it goes stale
+		e.expiry_ = now + RESOLVER_NEGATIVE_TTL;
+		return;
+	}
+
+	e.address_ = address;
+	e.error_ = error;
+	e.expiry_ = now + (error ? RESOLVER_NEGATIVE_TTL : RESOLVER_CACHE_TTL);
+	e.stale_ = (error ? e.expiry_ : e.expiry_ + RESOLVER_STALE_TTL);
+}
+
+void Resolver::on_answers (Event e)
+{
+	if (read_action_)
+		read_action_->cancel (), read_action_ = 0;
+	if (e.type_ != Event::Done)
+	{
+		ERROR(log_) << "Unexpected event: " << e;
+		return;
+	}
+	read_action_ = event_system.track (rfd_, StreamModeRead, callback (this, &Resolver::on_answers));
+
+	std::deque<Answer> answers;
+	pthread_mutex_lock (&mutex_);
+	answers.swap (answers_);
+	pthread_mutex_unlock (&mutex_);
+
+	while (! answers.empty ())
+	{
+		Answer& a = answers.front ();
+		Buffer address;
+		if (! a.cached_)
+		{
+			if (a.error_ == 0)
+				address.append ((uint8_t*) &a.address_, a.length_);
+			else
+				INFO(log_) << "Could not look up " << a.host_ << ": " << gai_strerror (a.error_);
+			store (a.key_, address, a.error_);
+		}
+
+		std::multimap<std::string, Request*>::iterator it;
+		while ((it = pending_.find (a.key_)) != pending_.end ())
+		{
+			Request* req = it->second;
+			pending_.erase (it);
+			if (req->callback_)
+			{
+				running_ = req;
+				req->callback_->param () = (a.error_ ? Event (Event::Error, EHOSTUNREACH) : Event (Event::Done, address));
+				req->callback_->execute ();
+				running_ = 0;
+			}
+			if (req->is_cancelled ())
+				delete req;
+		}
+		answers.pop_front ();
+	}
+}
+
+void Resolver::shutdown ()
+{
+	if (stop_action_)
+		stop_action_->cancel (), stop_action_ = 0;
+	if (read_action_)
+		read_action_->cancel (), read_action_ = 0;
+	stop ();
+}
+
+int Resolver::fetch (const ResolverQuery& query, struct sockaddr_storage& address, socklen_t& length)
+{
+	struct addrinfo hints, *ai;
+
+	memset (&hints, 0, sizeof hints);
+	hints.ai_family = query.family_;
+	hints.ai_socktype = query.socktype_;
+	hints.ai_protocol = query.protocol_;
+
+	/*
+	 * Mac OS X ~Snow Leopard~ cannot handle a service name of "0",
+	 * so no service is given in that case.
+	 */
+	const char* serv = (query.service_ == "" || query.service_ == "0" ? 0 : query.service_.c_str ());
+	int rv = getaddrinfo (query.host_.c_str (), serv, &hints, &ai);
+	if (rv != 0)
+		return rv;
+
+	// just use the first one
+	length = (ai->ai_addrlen <= sizeof address ? ai->ai_addrlen : sizeof address);
+	memcpy (&address, ai->ai_addr, length);
+	freeaddrinfo (ai);
+	return 0;
+}
+
+Resolver resolver;
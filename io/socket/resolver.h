@@ -0,0 +1,108 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// File:           resolver.h                                                 //
+// Description:    background name resolution with a cache of answers         //
+// Project:        WANProxy XTech                                             //
+// Author:         Andreu Vidal Bramfeld-Software                             //
+// Last modified:  2026-10-19                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef	IO_SOCKET_RESOLVER_H
+#define	IO_SOCKET_RESOLVER_H
+
+#include <map>
+#include <deque>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <common/buffer.h>
+#include <common/thread/thread.h>
+#include <event/action.h>
+#include <event/event.h>
+#include <event/event_callback.h>
+
+#define RESOLVER_CACHE_TTL			60
+#define RESOLVER_NEGATIVE_TTL		5
+#define RESOLVER_STALE_TTL			600
+
+struct ResolverQuery
+{
+	std::string host_;
+	std::string service_;
+	int family_, socktype_, protocol_;
+
+	ResolverQuery () : family_(0), socktype_(0), protocol_(0)   { }
+	std::string key () const;
+};
+
+class Resolver : public Thread
+{
+	class Request : public Action
+	{
+	public:
+		Resolver* resolver_;
+		std::string key_;
+		EventCallback* callback_;
+
+		Request (Resolver* rsv, const std::string& key, EventCallback* cb) : resolver_(rsv), key_(key), callback_(cb)   { }
+		~Request ()   { delete callback_; }
+		virtual void cancel ()   { cancelled_ = true; resolver_->cancel (this); }
+	};
+
+	struct Entry
+	{
+		Buffer address_;
+		int error_;
+		time_t expiry_;
+		time_t stale_;
+		bool refreshing_;
+
+		Entry () : error_(0), expiry_(0), stale_(0), refreshing_(false)   { }
+	};
+
+	struct Answer
+	{
+		std::string key_;
+		std::string host_;
+		struct sockaddr_storage address_;
+		socklen_t length_;
+		int error_;
+		bool cached_;
+	};
+
+	LogHandle log_;
+	pthread_mutex_t mutex_;
+	pthread_cond_t ready_;
+	std::deque<ResolverQuery> queries_;
+	std::deque<Answer> answers_;
+	std::map<std::string, Entry> cache_;
+	std::multimap<std::string, Request*> pending_;
+	Request* running_;
+	Action* read_action_;
+	Action* stop_action_;
+	int rfd_, wfd_;
+	bool started_;
+
+public:
+	Resolver ();
+	~Resolver ();
+
+	bool lookup (const ResolverQuery& query, Buffer& address);
+	bool resolve (const ResolverQuery& query, Buffer& address);
+	Action* resolve (const ResolverQuery& query, EventCallback* cb);
+
+	virtual void main ();
+	virtual void stop ();
+
+private:
+	bool launch ();
+	void cancel (Request* req);
+	void store (const std::string& key, const Buffer& address, int error);
+	void on_answers (Event e);
+	void shutdown ();
+	static int fetch (const ResolverQuery& query, struct sockaddr_storage& address, socklen_t& length);
+};
+
+extern Resolver resolver;
+
+#endif /* !IO_SOCKET_RESOLVER_H */
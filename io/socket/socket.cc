@@ -28,14 +28,17 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <netdb.h>
 #include <stdio.h>
+#include <unistd.h>
 #include <common/endian.h>
 #include <event/event_system.h>
 #include <io/socket/socket.h>
+#include <io/socket/resolver.h>
 
 ////////////////////////////////////////////////////////////////////////////////
 //                                                                            //
@@ -185,7 +188,7 @@ struct socket_address {
 		memset(&addr_, 0, sizeof addr_);
 	}
 
-	bool operator() (int domain, int socktype, int protocol, const std::string& str)
+	static bool parse(int domain, int socktype, int protocol, const std::string& str, ResolverQuery& query)
 	{
 		switch (domain) {
 #if defined(AF_INET6)
@@ -193,59 +196,55 @@ struct socket_address {
 		case AF_INET6:
 #endif
 		case AF_INET:
-		{
-			std::string name;
-			std::string service;
-
-			std::string::size_type pos = str.find(']');
-			if (pos != std::string::npos) {
-				if (pos < 3 || str[0] != '[' || str[pos + 1] != ':')
-					return (false);
-				name = str.substr(1, pos - 1);
-				service = str.substr(pos + 2);
-			} else {
-				pos = str.find(':');
-				if (pos == std::string::npos)
-					return (false);
-				name = str.substr(0, pos);
-				service = str.substr(pos + 1);
-			}
+			break;
+		default:
+			return (false);
+		}
 
-			struct addrinfo hints;
+		std::string::size_type pos = str.find(']');
+		if (pos != std::string::npos) {
+			if (pos < 3 || str[0] != '[' || str[pos + 1] != ':')
+				return (false);
+			query.host_ = str.substr(1, pos - 1);
+			query.service_ = str.substr(pos + 2);
+		} else {
+			pos = str.find(':');
+			if (pos == std::string::npos)
+				return (false);
+			query.host_ = str.substr(0, pos);
+			query.service_ = str.substr(pos + 1);
+		}
 
-			memset(&hints, 0, sizeof hints);
-			hints.ai_family = domain;
-			hints.ai_socktype = socktype;
-			hints.ai_protocol = protocol;
+		query.family_ = domain;
+		query.socktype_ = socktype;
+		query.protocol_ = protocol;
+		return (true);
+	}
 
-			/*
-			 * Mac OS X ~Snow Leopard~ cannot handle a service name
-			 * of "0" where older Mac OS X could.  Don't know if
-			 * that is because it's not in services(5) or due to
-			 * some attempt at input validation.  So work around it
-			 * here, sigh.
-			 */
-			const char *servptr;
-			if (service == "" || service == "0")
-				servptr = NULL;
-			else
-				servptr = service.c_str();
-
-			struct addrinfo *ai;
-			int rv = getaddrinfo(name.c_str(), servptr, &hints, &ai);
-			if (rv != 0) {
-				ERROR("/socket/address") << "Could not look up " << str << ": " << gai_strerror(rv);
+	bool operator() (int domain, int socktype, int protocol, const std::string& str)
+	{
+		switch (domain) {
+#if defined(AF_INET6)
+		case AF_UNSPEC:
+		case AF_INET6:
+#endif
+		case AF_INET:
+		{
+			ResolverQuery query;
+			Buffer address;
+
+			if (!parse(domain, socktype, protocol, str, query))
 				return (false);
-			}
 
 			/*
-			 * Just use the first one.
-			 * XXX Will we ever get one in the wrong family?  Is the hint mandatory?
+			 * This waits for the name servers on a cache miss, so it
+			 * only serves bind and connect without a resolver thread.
 			 */
-			memcpy(&addr_.sockaddr_, ai->ai_addr, ai->ai_addrlen);
-			addrlen_ = ai->ai_addrlen;
+			if (!resolver.resolve(query, address))
+				return (false);
 
-			freeaddrinfo(ai);
+			if (!set(address))
+				return (false);
 			break;
 		}
 		case AF_UNIX:
@@ -264,6 +263,15 @@ struct socket_address {
 		return (true);
 	}
 
+	bool set(const Buffer& address)
+	{
+		if (address.empty() || address.length() > sizeof addr_)
+			return (false);
+		address.copyout((uint8_t *)&addr_, address.length());
+		addrlen_ = address.length();
+		return (true);
+	}
+
 	operator std::string (void) const
 	{
 		std::ostringstream str;
@@ -305,8 +313,11 @@ Socket::Socket (int fd, int domain, int socktype, int protocol)
   domain_(domain),
   socktype_(socktype),
   protocol_(protocol),
+  unspecified_(false),
   accept_request_(0),
-  accept_check_(0)
+  accept_check_(0),
+  connect_request_(0),
+  connect_check_(0)
 {
 	ASSERT(log_, fd_ != -1);
 }
@@ -345,27 +356,37 @@ void Socket::accept_complete (Event e)
 		default:
 			HALT(log_) << "Unexpected event: " << e;
 		}
+	}
 
+	/*
+	 * Drain the backlog in one go, up to a limit so that a flood of
+	 * connections does not keep the established ones waiting.
+	 */
+	for (int n = 0; n < SOCKET_ACCEPT_BATCH && accept_request_ && (cb = accept_request_->callback_); ++n)
+	{
+#if defined(SOCK_NONBLOCK)
+		int s = ::accept4 (fd_, 0, 0, SOCK_NONBLOCK);
+#else
 		int s = ::accept (fd_, 0, 0);
+#endif
 		if (s == -1) 
 		{
-			switch (errno) 
-			{
-			case EAGAIN:
-				return;
-			default:
-				cb->param (Event(Event::Error, errno), 0);
-				cb->execute ();
-				return;
-			}
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			if (errno == ECONNABORTED || errno == EINTR)
+				continue;
+			cb->param (Event(Event::Error, errno), 0);
+			cb->execute ();
+			return;
 		}
 
 		Socket* sck = new Socket (s, domain_, socktype_, protocol_);
 		cb->param (Event::Done, sck);
 		cb->execute ();
+	}
 		
+	if (accept_request_ && ! accept_check_)
 		accept_check_ = event_system.track (fd_, StreamModeAccept, callback (this, &Socket::accept_complete));
-	}
 }
 
 void Socket::accept_cancel (void)
@@ -380,24 +401,146 @@ void Socket::accept_cancel (void)
 Action* Socket::connect (const std::string& name, EventCallback* cb)
 {
 	socket_address addr;
+	ResolverQuery query;
+	Buffer address;
+	int domain = (unspecified_ ? AF_UNSPEC : domain_);
+
+	ASSERT(log_, connect_request_ == 0);
+
+	/*
+	 * A name that is not in the cache is looked up by the resolver thread,
+	 * the connection being started once its answer arrives, so that a slow
+	 * name server does not hold up every other connection.
+	 */
+	if (cb && socket_address::parse (domain, socktype_, protocol_, name, query) && ! resolver.lookup (query, address))
+	{
+		connect_request_ = new SocketConnectAction (this, &Socket::connect_cancel, cb);
+		if ((connect_check_ = resolver.resolve (query, callback (this, &Socket::resolve_complete))))
+			return connect_request_;
+		// without the resolver thread the name is looked up right here
+		connect_request_->callback_ = 0;
+		connect_request_->cancel ();
+	}
 
-	if (! addr (domain_, socktype_, protocol_, name)) 
+	if (! (address.empty () ? addr (domain, socktype_, protocol_, name) : addr.set (address)))
 	{
 		ERROR(log_) << "Invalid name for connect: " << name;
 		return 0;
 	}
-	
+	if (! adapt (addr.addr_.sockaddr_.sa_family))
+		return 0;
+	prepare_connect ();
+
 	if (cb)
 		cb->param ().buffer_ = Buffer ((uint8_t*) &addr.addr_.sockaddr_, addr.addrlen_);
 	
 	return event_system.track (fd_, StreamModeConnect, cb);
 }
 
-bool Socket::bind (const std::string& name)
+void Socket::resolve_complete (Event e)
+{
+	socket_address addr;
+
+	if (connect_check_)
+		connect_check_->cancel (), connect_check_ = 0;
+
+	if (e.type_ != Event::Done)
+	{
+		connect_complete (e);
+		return;
+	}
+	if (! addr.set (e.buffer_) || ! adapt (addr.addr_.sockaddr_.sa_family))
+	{
+		connect_complete (Event (Event::Error, EAFNOSUPPORT));
+		return;
+	}
+	prepare_connect ();
+
+	EventCallback* cb = callback (this, &Socket::connect_complete);
+	cb->param ().buffer_ = e.buffer_;
+	connect_check_ = event_system.track (fd_, StreamModeConnect, cb);
+}
+
+void Socket::connect_complete (Event e)
+{
+	EventCallback* cb;
+
+	if (connect_check_)
+		connect_check_->cancel (), connect_check_ = 0;
+
+	// the requester normally cancels its action from within the callback
+	if (connect_request_ && (cb = connect_request_->callback_))
+	{
+		connect_request_->callback_ = 0;
+		cb->param () = e;
+		cb->execute ();
+		delete cb;
+	}
+}
+
+void Socket::connect_cancel (void)
+{
+	if (connect_check_)
+		connect_check_->cancel (), connect_check_ = 0;
+
+	delete connect_request_;
+	connect_request_ = 0;
+}
+
+/*
+ * A socket created before its name was resolved has a provisional family.
+ * Once the address is known its descriptor is replaced in place by one of
+ * the right family, which keeps the number its owner already holds.
+ */
+bool Socket::adapt (int domain)
+{
+	if (domain == domain_)
+		return (true);
+	if (! unspecified_)
+	{
+		ERROR(log_) << "Address family " << domain << " does not match the socket.";
+		return (false);
+	}
+
+	int s = ::socket (domain, socktype_, protocol_);
+	if (s == -1)
+	{
+		ERROR(log_) << "Could not create socket: " << strerror(errno);
+		return (false);
+	}
+	int rv = ::dup2 (s, fd_);
+	::close (s);
+	if (rv == -1)
+	{
+		ERROR(log_) << "Could not replace socket: " << strerror(errno);
+		return (false);
+	}
+	int flags = ::fcntl (fd_, F_GETFL, 0);
+	if (flags == -1 || ::fcntl (fd_, F_SETFL, flags | O_NONBLOCK) == -1)
+		ERROR(log_) << "Could not set flags for file descriptor, some operations may block.";
+
+	domain_ = domain;
+	return (true);
+}
+
+void Socket::prepare_connect ()
+{
+#ifdef TCP_FASTOPEN_CONNECT
+	// let the first write ride on the SYN when the peer has given us a cookie
+	if (socktype_ == SOCK_STREAM && domain_ != AF_UNIX)
+	{
+		int on = 1;
+		if (setsockopt (fd_, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &on, sizeof on) == -1)
+			DEBUG(log_) << "Could not setsockopt(TCP_FASTOPEN_CONNECT): " << strerror(errno);
+	}
+#endif
+}
+
+bool Socket::bind (const std::string& name, bool shared)
 {
 	socket_address addr;
 
-	if (! addr (domain_, socktype_, protocol_, name)) 
+	if (! addr ((unspecified_ ? AF_UNSPEC : domain_), socktype_, protocol_, name) || ! adapt (addr.addr_.sockaddr_.sa_family)) 
 	{
 		ERROR(log_) << "Invalid name for bind: " << name;
 		return (false);
@@ -408,6 +551,19 @@ bool Socket::bind (const std::string& name)
 	if (rv == -1)
 		ERROR(log_) << "Could not setsockopt(SO_REUSEADDR): " << strerror(errno);
 
+	if (shared)
+	{
+#ifdef SO_REUSEPORT
+		// several sockets listen on the same address, the kernel spreading the connections
+		rv = setsockopt (fd_, SOL_SOCKET, SO_REUSEPORT, &on, sizeof on);
+		if (rv == -1)
+			ERROR(log_) << "Could not setsockopt(SO_REUSEPORT): " << strerror(errno);
+#else
+		ERROR(log_) << "Shared listening addresses are not supported.";
+		return (false);
+#endif
+	}
+
 	rv = ::bind (fd_, &addr.addr_.sockaddr_, addr.addrlen_);
 	if (rv == -1) 
 	{
@@ -418,9 +574,18 @@ bool Socket::bind (const std::string& name)
 	return (true);
 }
 
-bool Socket::listen (void)
+bool Socket::listen (int backlog)
 {
-	int rv = ::listen (fd_, 128);
+#ifdef TCP_FASTOPEN
+	if (socktype_ == SOCK_STREAM && domain_ != AF_UNIX)
+	{
+		int qlen = backlog;
+		if (setsockopt (fd_, IPPROTO_TCP, TCP_FASTOPEN, &qlen, sizeof qlen) == -1)
+			DEBUG(log_) << "Could not setsockopt(TCP_FASTOPEN): " << strerror(errno);
+	}
+#endif
+
+	int rv = ::listen (fd_, backlog);
 	return (rv != -1);
 }
 
@@ -471,6 +636,22 @@ std::string Socket::getsockname (void) const
 	return ((std::string)sa);
 }
 
+/*
+ * The kernel's smoothed round trip time in microseconds, or 0 where the
+ * system does not tell it.
+ */
+unsigned Socket::round_trip () const
+{
+#ifdef TCP_INFO
+	struct tcp_info info;
+	socklen_t len = sizeof info;
+
+	if (socktype_ == SOCK_STREAM && ::getsockopt (fd_, IPPROTO_TCP, TCP_INFO, &info, &len) == 0)
+		return (info.tcpi_rtt);
+#endif
+	return (0);
+}
+
 Socket* Socket::create(SocketAddressFamily family, SocketType type, const std::string& protocol, const std::string& hint)
 {
 	int typenum;
@@ -503,6 +684,7 @@ Socket* Socket::create(SocketAddressFamily family, SocketType type, const std::s
 	}
 
 	int domainnum;
+	bool unspecified = false;
 
 	switch (family) {
 	case SocketAddressFamilyIP:
@@ -512,13 +694,23 @@ Socket* Socket::create(SocketAddressFamily family, SocketType type, const std::s
 			return (NULL);
 		} else {
 			socket_address addr;
+			ResolverQuery query;
+			Buffer address;
 
-			if (!addr(AF_UNSPEC, typenum, protonum, hint)) {
+			if (!socket_address::parse(AF_UNSPEC, typenum, protonum, hint, query)) {
 				ERROR("/socket") << "Invalid hint: " << hint;
 				return (NULL);
 			}
 
-			/* XXX Just make socket_address::operator() smarter about AF_UNSPEC?  */
+			/*
+			 * The family is taken from a cached answer for the hint, if
+			 * any, and otherwise the socket is adapted by connect or bind
+			 * once the name is resolved, no lookup being made here.
+			 */
+			if (!resolver.lookup(query, address) || !addr.set(address))
+				addr.addr_.sockaddr_.sa_family = AF_INET6;
+			unspecified = true;
+
 			switch (addr.addr_.sockaddr_.sa_family) {
 			case AF_INET:
 				domainnum = AF_INET;
@@ -568,7 +760,7 @@ Socket* Socket::create(SocketAddressFamily family, SocketType type, const std::s
 		 * protocol is not supported, try explicitly creating an IPv4
 		 * socket.
 		 */
-		if (errno == EPROTONOSUPPORT && domainnum == AF_INET6 &&
+		if ((errno == EPROTONOSUPPORT || errno == EAFNOSUPPORT) && domainnum == AF_INET6 &&
 		    family == SocketAddressFamilyIP) {
 			DEBUG("/socket") << "IPv6 socket create failed; trying IPv4.";
 			return (Socket::create(SocketAddressFamilyIPv4, type, protocol, hint));
@@ -578,5 +770,7 @@ Socket* Socket::create(SocketAddressFamily family, SocketType type, const std::s
 		return (NULL);
 	}
 
-	return (new Socket(s, domainnum, typenum, protonum));
+	Socket *sck = new Socket(s, domainnum, typenum, protonum);
+	sck->unspecified_ = unspecified;
+	return (sck);
 }
@@ -42,8 +42,12 @@
 //                                                                            //
 ////////////////////////////////////////////////////////////////////////////////
 
+#define SOCKET_LISTEN_BACKLOG		128
+#define SOCKET_ACCEPT_BATCH		64
+
 typedef class TypedPairCallback<Event, Socket*> SocketEventCallback;
 typedef class CallbackAction<Socket, SocketEventCallback> SocketEventAction;
+typedef class CallbackAction<Socket, EventCallback> SocketConnectAction;
 
 class Socket : public StreamHandle 
 {
@@ -51,23 +55,32 @@ class Socket : public StreamHandle
 	int domain_;
 	int socktype_;
 	int protocol_;
+	bool unspecified_;
 	SocketEventAction* accept_request_;
 	Action* accept_check_;
+	SocketConnectAction* connect_request_;
+	Action* connect_check_;
 
 private:
 	Socket (int, int, int, int);
+	bool adapt (int);
+	void prepare_connect ();
 	
 public:
 	Action* accept (SocketEventCallback*);
 	void accept_complete (Event);
 	void accept_cancel ();
 	Action* connect (const std::string&, EventCallback*);
-	bool bind (const std::string&);
-	bool listen ();
+	void resolve_complete (Event);
+	void connect_complete (Event);
+	void connect_cancel ();
+	bool bind (const std::string&, bool shared = false);
+	bool listen (int backlog = SOCKET_LISTEN_BACKLOG);
 	bool shutdown (bool, bool);
 
 	std::string getpeername () const;
 	std::string getsockname () const;
+	unsigned round_trip () const;
 
 	static Socket* create (SocketAddressFamily, SocketType, const std::string& = "", const std::string& = "");
 };
@@ -42,7 +42,7 @@ StreamHandle::StreamHandle (int fd) : log_("/file/descriptor"), fd_(fd)
 	int flags = ::fcntl (fd_, F_GETFL, 0);
 	if (flags == -1)
 		ERROR(log_) << "Could not get flags for file descriptor.";
-	else 
+	else if (! (flags & O_NONBLOCK))
 	{
 		flags = ::fcntl (fd_, F_SETFL, flags | O_NONBLOCK);
 		if (flags == -1)
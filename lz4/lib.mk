@@ -0,0 +1,10 @@
+# Build with NO_LZ4=1 where liblz4 is not installed.
+ifdef NO_LZ4
+CPPFLAGS+=-DNO_LZ4=1
+else
+VPATH+=	${TOPDIR}/lz4
+
+SRCS+=	lz4_filter.cc
+
+LDADD+=	-llz4
+endif
@@ -0,0 +1,169 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// File:           lz4_filter.cc                                              //
+// Description:    data filters for lz4 frame streams                         //
+// Project:        WANProxy XTech                                             //
+// Author:         Andreu Vidal Bramfeld-Software                             //
+// Last modified:  2026-10-19                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+#include "lz4_filter.h"
+
+// Compress
+
+LZ4CompressFilter::LZ4CompressFilter (int level) : BufferedFilter ("/lz4/compress")
+{
+	memset (&prefs_, 0, sizeof prefs_);
+	prefs_.frameInfo.blockSizeID = LZ4F_max64KB;
+	prefs_.frameInfo.blockMode = LZ4F_blockLinked;
+	prefs_.compressionLevel = level;
+	started_ = false;
+
+	// room for the largest output of one chunk of input, or of the frame header
+	outsize = LZ4F_compressBound (LZ4_CHUNK_SIZE, &prefs_);
+	if (outsize < LZ4F_HEADER_SIZE_MAX)
+		outsize = LZ4F_HEADER_SIZE_MAX;
+	outbuf = new uint8_t[outsize];
+
+	if (LZ4F_isError (LZ4F_createCompressionContext (&stream_, LZ4F_VERSION)))
+	{
+		CRITICAL(log_) << "Could not initialize lz4 compression stream.";
+		stream_ = 0;
+	}
+}
+
+LZ4CompressFilter::~LZ4CompressFilter ()
+{
+	LZ4F_freeCompressionContext (stream_);
+	delete[] outbuf;
+}
+
+bool LZ4CompressFilter::start ()
+{
+	size_t rv = LZ4F_compressBegin (stream_, outbuf, outsize, &prefs_);
+	if (LZ4F_isError (rv))
+	{
+		ERROR(log_) << "LZ4F_compressBegin(): " << LZ4F_getErrorName (rv);
+		return false;
+	}
+	pending_.append (outbuf, rv);
+	started_ = true;
+	return true;
+}
+
+bool LZ4CompressFilter::consume (Buffer& buf, int flg)
+{
+	const BufferSegment* seg;
+	size_t rv;
+
+	if (! stream_)
+		return false;
+
+	pending_.clear ();
+	if (! started_ && ! start ())
+		return false;
+
+	for (Buffer::SegmentIterator it = buf.segments (); ! it.end (); it.next ())
+	{
+		seg = *it;
+		for (size_t n = 0; n < seg->length (); n += LZ4_CHUNK_SIZE)
+		{
+			size_t len = (seg->length () - n < LZ4_CHUNK_SIZE ? seg->length () - n : LZ4_CHUNK_SIZE);
+			rv = LZ4F_compressUpdate (stream_, outbuf, outsize, seg->data () + n, len, 0);
+			if (LZ4F_isError (rv))
+			{
+				ERROR(log_) << "LZ4F_compressUpdate(): " << LZ4F_getErrorName (rv);
+				return false;
+			}
+			if (rv > 0)
+				pending_.append (outbuf, rv);
+		}
+	}
+
+	// everything given so far must reach the other side now
+	rv = LZ4F_flush (stream_, outbuf, outsize, 0);
+	if (LZ4F_isError (rv))
+	{
+		ERROR(log_) << "LZ4F_flush(): " << LZ4F_getErrorName (rv);
+		return false;
+	}
+	if (rv > 0)
+		pending_.append (outbuf, rv);
+
+	return produce (pending_, flg);
+}
+
+void LZ4CompressFilter::flush (int flg)
+{
+	pending_.clear ();
+
+	if (stream_ && started_)
+	{
+		size_t rv = LZ4F_compressEnd (stream_, outbuf, outsize, 0);
+		if (LZ4F_isError (rv))
+			ERROR(log_) << "LZ4F_compressEnd(): " << LZ4F_getErrorName (rv);
+		else if (rv > 0)
+			pending_.append (outbuf, rv), produce (pending_);
+	}
+
+	Filter::flush (flg);
+}
+
+// Decompress
+
+LZ4DecompressFilter::LZ4DecompressFilter () : BufferedFilter ("/lz4/decompress")
+{
+	if (LZ4F_isError (LZ4F_createDecompressionContext (&stream_, LZ4F_VERSION)))
+	{
+		CRITICAL(log_) << "Could not initialize lz4 decompression stream.";
+		stream_ = 0;
+	}
+}
+
+LZ4DecompressFilter::~LZ4DecompressFilter()
+{
+	LZ4F_freeDecompressionContext (stream_);
+}
+
+bool LZ4DecompressFilter::consume (Buffer& buf, int flg)
+{
+	const BufferSegment* seg;
+
+	if (! stream_)
+		return false;
+
+	pending_.clear ();
+
+	for (Buffer::SegmentIterator it = buf.segments (); ! it.end (); it.next ())
+	{
+		seg = *it;
+		const uint8_t* src = seg->data ();
+		size_t left = seg->length ();
+		size_t out;
+
+		do
+		{
+			size_t in = left;
+			out = sizeof outbuf;
+			size_t rv = LZ4F_decompress (stream_, outbuf, &out, src, &in, 0);
+			if (LZ4F_isError (rv))
+			{
+				ERROR(log_) << "LZ4F_decompress(): " << LZ4F_getErrorName (rv);
+				return false;
+			}
+			if (out > 0)
+				pending_.append (outbuf, out);
+			src += in, left -= in;
+		}
+		while (left > 0 || out == sizeof outbuf);
+	}
+
+	return produce (pending_, flg);
+}
+
+void LZ4DecompressFilter::flush (int flg)
+{
+	Filter::flush (flg);
+}
@@ -0,0 +1,52 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// File:           lz4_filter.h                                               //
+// Description:    data filters for lz4 frame streams                         //
+// Project:        WANProxy XTech                                             //
+// Author:         Andreu Vidal Bramfeld-Software                             //
+// Last modified:  2026-10-19                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef	LZ4_LZ4_FILTER_H
+#define	LZ4_LZ4_FILTER_H
+
+#include <common/filter.h>
+#include <lz4frame.h>
+
+#define	LZ4_CHUNK_SIZE		0x10000
+
+class LZ4CompressFilter : public BufferedFilter
+{
+private:
+	LZ4F_cctx* stream_;
+	LZ4F_preferences_t prefs_;
+	bool started_;
+	uint8_t* outbuf;
+	size_t outsize;
+
+	bool start ();
+
+public:
+   LZ4CompressFilter (int level = 0);
+   virtual ~LZ4CompressFilter ();
+
+   virtual bool consume (Buffer& buf, int flg = 0);
+   virtual void flush (int flg);
+};
+
+class LZ4DecompressFilter : public BufferedFilter
+{
+private:
+	LZ4F_dctx* stream_;
+	uint8_t outbuf[LZ4_CHUNK_SIZE];
+
+public:
+   LZ4DecompressFilter ();
+  ~LZ4DecompressFilter ();
+
+   virtual bool consume (Buffer& buf, int flg = 0);
+   virtual void flush (int flg);
+};
+
+#endif /* !LZ4_LZ4_FILTER_H */
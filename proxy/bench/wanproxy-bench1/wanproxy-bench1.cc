@@ -0,0 +1,646 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// File:           wanproxy-bench1.cc                                         //
+// Description:    loopback benchmark of a client and server proxy pair       //
+// Project:        WANProxy XTech                                             //
+// Author:         Andreu Vidal Bramfeld-Software                             //
+// Last modified:  2026-10-19                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#define BENCH_BASE_PORT			4700
+#define BENCH_TRANSFERS			8
+#define BENCH_PARALLEL			1
+#define BENCH_SIZE				8			// MB
+#define BENCH_CHUNK				16384
+#define BENCH_PACKET				1448
+#define BENCH_MIN_RTO			200		// ms
+#define BENCH_START_WAIT		5000		// ms
+
+/*
+ * The client proxy listens on the base port and reaches the server proxy
+ * through the link emulator on the next one. The server proxy listens two
+ * ports above and talks to the workload backend on the third one:
+ *
+ *   bench client -> client proxy -> link -> server proxy -> backend
+ *
+ * A transfer asks the backend for a number of bytes with a "size" line, and
+ * is timed from the connection to the first byte back and to the end of
+ * the data. The CPU time of both proxies, taken when they exit, is divided
+ * by the bytes moved.
+ */
+
+struct LinkParams
+{
+	double rate_;			// bytes per second, 0 for no limit
+	int delay_;				// one way, in ms
+	double loss_;			// probability of losing each packet
+};
+
+struct Transfer
+{
+	double ttfb_;
+	double time_;
+	uint64_t bytes_;
+	bool ok_;
+};
+
+static LinkParams link_params = { 0, 0, 0 };
+static int base_port = BENCH_BASE_PORT;
+static std::string pattern = "repeated";
+static std::vector<uint8_t> workload;
+static uint64_t transfer_size = (uint64_t) BENCH_SIZE << 20;
+static int transfers = BENCH_TRANSFERS;
+static int next_transfer = 0;
+static std::vector<Transfer> results;
+static pthread_mutex_t bench_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static double now ()
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t xorshift (uint64_t& state)
+{
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+
+static bool write_all (int fd, const uint8_t* p, size_t n)
+{
+	while (n > 0)
+	{
+		ssize_t k = ::write (fd, p, n);
+		if (k < 0 && errno == EINTR)
+			continue;
+		if (k <= 0)
+			return false;
+		p += k, n -= k;
+	}
+	return true;
+}
+
+static int listen_on (int port)
+{
+	struct sockaddr_in sa;
+	int fd, on = 1;
+
+	if ((fd = ::socket (AF_INET, SOCK_STREAM, 0)) < 0)
+		return -1;
+	::setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+	memset (&sa, 0, sizeof sa);
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons (port);
+	sa.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+	if (::bind (fd, (struct sockaddr*) &sa, sizeof sa) < 0 || ::listen (fd, 128) < 0)
+	{
+		::close (fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int connect_to (int port)
+{
+	struct sockaddr_in sa;
+	int fd, on = 1;
+
+	if ((fd = ::socket (AF_INET, SOCK_STREAM, 0)) < 0)
+		return -1;
+	memset (&sa, 0, sizeof sa);
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons (port);
+	sa.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+	if (::connect (fd, (struct sockaddr*) &sa, sizeof sa) < 0)
+	{
+		::close (fd);
+		return -1;
+	}
+	::setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+	return fd;
+}
+
+static void spawn (void* (*fn) (void*), void* arg)
+{
+	pthread_t td;
+	if (pthread_create (&td, NULL, fn, arg) == 0)
+		pthread_detach (td);
+}
+
+/*
+ * Each direction of a link connection releases what it reads once the
+ * bytes ahead of it have gone through at the link rate and the delay has
+ * passed. The link carries a byte stream, so a lost packet is not missing
+ * data but a stall of one retransmission timeout, which holds back all
+ * that follows it as TCP would. Reading stops while more than a window of
+ * data is held.
+ */
+
+class LinkDirection
+{
+	struct Chunk
+	{
+		double release_;
+		std::vector<uint8_t> data_;
+	};
+
+	int in_, out_;
+	std::deque<Chunk> queue_;
+	size_t held_;
+	double free_, last_;
+	uint64_t seed_;
+
+public:
+	LinkDirection (int in, int out, uint64_t seed) : in_(in), out_(out)
+	{
+		held_ = 0;
+		free_ = last_ = 0;
+		seed_ = seed;
+	}
+
+	void run ()
+	{
+		uint8_t buf[BENCH_CHUNK];
+		bool eos = false;
+
+		for (;;)
+		{
+			double t = now ();
+			while (! queue_.empty () && queue_.front ().release_ <= t)
+			{
+				Chunk& c = queue_.front ();
+				if (! write_all (out_, &c.data_[0], c.data_.size ()))
+				{
+					::shutdown (in_, SHUT_RDWR);
+					return;
+				}
+				held_ -= c.data_.size ();
+				queue_.pop_front ();
+			}
+			if (eos && queue_.empty ())
+				break;
+
+			struct pollfd pfd = { in_, POLLIN, 0 };
+			int timeout = (queue_.empty () ? -1 : (int) ((queue_.front ().release_ - t) * 1000) + 1);
+			if (eos || held_ > window ())
+				pfd.fd = -1;
+			if (::poll (&pfd, 1, timeout) <= 0 || ! pfd.revents)
+				continue;
+
+			ssize_t n = ::read (in_, buf, sizeof buf);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				eos = true;
+			else
+				enqueue (buf, n);
+		}
+
+		::shutdown (out_, SHUT_WR);
+	}
+
+private:
+	size_t window ()
+	{
+		double bdp = link_params.rate_ * link_params.delay_ / 500;
+		return (size_t) bdp + (1 << 20);
+	}
+
+	void enqueue (const uint8_t* p, size_t n)
+	{
+		Chunk c;
+		double t = now (), rto;
+		int packets = (n + BENCH_PACKET - 1) / BENCH_PACKET;
+
+		free_ = std::max (free_, t) + (link_params.rate_ > 0 ? n / link_params.rate_ : 0);
+		c.release_ = free_ + link_params.delay_ / 1000.0;
+		if (link_params.loss_ > 0)
+		{
+			rto = std::max (BENCH_MIN_RTO, 4 * link_params.delay_) / 1000.0;
+			while (packets-- > 0)
+				if ((xorshift (seed_) % 1000000) < link_params.loss_ * 1000000)
+					c.release_ += rto;
+		}
+		c.release_ = last_ = std::max (c.release_, last_);
+		c.data_.assign (p, p + n);
+		held_ += n;
+		queue_.push_back (c);
+	}
+};
+
+static void* link_direction (void* arg)
+{
+	((LinkDirection*) arg)->run ();
+	return 0;
+}
+
+static void* link_connection (void* arg)
+{
+	int fd = (int) (intptr_t) arg, peer;
+	pthread_t td;
+
+	if ((peer = connect_to (base_port + 2)) < 0)
+	{
+		::close (fd);
+		return 0;
+	}
+
+	LinkDirection up (fd, peer, ((uint64_t) fd << 32) | 0x9e3779b9);
+	LinkDirection down (peer, fd, ((uint64_t) peer << 32) | 0x7f4a7c15);
+	if (pthread_create (&td, NULL, link_direction, &down) == 0)
+	{
+		up.run ();
+		pthread_join (td, NULL);
+	}
+	::close (peer);
+	::close (fd);
+	return 0;
+}
+
+static void* backend_connection (void* arg)
+{
+	int fd = (int) (intptr_t) arg;
+	uint64_t size, sent, state = ((uint64_t) fd << 32) | 12345;
+	uint8_t buf[BENCH_CHUNK];
+	char line[64];
+	size_t n = 0;
+
+	while (n < sizeof line - 1)
+	{
+		ssize_t k = ::read (fd, line + n, 1);
+		if (k <= 0)
+			break;
+		if (line[n++] == '\n')
+			break;
+	}
+	line[n] = 0;
+	size = strtoull (line, 0, 10);
+
+	for (sent = 0; sent < size; sent += n)
+	{
+		n = (size - sent < sizeof buf ? size - sent : sizeof buf);
+		if (pattern == "random")
+		{
+			for (size_t i = 0; i < n; i += 8)
+			{
+				uint64_t r = xorshift (state);
+				memcpy (buf + i, &r, (n - i < 8 ? n - i : 8));
+			}
+		}
+		else
+		{
+			for (size_t i = 0; i < n; ++i)
+				buf[i] = workload[(sent + i) % workload.size ()];
+		}
+		if (! write_all (fd, buf, n))
+			break;
+	}
+
+	::close (fd);
+	return 0;
+}
+
+struct Listener
+{
+	int fd_;
+	void* (*handler_) (void*);
+};
+
+static void* accept_loop (void* arg)
+{
+	Listener* l = (Listener*) arg;
+	int fd;
+
+	for (;;)
+	{
+		if ((fd = ::accept (l->fd_, NULL, NULL)) >= 0)
+			spawn (l->handler_, (void*) (intptr_t) fd);
+		else if (errno != EINTR && errno != ECONNABORTED)
+			break;
+	}
+	return 0;
+}
+
+static void* client_loop (void*)
+{
+	uint8_t buf[BENCH_CHUNK];
+	char line[64];
+
+	for (;;)
+	{
+		pthread_mutex_lock (&bench_mutex);
+		bool more = (next_transfer < transfers);
+		next_transfer++;
+		pthread_mutex_unlock (&bench_mutex);
+		if (! more)
+			break;
+
+		Transfer t = { 0, 0, 0, false };
+		double start = now ();
+		int fd = connect_to (base_port);
+		if (fd >= 0)
+		{
+			snprintf (line, sizeof line, "%llu\n", (unsigned long long) transfer_size);
+			if (write_all (fd, (const uint8_t*) line, strlen (line)))
+			{
+				ssize_t n;
+				while ((n = ::read (fd, buf, sizeof buf)) > 0 || (n < 0 && errno == EINTR))
+				{
+					if (n > 0 && t.bytes_ == 0)
+						t.ttfb_ = now () - start;
+					if (n > 0)
+						t.bytes_ += n;
+				}
+			}
+			::close (fd);
+		}
+		t.time_ = now () - start;
+		t.ok_ = (t.bytes_ == transfer_size);
+
+		pthread_mutex_lock (&bench_mutex);
+		results.push_back (t);
+		pthread_mutex_unlock (&bench_mutex);
+	}
+	return 0;
+}
+
+static bool write_config (const std::string& path, int side, const std::vector<std::string>& codec,
+								  const std::vector<std::string>& proxy)
+{
+	std::ofstream f (path.c_str ());
+	int listen = (side ? base_port + 2 : base_port), peer = (side ? base_port + 3 : base_port + 1);
+	std::vector<std::string>::const_iterator it;
+
+	f << "create codec codec0\nset codec0.codec XCodec\n";
+	for (it = codec.begin (); it != codec.end (); ++it)
+		f << "set codec0." << it->substr (0, it->find ('=')) << " " << it->substr (it->find ('=') + 1) << "\n";
+	f << "activate codec0\n";
+	f << "create interface if0\nset if0.family IPv4\nset if0.host \"127.0.0.1\"\nset if0.port \"" << listen << "\"\nactivate if0\n";
+	f << "create peer peer0\nset peer0.family IPv4\nset peer0.host \"127.0.0.1\"\nset peer0.port \"" << peer << "\"\nactivate peer0\n";
+	f << "create proxy proxy0\nset proxy0.interface if0\nset proxy0.peer peer0\n";
+	f << "set proxy0.interface_codec " << (side ? "codec0" : "None") << "\n";
+	f << "set proxy0.peer_codec " << (side ? "None" : "codec0") << "\n";
+	f << "set proxy0.role " << (side ? "Server" : "Client") << "\n";
+	for (it = proxy.begin (); it != proxy.end (); ++it)
+		f << "set proxy0." << it->substr (0, it->find ('=')) << " " << it->substr (it->find ('=') + 1) << "\n";
+	f << "activate proxy0\n";
+	return f.good ();
+}
+
+static pid_t start_proxy (const std::string& binary, const std::string& config, const std::string& log)
+{
+	pid_t pid = ::fork ();
+	if (pid == 0)
+	{
+		int fd = ::open (log.c_str (), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd >= 0)
+			::dup2 (fd, 1), ::dup2 (fd, 2);
+		::execl (binary.c_str (), binary.c_str (), "-c", config.c_str (), (char*) 0);
+		_exit (127);
+	}
+	return pid;
+}
+
+static bool wait_port (int port, pid_t pid)
+{
+	double limit = now () + BENCH_START_WAIT / 1000.0;
+	int fd, st;
+
+	while (now () < limit)
+	{
+		if (::waitpid (pid, &st, WNOHANG) == pid)
+			return false;
+		if ((fd = connect_to (port)) >= 0)
+		{
+			::close (fd);
+			return true;
+		}
+		usleep (20000);
+	}
+	return false;
+}
+
+static double stop_proxy (pid_t pid)
+{
+	struct rusage ru;
+	int st;
+
+	::kill (pid, SIGINT);
+	for (int i = 0; i < 100; ++i)
+	{
+		if (::wait4 (pid, &st, WNOHANG, &ru) == pid)
+			return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+		usleep (50000);
+	}
+	::kill (pid, SIGKILL);
+	if (::wait4 (pid, &st, 0, &ru) == pid)
+		return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+	return 0;
+}
+
+static void usage ()
+{
+	fprintf (stderr, "usage: wanproxy-bench1 [-w wanproxy] [-P port] [-r Mbit/s] [-d ms] [-l loss%%] [-n transfers]\n"
+						  "                       [-p parallel] [-s MB] [-g random|repeated] [-f file]\n"
+						  "                       [-o codec_option=value] [-x proxy_option=value] [-k]\n");
+	exit (1);
+}
+
+int main (int argc, char* argv[])
+{
+	std::string binary = "../../bin/wanproxy", file, dir;
+	std::vector<std::string> codec, proxy;
+	std::vector<pthread_t> clients;
+	int parallel = BENCH_PARALLEL, ch, i;
+	bool keep = false;
+	char tmp[] = "/tmp/wanproxy-bench.XXXXXX";
+
+	while ((ch = getopt (argc, argv, "w:P:r:d:l:n:p:s:g:f:o:x:k")) != -1)
+	{
+		switch (ch)
+		{
+		case 'w':
+			binary = optarg;
+			break;
+		case 'P':
+			base_port = atoi (optarg);
+			break;
+		case 'r':
+			link_params.rate_ = atof (optarg) * 1e6 / 8;
+			break;
+		case 'd':
+			link_params.delay_ = atoi (optarg);
+			break;
+		case 'l':
+			link_params.loss_ = atof (optarg) / 100;
+			break;
+		case 'n':
+			transfers = atoi (optarg);
+			break;
+		case 'p':
+			parallel = atoi (optarg);
+			break;
+		case 's':
+			transfer_size = (uint64_t) (atof (optarg) * 1048576);
+			break;
+		case 'g':
+			pattern = optarg;
+			if (pattern != "random" && pattern != "repeated")
+				usage ();
+			break;
+		case 'f':
+			file = optarg;
+			break;
+		case 'o':
+		case 'x':
+			if (! strchr (optarg, '='))
+				usage ();
+			(ch == 'o' ? codec : proxy).push_back (optarg);
+			break;
+		case 'k':
+			keep = true;
+			break;
+		default:
+			usage ();
+		}
+	}
+
+	if (transfers < 1 || parallel < 1 || transfer_size < 1 || link_params.delay_ < 0 || link_params.loss_ < 0)
+		usage ();
+
+	/*
+	 * A file given as workload is served whole in every transfer, which
+	 * replays it through the proxies as many times as transfers are made.
+	 */
+	if (! file.empty ())
+	{
+		std::ifstream f (file.c_str (), std::ios::binary);
+		workload.assign (std::istreambuf_iterator<char> (f), std::istreambuf_iterator<char> ());
+		if (workload.empty ())
+		{
+			fprintf (stderr, "wanproxy-bench1: cannot read %s\n", file.c_str ());
+			return 1;
+		}
+		pattern = "file";
+		transfer_size = workload.size ();
+	}
+	else if (pattern == "repeated")
+	{
+		uint64_t state = 0x9e3779b97f4a7c15ULL;
+		workload.resize (transfer_size);
+		for (size_t j = 0; j < workload.size (); ++j)
+			workload[j] = (uint8_t) (xorshift (state) >> 24);
+	}
+
+	::signal (SIGPIPE, SIG_IGN);
+	if (! ::mkdtemp (tmp))
+	{
+		perror ("mkdtemp");
+		return 1;
+	}
+	dir = tmp;
+
+	static Listener link = { listen_on (base_port + 1), link_connection };
+	static Listener backend = { listen_on (base_port + 3), backend_connection };
+	if (link.fd_ < 0 || backend.fd_ < 0)
+	{
+		fprintf (stderr, "wanproxy-bench1: cannot listen on ports %d and %d\n", base_port + 1, base_port + 3);
+		return 1;
+	}
+	spawn (accept_loop, &link);
+	spawn (accept_loop, &backend);
+
+	if (! write_config (dir + "/client.conf", 0, codec, proxy) || ! write_config (dir + "/server.conf", 1, codec, proxy))
+	{
+		fprintf (stderr, "wanproxy-bench1: cannot write configuration in %s\n", dir.c_str ());
+		return 1;
+	}
+	pid_t server = start_proxy (binary, dir + "/server.conf", dir + "/server.log");
+	pid_t client = start_proxy (binary, dir + "/client.conf", dir + "/client.log");
+	if (! wait_port (base_port + 2, server) || ! wait_port (base_port, client))
+	{
+		fprintf (stderr, "wanproxy-bench1: proxies did not start, see %s\n", dir.c_str ());
+		stop_proxy (client), stop_proxy (server);
+		return 1;
+	}
+
+	/*
+	 * The probes made while waiting for the listeners count as connections
+	 * of the proxies, so they are left to settle before starting.
+	 */
+	usleep (200000);
+	double start = now ();
+	for (i = 0; i < parallel; ++i)
+	{
+		pthread_t td;
+		if (pthread_create (&td, NULL, client_loop, 0) == 0)
+			clients.push_back (td);
+	}
+	for (i = 0; i < (int) clients.size (); ++i)
+		pthread_join (clients[i], NULL);
+	double elapsed = now () - start;
+
+	double cpu_client = stop_proxy (client), cpu_server = stop_proxy (server);
+
+	std::vector<double> ttfb;
+	uint64_t bytes = 0;
+	int failed = 0;
+	for (i = 0; i < (int) results.size (); ++i)
+	{
+		bytes += results[i].bytes_;
+		if (results[i].ok_)
+			ttfb.push_back (results[i].ttfb_ * 1000);
+		else
+			failed++;
+	}
+	std::sort (ttfb.begin (), ttfb.end ());
+
+	printf ("wanproxy-bench1 workload=%s rate_mbit=%.1f delay_ms=%d loss_pct=%.2f transfers=%d parallel=%d"
+			  " bytes=%llu failed=%d seconds=%.3f throughput_mbps=%.2f ttfb_ms_min=%.2f ttfb_ms_median=%.2f"
+			  " ttfb_ms_max=%.2f cpu_client_s=%.3f cpu_server_s=%.3f cpu_ns_per_byte=%.2f\n",
+			  pattern.c_str (), link_params.rate_ * 8 / 1e6, link_params.delay_, link_params.loss_ * 100,
+			  transfers, parallel, (unsigned long long) bytes, failed, elapsed, bytes / elapsed / 1048576,
+			  (ttfb.empty () ? 0 : ttfb.front ()), (ttfb.empty () ? 0 : ttfb[ttfb.size () / 2]),
+			  (ttfb.empty () ? 0 : ttfb.back ()), cpu_client, cpu_server,
+			  (bytes ? (cpu_client + cpu_server) * 1e9 / bytes : 0));
+
+	if (keep)
+		fprintf (stderr, "wanproxy-bench1: configuration and logs kept in %s\n", dir.c_str ());
+	else
+	{
+		const char* names[] = { "client.conf", "server.conf", "client.log", "server.log" };
+		for (i = 0; i < 4; ++i)
+			::unlink ((dir + "/" + names[i]).c_str ());
+		::rmdir (dir.c_str ());
+	}
+
+	return (failed ? 1 : 0);
+}
@@ -0,0 +1,187 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// File:           proxy_capture.cc                                           //
+// Description:    files holding the data read by a connection, for replay    //
+// Project:        WANProxy XTech                                             //
+// Author:         Andreu Vidal Bramfeld-Software                             //
+// Last modified:  2026-10-19                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <common/endian.h>
+#include "proxy_capture.h"
+
+static uint64_t capture_clock ()
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+ProxyCapture::ProxyCapture () : log_("/wanproxy/capture")
+{
+	start_ = 0;
+}
+
+// files are named after the proxy, the time and a sequence of this process
+bool ProxyCapture::create (const std::string& dir, const std::string& proxy, const std::string& label)
+{
+	static unsigned sequence = 0;
+	char name[64];
+	time_t now = time (0);
+
+	strftime (name, sizeof name, "%Y%m%d-%H%M%S", localtime (&now));
+	path_ = dir;
+	if (path_.size () > 0 && path_[path_.size () - 1] != '/')
+		path_.append ("/");
+	path_.append (proxy + "-" + name);
+	snprintf (name, sizeof name, "-%u-%u.wpcap", (unsigned) getpid (), ++sequence);
+	path_.append (name);
+
+	out_.open (path_.c_str (), std::ios::out | std::ios::trunc | std::ios::binary);
+	if (! out_.is_open ())
+	{
+		ERROR(log_) << "Could not create capture file: " << path_;
+		return false;
+	}
+
+	proxy_ = proxy;
+	label_ = label;
+	start_ = capture_clock ();
+	out_.write (CAPTURE_MAGIC, strlen (CAPTURE_MAGIC));
+	write_string (proxy_);
+	write_string (label_);
+	return out_.good ();
+}
+
+bool ProxyCapture::open (const std::string& path)
+{
+	char magic[sizeof CAPTURE_MAGIC];
+
+	path_ = path;
+	in_.open (path_.c_str (), std::ios::in | std::ios::binary);
+	if (! in_.is_open ())
+	{
+		ERROR(log_) << "Could not open capture file: " << path_;
+		return false;
+	}
+
+	in_.read (magic, strlen (CAPTURE_MAGIC));
+	if (! in_.good () || memcmp (magic, CAPTURE_MAGIC, strlen (CAPTURE_MAGIC)) != 0 ||
+		 ! read_string (proxy_) || ! read_string (label_))
+	{
+		ERROR(log_) << "Not a capture file: " << path_;
+		return false;
+	}
+	return true;
+}
+
+void ProxyCapture::record (CaptureChain chain, const Buffer& buf)
+{
+	if (! out_.is_open () || buf.empty ())
+		return;
+
+	write_header (chain, buf.length (), CaptureData);
+	for (Buffer::SegmentIterator it = buf.segments (); ! it.end (); it.next ())
+		out_.write ((const char*) (*it)->data (), (*it)->length ());
+}
+
+void ProxyCapture::record_eos (CaptureChain chain)
+{
+	if (! out_.is_open ())
+		return;
+
+	write_header (chain, 0, CaptureEnd);
+	out_.flush ();
+}
+
+void ProxyCapture::record_segments (CaptureChain chain)
+{
+	std::map<uint64_t, Buffer>::const_iterator it;
+
+	if (! out_.is_open ())
+		return;
+
+	for (it = referenced_[chain].begin (); it != referenced_[chain].end (); ++it)
+	{
+		if (! recorded_[chain].insert (it->first).second)
+			continue;
+		write_header (chain, it->second.length (), CaptureSegment);
+		for (Buffer::SegmentIterator si = it->second.segments (); ! si.end (); si.next ())
+			out_.write ((const char*) (*si)->data (), (*si)->length ());
+	}
+	referenced_[chain].clear ();
+}
+
+bool ProxyCapture::next (CaptureChain& chain, uint64_t& time, Buffer& buf, CaptureKind& kind)
+{
+	uint8_t head[2], data[8192];
+	uint64_t t;
+	uint32_t len, n;
+
+	in_.read ((char*) &t, sizeof t);
+	in_.read ((char*) head, sizeof head);
+	in_.read ((char*) &len, sizeof len);
+	if (! in_.good ())
+		return false;
+
+	time = BigEndian::decode (t);
+	len = BigEndian::decode (len);
+	chain = (head[0] ? CaptureResponse : CaptureRequest);
+	kind = (CaptureKind) head[1];
+	if (len > CAPTURE_RECORD_LIMIT || kind > CaptureSegment)
+	{
+		ERROR(log_) << "Bad record in capture file: " << path_;
+		return false;
+	}
+
+	buf.clear ();
+	for (; len > 0; len -= n)
+	{
+		n = (len < sizeof data ? len : sizeof data);
+		in_.read ((char*) data, n);
+		if (! in_.good ())
+		{
+			ERROR(log_) << "Truncated capture file: " << path_;
+			return false;
+		}
+		buf.append (data, n);
+	}
+	return true;
+}
+
+void ProxyCapture::write_header (CaptureChain chain, uint32_t len, CaptureKind kind)
+{
+	uint64_t t = BigEndian::encode (capture_clock () - start_);
+	uint8_t head[2] = { (uint8_t) chain, (uint8_t) kind };
+
+	len = BigEndian::encode (len);
+	out_.write ((const char*) &t, sizeof t);
+	out_.write ((const char*) head, sizeof head);
+	out_.write ((const char*) &len, sizeof len);
+}
+
+void ProxyCapture::write_string (const std::string& s)
+{
+	uint16_t len = BigEndian::encode ((uint16_t) s.size ());
+	out_.write ((const char*) &len, sizeof len);
+	out_.write (s.data (), s.size ());
+}
+
+bool ProxyCapture::read_string (std::string& s)
+{
+	uint16_t len;
+	char data[65536];
+
+	in_.read ((char*) &len, sizeof len);
+	len = BigEndian::decode (len);
+	in_.read (data, len);
+	if (! in_.good ())
+		return false;
+	s.assign (data, len);
+	return true;
+}
@@ -0,0 +1,81 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// File:           proxy_capture.h                                            //
+// Description:    files holding the data read by a connection, for replay    //
+// Project:        WANProxy XTech                                             //
+// Author:         Andreu Vidal Bramfeld-Software                             //
+// Last modified:  2026-10-19                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef	PROGRAMS_WANPROXY_PROXY_CAPTURE_H
+#define	PROGRAMS_WANPROXY_PROXY_CAPTURE_H
+
+#include <map>
+#include <set>
+#include <string>
+#include <fstream>
+#include <common/buffer.h>
+
+#define CAPTURE_MAGIC			"WPCAP001"
+#define CAPTURE_RECORD_LIMIT	(16 << 20)
+
+enum CaptureChain
+{
+	CaptureRequest,
+	CaptureResponse
+};
+
+enum CaptureKind
+{
+	CaptureData,
+	CaptureEnd,
+	CaptureSegment
+};
+
+/*
+ * A capture holds what a connector reads on both sides, that is the input
+ * of its request and response chains, as records stamped with the time in
+ * microseconds since the connection started. A record with no data marks
+ * the end of the stream. Encoded input refers to segments that the cache
+ * of the replay may not have, so each segment a decoder of the chain found
+ * in its cache is recorded too, once, right after the data that used it.
+ * The header names the proxy, so that the same chains can be built when
+ * replaying it.
+ */
+
+class ProxyCapture
+{
+	LogHandle log_;
+	std::string path_;
+	std::string proxy_;
+	std::string label_;
+	std::ofstream out_;
+	std::ifstream in_;
+	uint64_t start_;
+	std::map<uint64_t, Buffer> referenced_[2];
+	std::set<uint64_t> recorded_[2];
+
+public:
+	ProxyCapture ();
+
+	bool create (const std::string& dir, const std::string& proxy, const std::string& label);
+	bool open (const std::string& path);
+	void record (CaptureChain chain, const Buffer& buf);
+	void record_eos (CaptureChain chain);
+	void record_segments (CaptureChain chain);
+	bool next (CaptureChain& chain, uint64_t& time, Buffer& buf, CaptureKind& kind);
+
+	std::map<uint64_t, Buffer>* referenced (CaptureChain chain)   { return &referenced_[chain]; }
+
+	const std::string& path () const   { return path_; }
+	const std::string& proxy () const   { return proxy_; }
+	const std::string& label () const   { return label_; }
+
+private:
+	void write_header (CaptureChain chain, uint32_t len, CaptureKind kind);
+	void write_string (const std::string& s);
+	bool read_string (std::string& s);
+};
+
+#endif /* !PROGRAMS_WANPROXY_PROXY_CAPTURE_H */
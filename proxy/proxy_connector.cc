@@ -28,9 +28,12 @@
 #include <io/sink_filter.h>
 #include <ssh/ssh_filter.h>
 #include <xcodec/xcodec_filter.h>
-#include <zlib/zlib_filter.h>
 #include <common/count_filter.h>
+#include "wanproxy.h"
 #include "proxy_connector.h"
+#include "proxy_capture.h"
+#include "proxy_dictionary.h"
+#include "proxy_stripe.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 //                                                                            //
@@ -48,14 +51,30 @@ ProxyConnector::ProxyConnector (const std::string& name,
           Socket* local_socket,
 			 SocketAddressFamily family,
 			 const std::string& remote_name,
-			 bool cln, bool ssh)
+			 bool cln, bool ssh,
+			 int stripes, ProxyStripe* stripe,
+			 std::list<ProxyConnector*>* pool)
  : log_("/wanproxy/" + name + "/connector"),
    local_codec_(local_codec),
    remote_codec_(remote_codec),
    local_socket_(local_socket),
    remote_socket_(0),
+   local_stripe_(stripe),
+   remote_stripe_(0),
+   remote_family_(family),
+   remote_name_(remote_name),
+   pool_(pool),
+   standby_sink_(0),
+   lazy_sink_(0),
+   remote_encoder_(0),
+   local_decoder_(0),
+   remote_decoder_(0),
+   request_sink_(0),
+   response_sink_(0),
 	is_cln_(cln),
 	is_ssh_(ssh),
+   request_account_(this, false),
+   response_account_(this, true),
    request_chain_(this),
    response_chain_(this),
    connect_action_(0),
@@ -63,21 +82,108 @@ ProxyConnector::ProxyConnector (const std::string& name,
 	request_action_(0),
 	response_action_(0),
 	close_action_(0),
-	flushing_(0)
+	flushing_(0),
+	tally_(wanproxy.tally (name)),
+	counted_(false),
+	capture_(0)
 {
-	if (local_socket_ && (remote_socket_ = Socket::create (family, SocketTypeStream, "tcp", remote_name)))
+	recorder_.label (name + (local_socket_ ? " " + local_socket_->getpeername () : local_stripe_ ? " stripe" : " standby"));
+	request_chain_.record (&recorder_);
+	response_chain_.record (&recorder_);
+	budget (name, true);
+	
+	if (local_socket_ || local_stripe_ || pool_)
 	{
-		connect_action_ = remote_socket_->connect (remote_name, callback (this, &ProxyConnector::connect_complete));
-		stop_action_ = event_system.register_interest (EventInterestStop, callback (this, &ProxyConnector::conclude));
+		if (local_socket_ || local_stripe_)
+			count ();
+		capture (name);
+		if (stripes > 1)
+		{
+			remote_stripe_ = new ProxyStripe (name, stripes);
+			connect_action_ = remote_stripe_->connect (family, remote_name, callback (this, &ProxyConnector::connect_complete));
+		}
+		else if (local_socket_ && local_codec_ && local_codec_->xcache_ && ! is_ssh_)
+		{
+			/*
+			 * The peer proxy greets as soon as it connects, telling whether
+			 * this is a standby connection, which opens no path to the server
+			 * until it is put to use. A peer that only greets along with its
+			 * first data gets the path once a grace time is over.
+			 */
+			request_sink_ = lazy_sink_ = new SinkFilter ("/wanproxy/request", 0);
+			if (build_chains (local_codec_, remote_codec_, local_socket_, 0))
+			{
+				request_action_ = local_socket_->read (callback (this, &ProxyConnector::on_request_data));
+				connect_action_ = event_system.track (PROXY_CONNECT_GRACE, StreamModeWait, callback (this, &ProxyConnector::grace_complete));
+			}
+		}
+		else
+		{
+			connect_remote ();
+		}
 	}
+	
+	if (connect_action_)
+		stop_action_ = event_system.register_interest (EventInterestStop, callback (this, &ProxyConnector::conclude));
 	else
-	{
 		close_action_ = event_system.track (0, StreamModeWait, callback (this, &ProxyConnector::conclude));
-	}
+}
+
+/*
+ * A connector to replay a capture has no sockets, its chains ending in the
+ * given filters instead, and gets its data from the replay.
+ */
+
+ProxyConnector::ProxyConnector (const std::string& name,
+          WANProxyCodec* local_codec,
+			 WANProxyCodec* remote_codec,
+			 bool cln,
+			 Filter* request_sink,
+			 Filter* response_sink)
+ : log_("/wanproxy/" + name + "/connector"),
+   local_codec_(local_codec),
+   remote_codec_(remote_codec),
+   local_socket_(0),
+   remote_socket_(0),
+   local_stripe_(0),
+   remote_stripe_(0),
+   remote_family_(SocketAddressFamilyUnspecified),
+   pool_(0),
+   standby_sink_(0),
+   lazy_sink_(0),
+   remote_encoder_(0),
+   local_decoder_(0),
+   remote_decoder_(0),
+   request_sink_(request_sink),
+   response_sink_(response_sink),
+	is_cln_(cln),
+	is_ssh_(false),
+   request_account_(this, false),
+   response_account_(this, true),
+   request_chain_(this),
+   response_chain_(this),
+   connect_action_(0),
+   stop_action_(0),
+	request_action_(0),
+	response_action_(0),
+	close_action_(0),
+	flushing_(0),
+	tally_(wanproxy.tally (name)),
+	counted_(false),
+	capture_(0)
+{
+	recorder_.label (name + " replay");
+	request_chain_.record (&recorder_);
+	response_chain_.record (&recorder_);
+	budget (name, false);
+	build_chains (local_codec_, remote_codec_, 0, 0);
 }
 
 ProxyConnector::~ProxyConnector ()
 {
+	request_account_.owner_ = response_account_.owner_ = 0;
+	if (pool_)
+		pool_->remove (this);
    if (connect_action_)
       connect_action_->cancel ();
    if (stop_action_)
@@ -94,6 +200,11 @@ ProxyConnector::~ProxyConnector ()
 		remote_socket_->close ();
    delete local_socket_;
    delete remote_socket_;
+	delete local_stripe_;
+	delete remote_stripe_;
+	delete capture_;
+	if (counted_)
+		tally_->active_--;
 }
 
 void ProxyConnector::connect_complete (Event e)
@@ -115,19 +226,69 @@ void ProxyConnector::connect_complete (Event e)
 		return;
 	}
 
-   if (build_chains (local_codec_, remote_codec_, local_socket_, remote_socket_))
+	if (lazy_sink_)
 	{
-		request_action_ = local_socket_->read (callback (this, &ProxyConnector::on_request_data));
+		lazy_sink_->attach (remote_socket_);
+		lazy_sink_ = 0;
 		response_action_ = remote_socket_->read (callback (this, &ProxyConnector::on_response_data));
+		return;
 	}
+
+   if (build_chains (local_codec_, remote_codec_, local_socket_, remote_socket_))
+	{
+		/*
+		 * The <HELLO> goes out right away, so that the peer has its cache
+		 * ready and knows whether a standby connection needs a path yet.
+		 */
+		if (remote_encoder_ && ! is_ssh_ && ! remote_encoder_->greet (pool_ && ! local_socket_))
+		{
+			conclude (e);
+			return;
+		}
+		if (pool_ && ! local_socket_)
+		{
+			response_action_ = remote_socket_->read (callback (this, &ProxyConnector::on_response_data));
+			return;
+		}
+		if (local_stripe_)
+			request_action_ = local_stripe_->read (callback (this, &ProxyConnector::on_request_data));
+		else
+			request_action_ = local_socket_->read (callback (this, &ProxyConnector::on_request_data));
+		if (remote_stripe_)
+			response_action_ = remote_stripe_->read (callback (this, &ProxyConnector::on_response_data));
+		else
+			response_action_ = remote_socket_->read (callback (this, &ProxyConnector::on_response_data));
+	}
+}
+
+void ProxyConnector::grace_complete (Event e)
+{
+	if (connect_action_)
+		connect_action_->cancel (), connect_action_ = 0;
+	if (! remote_socket_ && ! connect_remote ())
+		conclude (e);
+}
+
+bool ProxyConnector::connect_remote ()
+{
+	if ((remote_socket_ = Socket::create (remote_family_, SocketTypeStream, "tcp", remote_name_)))
+		connect_action_ = remote_socket_->connect (remote_name_, callback (this, &ProxyConnector::connect_complete));
+	return (connect_action_ != 0);
 }
 
 bool ProxyConnector::build_chains (WANProxyCodec* cdc1, WANProxyCodec* cdc2, Socket* sck1, Socket* sck2)
 {
-   if (! sck1 || ! sck2)
+   if (! request_sink_ && ((! sck1 && ! local_stripe_ && ! pool_) || (! sck2 && ! remote_stripe_)))
       return false;
       
-   response_chain_.prepend (new SinkFilter ("/wanproxy/response", sck1, is_cln_));
+	if (response_sink_)
+		response_chain_.prepend (response_sink_);
+	else if (local_stripe_)
+		response_chain_.prepend (local_stripe_->sink ());
+	else if (! sck1)
+		response_chain_.prepend ((standby_sink_ = new SinkFilter ("/wanproxy/response", 0, is_cln_)));
+	else
+		response_chain_.prepend (new SinkFilter ("/wanproxy/response", sck1, is_cln_));
 	
 	if (is_ssh_)
 	{
@@ -139,6 +300,9 @@ bool ProxyConnector::build_chains (WANProxyCodec* cdc1, WANProxyCodec* cdc2, Soc
    
 	if (cdc1) 
    {
+		if (sck1)
+			cdc1->measure (sck1->round_trip ());
+
 		if (cdc1->counting_) 
       {
 			request_chain_.append (new CountFilter (cdc1->request_input_bytes_));
@@ -147,8 +311,15 @@ bool ProxyConnector::build_chains (WANProxyCodec* cdc1, WANProxyCodec* cdc2, Soc
 
 		if (cdc1->compressor_) 
       {
-			request_chain_.append (new InflateFilter ());
-			response_chain_.prepend (new DeflateFilter (cdc1->compressor_level_));
+			Filter* cmp = cdc1->compress_filter ();
+			Filter* dcmp = cdc1->decompress_filter ();
+			if (cdc1->compressor_dictionary_)
+			{
+				request_chain_.append (new DictionaryReceiveFilter (cdc1, dcmp));
+				response_chain_.prepend (new DictionarySendFilter (cdc1, cmp, false));
+			}
+			request_chain_.append (dcmp);
+			response_chain_.prepend (cmp);
 		}
 
 		if (cdc1->xcache_) 
@@ -157,6 +328,9 @@ bool ProxyConnector::build_chains (WANProxyCodec* cdc1, WANProxyCodec* cdc2, Soc
 			request_chain_.append ((dec = new DecodeFilter ("/wanproxy/" + cdc1->name_ + "/dec", cdc1)));
 			response_chain_.prepend ((enc = new EncodeFilter ("/wanproxy/" + cdc1->name_ + "/enc", cdc1, 1)));
          dec->set_upstream (enc);
+			local_decoder_ = dec;
+			if (capture_)
+				dec->witness (capture_->referenced (CaptureRequest));
 		}
 
 		if (cdc1->counting_) 
@@ -168,6 +342,9 @@ bool ProxyConnector::build_chains (WANProxyCodec* cdc1, WANProxyCodec* cdc2, Soc
 
 	if (cdc2) 
    {
+		if (sck2)
+			cdc2->measure (sck2->round_trip ());
+
 		if (cdc2->counting_) 
       {
 			request_chain_.append (new CountFilter (cdc2->request_input_bytes_));
@@ -180,12 +357,23 @@ bool ProxyConnector::build_chains (WANProxyCodec* cdc1, WANProxyCodec* cdc2, Soc
 			request_chain_.append ((enc = new EncodeFilter ("/wanproxy/" + cdc2->name_ + "/enc", cdc2)));
 			response_chain_.prepend ((dec = new DecodeFilter ("/wanproxy/" + cdc2->name_ + "/dec", cdc2)));
          dec->set_upstream (enc);
+			remote_encoder_ = enc;
+			remote_decoder_ = dec;
+			if (capture_)
+				dec->witness (capture_->referenced (CaptureResponse));
 		}
 
 		if (cdc2->compressor_) 
       {
-			request_chain_.append (new DeflateFilter (cdc2->compressor_level_));
-			response_chain_.prepend (new InflateFilter ());
+			Filter* cmp = cdc2->compress_filter ();
+			Filter* dcmp = cdc2->decompress_filter ();
+			request_chain_.append (cmp);
+			response_chain_.prepend (dcmp);
+			if (cdc2->compressor_dictionary_)
+			{
+				request_chain_.append (new DictionarySendFilter (cdc2, cmp, true));
+				response_chain_.prepend (new DictionaryReceiveFilter (cdc2, dcmp));
+			}
 		}
 
 		if (cdc2->counting_) 
@@ -203,14 +391,74 @@ bool ProxyConnector::build_chains (WANProxyCodec* cdc1, WANProxyCodec* cdc2, Soc
 		dec->set_encrypter (enc);
 	}
    
-   request_chain_.append (new SinkFilter ("/wanproxy/request", sck2));
+	if (request_sink_)
+		request_chain_.append (request_sink_);
+	else if (remote_stripe_)
+		request_chain_.append (remote_stripe_->sink ());
+	else
+		request_chain_.append (new SinkFilter ("/wanproxy/request", sck2));
    
    return true;
 }
 
+void ProxyConnector::adopt (Socket* sck)
+{
+	local_socket_ = sck;
+	pool_ = 0;
+	standby_sink_->attach (sck);
+	standby_sink_ = 0;
+	count ();
+	recorder_.add (TraceRead, 0, 2);
+	if (remote_encoder_ && ! remote_encoder_->wake ())
+	{
+		if (! close_action_)
+			close_action_ = event_system.track (0, StreamModeWait, callback (this, &ProxyConnector::conclude));
+		return;
+	}
+	request_action_ = local_socket_->read (callback (this, &ProxyConnector::on_request_data));
+}
+
+void ProxyConnector::capture (const std::string& name)
+{
+	std::string dir = wanproxy.capture (name);
+	if (dir.empty ())
+		return;
+	capture_ = new ProxyCapture ();
+	if (! capture_->create (dir, name, (local_socket_ ? local_socket_->getpeername () : local_stripe_ ? "stripe" : "standby")))
+		delete capture_, capture_ = 0;
+}
+
+/*
+ * The bytes held by the filters of each chain are charged to an account of
+ * its own, part of the pool of all the connections of the proxy, which
+ * survives reloads like the tally it belongs to. A replay is not limited,
+ * its sinks not being sockets that could hold the data back.
+ */
+
+void ProxyConnector::budget (const std::string& name, bool limited)
+{
+	request_account_.join (&tally_->memory_);
+	response_account_.join (&tally_->memory_);
+	if (limited)
+	{
+		intmax_t limit = wanproxy.memory_limit (name);
+		request_account_.limit (limit);
+		response_account_.limit (limit);
+	}
+	request_chain_.charge (&request_account_);
+	response_chain_.charge (&response_account_);
+}
+
+void ProxyConnector::count ()
+{
+	tally_->active_++;
+	tally_->total_++;
+	counted_ = true;
+}
+
 void ProxyConnector::on_request_data (Event e)
 {
-	if (request_action_)
+	if (request_action_ && ! local_stripe_)
 		request_action_->cancel (), request_action_ = 0;
 	if (flushing_ & REQUEST_CHAIN_FLUSHING)
 		return;
@@ -218,10 +466,40 @@ void ProxyConnector::on_request_data (Event e)
 	switch (e.type_) 
 	{
 	case Event::Done:
-		request_action_ = local_socket_->read (callback (this, &ProxyConnector::on_request_data));
+		recorder_.add (TraceRead, e.buffer_.length (), 0);
+		if (capture_)
+			capture_->record (CaptureRequest, e.buffer_);
 		if (request_chain_.consume (e.buffer_))
+		{
+			if (capture_)
+				capture_->record_segments (CaptureRequest);
+			if (lazy_sink_ && ! remote_socket_)
+			{
+				if (connect_action_)
+					connect_action_->cancel (), connect_action_ = 0;
+				if (! local_decoder_->standby () && ! connect_remote ())
+				{
+					conclude (e);
+					return;
+				}
+			}
+			if (local_socket_ && ! request_action_ && ! request_account_.pause ())
+				request_action_ = local_socket_->read (callback (this, &ProxyConnector::on_request_data));
 			break;
+		}
 	case Event::EOS:
+		if (lazy_sink_ && ! remote_socket_)
+		{
+			DEBUG(log_) << "Standby connection closed by peer";
+			conclude (e);
+			return;
+		}
+		recorder_.add (TraceEOS, e.type_, 0);
+		if (capture_)
+		{
+			capture_->record_segments (CaptureRequest);
+			capture_->record_eos (CaptureRequest);
+		}
 		DEBUG(log_) << "Flushing request";
 		flushing_ |= REQUEST_CHAIN_FLUSHING;
 		request_chain_.flush (REQUEST_CHAIN_READY);
@@ -235,18 +513,38 @@ void ProxyConnector::on_request_data (Event e)
 
 void ProxyConnector::on_response_data (Event e)
 {
-	if (response_action_)
+	if (response_action_ && ! remote_stripe_)
 		response_action_->cancel (), response_action_ = 0;
 	if (flushing_ & RESPONSE_CHAIN_FLUSHING)
 		return;
+	if (standby_sink_ && e.type_ != Event::Done)
+	{
+		DEBUG(log_) << "Standby connection closed by peer";
+		conclude (e);
+		return;
+	}
 		
 	switch (e.type_) 
 	{
 	case Event::Done:
-		response_action_ = remote_socket_->read (callback (this, &ProxyConnector::on_response_data));
+		recorder_.add (TraceRead, e.buffer_.length (), 1);
+		if (capture_)
+			capture_->record (CaptureResponse, e.buffer_);
 		if (response_chain_.consume (e.buffer_))
+		{
+			if (capture_)
+				capture_->record_segments (CaptureResponse);
+			if (remote_socket_ && ! response_action_ && ! response_account_.pause ())
+				response_action_ = remote_socket_->read (callback (this, &ProxyConnector::on_response_data));
 			break;
+		}
 	case Event::EOS:
+		recorder_.add (TraceEOS, e.type_, 1);
+		if (capture_)
+		{
+			capture_->record_segments (CaptureResponse);
+			capture_->record_eos (CaptureResponse);
+		}
 		DEBUG(log_) << "Flushing response";
 		flushing_ |= RESPONSE_CHAIN_FLUSHING;
 		response_chain_.flush (RESPONSE_CHAIN_READY);
@@ -258,10 +556,33 @@ void ProxyConnector::on_response_data (Event e)
 	}
 }
 
+// a segment from a capture goes to the decoder of the chain it was found by
+void ProxyConnector::learn (CaptureChain chain, const Buffer& segment)
+{
+	DecodeFilter* dec = (chain == CaptureRequest ? local_decoder_ : remote_decoder_);
+
+	if (dec)
+		dec->learn (segment);
+}
+
+/*
+ * Reading stops while a chain holds more than it may, and starts again when
+ * its account is relieved. Stripes read on their own and are not held back.
+ */
+
+void ProxyConnector::resume (bool response)
+{
+	if (response && remote_socket_ && ! response_action_ && ! (flushing_ & RESPONSE_CHAIN_FLUSHING))
+		response_action_ = remote_socket_->read (callback (this, &ProxyConnector::on_response_data));
+	else if (! response && local_socket_ && ! request_action_ && ! (flushing_ & REQUEST_CHAIN_FLUSHING))
+		request_action_ = local_socket_->read (callback (this, &ProxyConnector::on_request_data));
+}
+
 void ProxyConnector::flush (int flg)
 {
+	recorder_.add (TraceFlush, flg, (flg & RESPONSE_CHAIN_READY ? 1 : 0));
 	flushing_ |= flg;
-	if ((flushing_ & (REQUEST_CHAIN_READY | RESPONSE_CHAIN_READY)) == (REQUEST_CHAIN_READY | RESPONSE_CHAIN_READY))
+	if ((flushing_ & (REQUEST_CHAIN_READY | RESPONSE_CHAIN_READY)) == (REQUEST_CHAIN_READY | RESPONSE_CHAIN_READY) || (flg & FILTER_ABORT))
 		if (! close_action_)
 			close_action_ = event_system.track (0, StreamModeWait, callback (this, &ProxyConnector::conclude));
 }
@@ -31,11 +31,21 @@
 #define REQUEST_CHAIN_READY		0x40000
 #define RESPONSE_CHAIN_READY		0x80000
 
+#define PROXY_CONNECT_GRACE		1000
+
+#include <list>
 #include <common/filter.h>
 #include <event/action.h>
 #include <event/event.h>
 #include <io/socket/socket_types.h>
 #include "wanproxy_codec.h"
+#include "proxy_capture.h"
+
+class DecodeFilter;
+class EncodeFilter;
+class ProxyStripe;
+class SinkFilter;
+struct WanProxyTally;
 
 ////////////////////////////////////////////////////////////////////////////////
 //                                                                            //
@@ -49,12 +59,36 @@
 
 class ProxyConnector : public Filter
 {
+	class ChainAccount : public MemoryAccount
+	{
+	public:
+		ProxyConnector* owner_;
+		bool response_;
+		
+		ChainAccount (ProxyConnector* owner, bool response) : owner_(owner), response_(response)   { }
+		virtual void relieved ()   { if (owner_) owner_->resume (response_); }
+	};
+	
 	LogHandle log_;
 	WANProxyCodec* local_codec_;
 	WANProxyCodec* remote_codec_;
 	Socket* local_socket_;
 	Socket* remote_socket_;
+	ProxyStripe* local_stripe_;
+	ProxyStripe* remote_stripe_;
+	SocketAddressFamily remote_family_;
+	std::string remote_name_;
+	std::list<ProxyConnector*>* pool_;
+	SinkFilter* standby_sink_;
+	SinkFilter* lazy_sink_;
+	EncodeFilter* remote_encoder_;
+	DecodeFilter* local_decoder_;
+	DecodeFilter* remote_decoder_;
+	Filter* request_sink_;
+	Filter* response_sink_;
 	bool is_cln_, is_ssh_;
+	ChainAccount request_account_;
+	ChainAccount response_account_;
 	FilterChain request_chain_;
 	FilterChain response_chain_;
 	Action* connect_action_;
@@ -63,18 +97,37 @@ class ProxyConnector : public Filter
 	Action* response_action_;
 	Action* close_action_;
    int flushing_;
+	WanProxyTally* tally_;
+	bool counted_;
+	FlightRecorder recorder_;
+	ProxyCapture* capture_;
 
 public:
 	ProxyConnector (const std::string&, WANProxyCodec*, WANProxyCodec*, 
-						 Socket*, SocketAddressFamily, const std::string&, bool cln, bool ssh);
+						 Socket*, SocketAddressFamily, const std::string&, bool cln, bool ssh,
+						 int stripes = 0, ProxyStripe* stripe = 0, std::list<ProxyConnector*>* pool = 0);
+	ProxyConnector (const std::string&, WANProxyCodec*, WANProxyCodec*, bool cln, Filter* request_sink, Filter* response_sink);
 	virtual ~ProxyConnector ();
 
+	bool ready () const   { return (standby_sink_ != 0); }
+	void detach ()   { pool_ = 0; }
+	void adopt (Socket* sck);
+
 	void connect_complete (Event e);
+	void grace_complete (Event e);
 	bool build_chains (WANProxyCodec* cdc1, WANProxyCodec* cdc2, Socket* sck1, Socket* sck2);
 	void on_request_data (Event e);
 	void on_response_data (Event e);
+	void learn (CaptureChain chain, const Buffer& segment);
    virtual void flush (int flg);
    void conclude (Event e);
+
+private:
+	bool connect_remote ();
+	void count ();
+	void capture (const std::string& name);
+	void budget (const std::string& name, bool limited);
+	void resume (bool response);
 };
 
 #endif /* !PROGRAMS_WANPROXY_PROXY_CONNECTOR_H */
@@ -0,0 +1,122 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// File:           proxy_dictionary.cc                                        //
+// Description:    compression dictionaries taken from the shared cache       //
+// Project:        WANProxy XTech                                             //
+// Author:         Andreu Vidal Bramfeld-Software                             //
+// Last modified:  2026-10-19                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <common/endian.h>
+#include <xcodec/xcodec_cache.h>
+#include "wanproxy.h"
+#include "proxy_dictionary.h"
+
+// Sending
+
+DictionarySendFilter::DictionarySendFilter (WANProxyCodec* cdc, Filter* cmp, bool prime) : BufferedFilter ("/wanproxy/dictionary/send")
+{
+	Buffer dict, list;
+	uint8_t count = 0;
+
+	/*
+	 * Only the side opening the connection primes its stream, since it
+	 * talks to the single peer which acknowledged the segments. Those
+	 * missing here by now are left out.
+	 */
+	if (prime && cdc->xcache_)
+	{
+		for (std::deque<uint64_t>::const_iterator it = cdc->dictionary_.begin (); it != cdc->dictionary_.end (); ++it)
+		{
+			if (cdc->xcache_->lookup (*it, dict))
+			{
+				uint64_t behash = BigEndian::encode (*it);
+				list.append (&behash);
+				count++;
+			}
+		}
+	}
+
+	if (count > 0 && cdc->prime_compressor (cmp, dict))
+	{
+		header_.append (count);
+		cdc->xcache_->identifier ().encode (header_);
+		header_.append (list);
+		DEBUG(log_) << "Priming stream with " << (unsigned) count << " segments.";
+	}
+	else
+	{
+		header_.append ((uint8_t) 0);
+	}
+}
+
+bool DictionarySendFilter::consume (Buffer& buf, int flg)
+{
+	if (header_.empty ())
+		return produce (buf, flg);
+
+	pending_.clear ();
+	pending_.append (header_);
+	pending_.append (buf);
+	header_.clear ();
+	return produce (pending_, flg);
+}
+
+// Receiving
+
+DictionaryReceiveFilter::DictionaryReceiveFilter (WANProxyCodec* cdc, Filter* dcmp) : BufferedFilter ("/wanproxy/dictionary/receive")
+{
+	codec_ = cdc;
+	decompressor_ = dcmp;
+	primed_ = false;
+}
+
+bool DictionaryReceiveFilter::consume (Buffer& buf, int flg)
+{
+	if (primed_)
+		return produce (buf, flg);
+
+	pending_.append (buf);
+	if (pending_.empty ())
+		return true;
+
+	uint8_t count = pending_.peek ();
+	if (count > 0)
+	{
+		if (pending_.length () < sizeof count + UUID_STRING_SIZE + count * sizeof (uint64_t))
+			return true;
+
+		UUID uuid;
+		XCodecCache* cache;
+		Buffer dict;
+
+		pending_.skip (sizeof count);
+		uuid.decode (pending_);
+		if (! (cache = wanproxy.find_cache (uuid)))
+		{
+			ERROR(log_) << "Unknown cache for compression dictionary: " << uuid;
+			return false;
+		}
+		for (int i = 0; i < count; ++i)
+		{
+			uint64_t hash;
+			pending_.moveout (&hash);
+			hash = BigEndian::decode (hash);
+			if (! cache->lookup (hash, dict))
+			{
+				ERROR(log_) << "Unknown hash in compression dictionary: " << hash;
+				return false;
+			}
+		}
+		if (! codec_->prime_decompressor (decompressor_, dict))
+			return false;
+	}
+	else
+	{
+		pending_.skip (sizeof count);
+	}
+
+	primed_ = true;
+	return (! pending_.empty () ? produce (pending_, flg) : true);
+}
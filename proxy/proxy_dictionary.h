@@ -0,0 +1,52 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// File:           proxy_dictionary.h                                         //
+// Description:    compression dictionaries taken from the shared cache       //
+// Project:        WANProxy XTech                                             //
+// Author:         Andreu Vidal Bramfeld-Software                             //
+// Last modified:  2026-10-19                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef	PROGRAMS_WANPROXY_PROXY_DICTIONARY_H
+#define	PROGRAMS_WANPROXY_PROXY_DICTIONARY_H
+
+#include <common/filter.h>
+#include "wanproxy_codec.h"
+
+/*
+ * A compressed stream starts with a header naming the cache segments used
+ * as preset dictionary, which the other side takes from its own copy of
+ * the same cache:
+ *
+ * 	count[uint8_t] (uuid[UUID_STRING_SIZE] hash[uint64_t x count])
+ *
+ * The sender goes after the compressor and the receiver before the
+ * decompressor, each one priming it before any data goes through.
+ */
+
+class DictionarySendFilter : public BufferedFilter
+{
+private:
+	Buffer header_;
+
+public:
+	DictionarySendFilter (WANProxyCodec* cdc, Filter* cmp, bool prime);
+
+	virtual bool consume (Buffer& buf, int flg = 0);
+};
+
+class DictionaryReceiveFilter : public BufferedFilter
+{
+private:
+	WANProxyCodec* codec_;
+	Filter* decompressor_;
+	bool primed_;
+
+public:
+	DictionaryReceiveFilter (WANProxyCodec* cdc, Filter* dcmp);
+
+	virtual bool consume (Buffer& buf, int flg = 0);
+};
+
+#endif /* !PROGRAMS_WANPROXY_PROXY_DICTIONARY_H */
@@ -24,6 +24,7 @@
  */
 
 #include <event/event_system.h>
+#include "wanproxy.h"
 #include "proxy_connector.h"
 #include "proxy_listener.h"
 
@@ -44,7 +45,8 @@ ProxyListener::ProxyListener (const std::string& name,
 										const std::string& local_address,
 										SocketAddressFamily remote_family,
 										const std::string& remote_address,
-										bool cln, bool ssh)
+										bool cln, bool ssh, int tunnels, int stripes, int pool,
+										int listeners, int backlog)
  : log_("/wanproxy/" + name + "/listener"),
    name_(name),
    local_codec_(local_codec),
@@ -55,16 +57,45 @@ ProxyListener::ProxyListener (const std::string& name,
    remote_address_(remote_address),
 	is_cln_(cln),
 	is_ssh_(ssh),
-   accept_action_(0),
+	tunnel_count_(tunnels),
+	stripe_count_(stripes),
+	standby_count_(pool),
+	listener_count_(listeners),
+	backlog_(backlog),
+   sweep_action_(0),
+   refill_action_(0),
    stop_action_(0)
 {
 	launch_service ();
+	fill_standby ();
 }
 
 ProxyListener::~ProxyListener ()
 { 
-	if (accept_action_)
-		accept_action_->cancel ();
+	drop_standby ();
+	while (! tunnels_.empty ())
+	{
+		ProxyTunnel* tnl = tunnels_.front ();
+		tunnels_.pop_front ();
+		tnl->detach ();
+		delete tnl;
+	}
+	std::map<Socket*, Greeting>::iterator it;
+	for (it = greetings_.begin (); it != greetings_.end (); ++it)
+	{
+		if (it->second.action_)
+			it->second.action_->cancel ();
+		it->first->close ();
+		delete it->first;
+	}
+	std::map<UUID, ProxyStripe*>::iterator st;
+	for (st = stripes_.begin (); st != stripes_.end (); ++st)
+		delete st->second;
+	if (sweep_action_)
+		sweep_action_->cancel ();
+	if (refill_action_)
+		refill_action_->cancel ();
+	stop_service ();
 	if (stop_action_)
 		stop_action_->cancel ();
 	close ();
@@ -72,9 +103,10 @@ ProxyListener::~ProxyListener ()
 
 void ProxyListener::launch_service ()
 {
-	if (listen (local_family_, local_address_))
+	if (listen (local_family_, local_address_, listener_count_, backlog_))
 	{
-		accept_action_ = accept (callback (this, &ProxyListener::accept_complete));
+		for (int i = 0; i < count (); ++i)
+			accept_actions_.push_back (accept (callback (this, &ProxyListener::accept_complete), i));
 		INFO(log_) << "Listening on: " << getsockname ();
 	}
 	else
@@ -83,6 +115,14 @@ void ProxyListener::launch_service ()
 	}
 }
 
+void ProxyListener::stop_service ()
+{
+	for (unsigned i = 0; i < accept_actions_.size (); ++i)
+		if (accept_actions_[i])
+			accept_actions_[i]->cancel ();
+	accept_actions_.clear ();
+}
+
 void ProxyListener::refresh  (const std::string& name,
 										WANProxyCodec* local_codec,
 										WANProxyCodec* remote_codec,
@@ -90,10 +130,15 @@ void ProxyListener::refresh  (const std::string& name,
 										const std::string& local_address,
 										SocketAddressFamily remote_family,
 										const std::string& remote_address,
-										bool cln, bool ssh)
+										bool cln, bool ssh, int tunnels, int stripes, int pool,
+										int listeners, int backlog)
 {
 	bool relaunch = (local_address != local_address_);
+	bool resize = (listeners != listener_count_);
+	bool requeue = (backlog != backlog_);
 	bool redirect = (remote_address != remote_address_);
+	bool reopen = (redirect || tunnels != tunnel_count_);
+	bool rewarm = (reopen || cln != is_cln_ || ssh != is_ssh_ || stripes != stripe_count_ || pool != standby_count_);
 	
    name_ = name;
    local_codec_ = local_codec;
@@ -104,13 +149,36 @@ void ProxyListener::refresh  (const std::string& name,
    remote_address_ = remote_address;
 	is_cln_ = cln;
 	is_ssh_ = ssh;
+	tunnel_count_ = tunnels;
+	stripe_count_ = stripes;
+	standby_count_ = pool;
+	listener_count_ = listeners;
+	backlog_ = backlog;
+	
+	if (rewarm)
+		drop_standby ();
+	fill_standby ();
+	
+	if (reopen)
+	{
+		std::list<ProxyTunnel*>::iterator it;
+		for (it = tunnels_.begin (); it != tunnels_.end (); ++it)
+			(*it)->retire ();
+	}
 	
 	if (relaunch)
 	{
-		if (accept_action_)
-			accept_action_->cancel (), accept_action_ = 0;
+		stop_service ();
 		launch_service ();
 	}
+	else
+	{
+		// the old sockets hold the address until they are closed
+		if (resize)
+			INFO(log_) << "New number of listeners will apply after a restart or a change of address.";
+		if (requeue)
+			relisten (backlog_);
+	}
 	
 	if (redirect)
 	{
@@ -124,7 +192,28 @@ void ProxyListener::accept_complete (Event e, Socket* sck)
 	{
 	case Event::Done:
 		DEBUG(log_) << "Accepted client: " << sck->getpeername ();
-		new ProxyConnector (name_, local_codec_, remote_codec_, sck, remote_family_, remote_address_, is_cln_, is_ssh_);
+		if (! admit (sck))
+		{
+			sck->close ();
+			delete sck;
+		}
+		else if (tunnel_count_ > 0 && ! is_ssh_)
+		{
+			if (is_cln_)
+				open_stream (sck);
+			else
+				new ProxyTunnel (name_, local_codec_, sck, remote_family_, remote_address_);
+		}
+		else if (stripe_count_ > 1 && ! is_cln_)
+		{
+			Greeting& g = greetings_[sck];
+			g.action_ = sck->read (callback (this, &ProxyListener::on_greeting, sck));
+			if (! sweep_action_)
+				sweep_action_ = event_system.track (STRIPE_SESSION_TIMEOUT, StreamModeWait, callback (this, &ProxyListener::sweep));
+		}
+		else if (! use_standby (sck))
+			new ProxyConnector (name_, local_codec_, remote_codec_, sck, remote_family_, remote_address_, is_cln_, is_ssh_,
+									  (is_cln_ ? stripe_count_ : 0));
 		break;
 	case Event::Error:
 		ERROR(log_) << "Accept error: " << e;
@@ -135,3 +224,205 @@ void ProxyListener::accept_complete (Event e, Socket* sck)
 	}
 }
 
+/*
+ * A proxy over its memory budget takes no new clients, be they meant for a
+ * tunnel, a set of stripes, a standby connection or a connector of their own.
+ */
+
+bool ProxyListener::admit (Socket* sck)
+{
+	WanProxyTally* tally = wanproxy.tally (name_);
+
+	if (! tally->memory_.exceeded ())
+		return true;
+	INFO(log_) << "Memory budget exceeded, rejecting connection from " << sck->getpeername ();
+	tally->rejected_++;
+	return false;
+}
+
+void ProxyListener::open_stream (Socket* sck)
+{
+	ProxyTunnel* tnl = 0;
+	int n = 0;
+	
+	std::list<ProxyTunnel*>::iterator it;
+	for (it = tunnels_.begin (); it != tunnels_.end (); ++it)
+	{
+		if ((*it)->available ())
+		{
+			if (! tnl || (*it)->stream_count () < tnl->stream_count ())
+				tnl = *it;
+			n++;
+		}
+	}
+	
+	if (! tnl || (tnl->stream_count () > 0 && n < tunnel_count_))
+		tnl = new ProxyTunnel (name_, remote_codec_, remote_family_, remote_address_, &tunnels_);
+		
+	if (! tnl->attach (sck))
+	{
+		INFO(log_) << "No tunnel available for client.";
+		sck->close ();
+		delete sck;
+	}
+}
+
+bool ProxyListener::use_standby (Socket* sck)
+{
+	ProxyConnector* cnt = 0;
+	
+	std::list<ProxyConnector*>::iterator it;
+	for (it = standby_.begin (); it != standby_.end (); ++it)
+	{
+		if ((*it)->ready ())
+		{
+			cnt = *it;
+			standby_.erase (it);
+			break;
+		}
+	}
+	
+	if (cnt)
+		cnt->adopt (sck);
+	fill_standby ();
+	return (cnt != 0);
+}
+
+/*
+ * Standby connections also leave the pool when the peer or a middlebox
+ * closes them, so the pool is checked now and then to make up for those,
+ * which also paces the attempts while the peer is unreachable.
+ */
+
+void ProxyListener::fill_standby ()
+{
+	if (! is_cln_ || is_ssh_ || tunnel_count_ > 0 || stripe_count_ > 1 || standby_count_ <= 0)
+	{
+		if (refill_action_)
+			refill_action_->cancel (), refill_action_ = 0;
+		return;
+	}
+		
+	while ((int) standby_.size () < standby_count_)
+		standby_.push_back (new ProxyConnector (name_, local_codec_, remote_codec_, 0, remote_family_, remote_address_, 
+															 is_cln_, is_ssh_, 0, 0, &standby_));
+	if (! refill_action_)
+		refill_action_ = event_system.track (STANDBY_REFILL_INTERVAL, StreamModeWait, callback (this, &ProxyListener::refill));
+}
+
+void ProxyListener::refill (Event e)
+{
+	if (refill_action_)
+		refill_action_->cancel (), refill_action_ = 0;
+	fill_standby ();
+}
+
+void ProxyListener::drop_standby ()
+{
+	while (! standby_.empty ())
+	{
+		ProxyConnector* cnt = standby_.front ();
+		standby_.pop_front ();
+		cnt->detach ();
+		delete cnt;
+	}
+}
+
+void ProxyListener::on_greeting (Event e, Socket* sck)
+{
+	std::map<Socket*, Greeting>::iterator it = greetings_.find (sck);
+	if (it == greetings_.end ())
+		return;
+	Greeting& g = it->second;
+	if (g.action_)
+		g.action_->cancel (), g.action_ = 0;
+
+	if (e.type_ == Event::Done)
+	{
+		g.buffer_.append (e.buffer_);
+		if (g.buffer_.length () < STRIPE_HEADER_SIZE)
+		{
+			g.action_ = sck->read (callback (this, &ProxyListener::on_greeting, sck));
+			return;
+		}
+	}
+
+	Buffer data (g.buffer_);
+	greetings_.erase (it);
+
+	UUID session;
+	int index, count;
+	if (e.type_ != Event::Done || ! ProxyStripe::decode_header (data, session, index, count))
+	{
+		INFO(log_) << "Invalid stripe greeting from: " << sck->getpeername ();
+		sck->close ();
+		delete sck;
+		return;
+	}
+
+	ProxyStripe*& stripe = stripes_[session];
+	if (! stripe)
+		stripe = new ProxyStripe (name_, session, count);
+	if (! stripe->attach (sck, index, data))
+	{
+		INFO(log_) << "Unexpected stripe member from: " << sck->getpeername ();
+		sck->close ();
+		delete sck;
+		return;
+	}
+
+	if (stripe->complete ())
+	{
+		DEBUG(log_) << "Stripe of " << count << " connections from: " << stripe->getpeername ();
+		new ProxyConnector (name_, local_codec_, remote_codec_, 0, remote_family_, remote_address_, is_cln_, is_ssh_, 0, stripe);
+		stripes_.erase (session);
+		stale_stripes_.erase (session);
+	}
+}
+
+/*
+ * Greetings and stripes still incomplete at two sweeps in a row are given
+ * up, so that a peer cannot hold sockets by never sending the rest.
+ */
+
+void ProxyListener::sweep (Event e)
+{
+	if (sweep_action_)
+		sweep_action_->cancel (), sweep_action_ = 0;
+
+	std::map<Socket*, Greeting>::iterator it = greetings_.begin ();
+	while (it != greetings_.end ())
+	{
+		if (! it->second.stale_)
+		{
+			it->second.stale_ = true;
+			++it;
+			continue;
+		}
+		INFO(log_) << "Stripe greeting timed out from: " << it->first->getpeername ();
+		if (it->second.action_)
+			it->second.action_->cancel ();
+		it->first->close ();
+		delete it->first;
+		greetings_.erase (it++);
+	}
+
+	std::set<UUID> stale;
+	std::map<UUID, ProxyStripe*>::iterator st = stripes_.begin ();
+	while (st != stripes_.end ())
+	{
+		if (stale_stripes_.find (st->first) == stale_stripes_.end ())
+		{
+			stale.insert (st->first);
+			++st;
+			continue;
+		}
+		INFO(log_) << "Incomplete stripe timed out from: " << st->second->getpeername ();
+		delete st->second;
+		stripes_.erase (st++);
+	}
+	stale_stripes_.swap (stale);
+
+	if (! greetings_.empty () || ! stripes_.empty ())
+		sweep_action_ = event_system.track (STRIPE_SESSION_TIMEOUT, StreamModeWait, callback (this, &ProxyListener::sweep));
+}
@@ -26,10 +26,19 @@
 #ifndef	PROGRAMS_WANPROXY_PROXY_LISTENER_H
 #define	PROGRAMS_WANPROXY_PROXY_LISTENER_H
 
+#include <list>
+#include <map>
+#include <set>
+#include <vector>
 #include <event/action.h>
 #include <event/event.h>
 #include <io/net/tcp_server.h>
 #include "wanproxy_codec.h"
+#include "proxy_tunnel.h"
+#include "proxy_stripe.h"
+#include "proxy_connector.h"
+
+#define STANDBY_REFILL_INTERVAL	1000		// ms between checks for standby connections lost
 
 ////////////////////////////////////////////////////////////////////////////////
 //                                                                            //
@@ -43,6 +52,14 @@
 
 class ProxyListener : public TCPServer
 {
+	struct Greeting
+	{
+		Action* action_;
+		Buffer buffer_;
+		bool stale_;
+		Greeting () : action_(0), stale_(false)   { }
+	};
+
 	LogHandle log_;
 	std::string name_;
 	WANProxyCodec* local_codec_;
@@ -52,18 +69,40 @@ class ProxyListener : public TCPServer
 	SocketAddressFamily remote_family_;
 	std::string remote_address_;
 	bool is_cln_, is_ssh_;
-	Action* accept_action_;
+	int tunnel_count_;
+	std::list<ProxyTunnel*> tunnels_;
+	int stripe_count_;
+	std::map<Socket*, Greeting> greetings_;
+	std::map<UUID, ProxyStripe*> stripes_;
+	std::set<UUID> stale_stripes_;
+	int standby_count_;
+	std::list<ProxyConnector*> standby_;
+	int listener_count_, backlog_;
+	std::vector<Action*> accept_actions_;
+	Action* sweep_action_;
+	Action* refill_action_;
 	Action* stop_action_;
 	
 public:
 	ProxyListener (const std::string&, WANProxyCodec*, WANProxyCodec*, SocketAddressFamily, const std::string&,
-						SocketAddressFamily, const std::string&, bool cln, bool ssh);
+						SocketAddressFamily, const std::string&, bool cln, bool ssh, int tunnels = 0, int stripes = 0, int pool = 0,
+						int listeners = 1, int backlog = SOCKET_LISTEN_BACKLOG);
 	~ProxyListener ();
 
 	void launch_service ();
+	void stop_service ();
 	void refresh (const std::string&, WANProxyCodec*, WANProxyCodec*, SocketAddressFamily, const std::string&,
-					  SocketAddressFamily, const std::string&, bool cln, bool ssh);
+					  SocketAddressFamily, const std::string&, bool cln, bool ssh, int tunnels = 0, int stripes = 0, int pool = 0,
+					  int listeners = 1, int backlog = SOCKET_LISTEN_BACKLOG);
 	void accept_complete (Event e, Socket* client);
+	bool admit (Socket* client);
+	void open_stream (Socket* client);
+	void on_greeting (Event e, Socket* client);
+	void sweep (Event e);
+	bool use_standby (Socket* client);
+	void fill_standby ();
+	void refill (Event e);
+	void drop_standby ();
 };
 
 #endif /* !PROGRAMS_WANPROXY_PROXY_LISTENER_H */
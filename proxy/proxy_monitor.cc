@@ -0,0 +1,231 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// File:           proxy_monitor.cc                                           //
+// Description:    serves the live statistics of the proxies on a socket     //
+// Project:        WANProxy XTech                                             //
+// Author:         Andreu Vidal Bramfeld-Software                             //
+// Last modified:  2026-10-19                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <sstream>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <event/event_system.h>
+#include <http/http_protocol.h>
+#include "wanproxy.h"
+#include "proxy_monitor.h"
+
+ProxyMonitor::ProxyMonitor ()
+ : log_("/wanproxy/monitor"),
+   tcp_server_(0),
+   unix_server_(0),
+   accept_action_(0),
+   stop_action_(0)
+{
+}
+
+ProxyMonitor::~ProxyMonitor ()
+{
+	shutdown ();
+}
+
+bool ProxyMonitor::listen (const std::string& address)
+{
+	struct stat st;
+
+	address_ = address;
+	if (address_.find ('/') != std::string::npos)
+	{
+		// a socket left behind by an earlier run would make the bind fail
+		if (::stat (address_.c_str (), &st) == 0 && S_ISSOCK (st.st_mode))
+			::unlink (address_.c_str ());
+		unix_server_ = new UnixServer ();
+		if (! unix_server_->listen (address_))
+			return false;
+		accept_action_ = unix_server_->accept (callback (this, &ProxyMonitor::accept_complete));
+	}
+	else
+	{
+		tcp_server_ = new TCPServer ();
+		if (! tcp_server_->listen (SocketAddressFamilyIP, address_))
+			return false;
+		accept_action_ = tcp_server_->accept (callback (this, &ProxyMonitor::accept_complete));
+	}
+
+	stop_action_ = event_system.register_interest (EventInterestStop, callback (this, &ProxyMonitor::shutdown));
+	INFO(log_) << "Statistics available on: " << (tcp_server_ ? tcp_server_->getsockname () : address_);
+	return true;
+}
+
+void ProxyMonitor::accept_complete (Event e, Socket* sck)
+{
+	switch (e.type_)
+	{
+	case Event::Done:
+		{
+			Client& c = clients_[sck];
+			c.action_ = sck->read (callback (this, &ProxyMonitor::on_request, sck));
+		}
+		break;
+	case Event::Error:
+		ERROR(log_) << "Accept error: " << e;
+		break;
+	default:
+		ERROR(log_) << "Unexpected event: " << e;
+		break;
+	}
+}
+
+void ProxyMonitor::on_request (Event e, Socket* sck)
+{
+	std::map<Socket*, Client>::iterator it = clients_.find (sck);
+	if (it == clients_.end ())
+		return;
+	Client& c = it->second;
+	if (c.action_)
+		c.action_->cancel (), c.action_ = 0;
+
+	switch (e.type_)
+	{
+	case Event::Done:
+		c.buffer_.append (e.buffer_);
+		if (answer (sck, c.buffer_, false))
+			return;
+		if (c.buffer_.length () < MONITOR_REQUEST_LIMIT)
+		{
+			c.action_ = sck->read (callback (this, &ProxyMonitor::on_request, sck));
+			return;
+		}
+		INFO(log_) << "Oversized statistics request.";
+		break;
+	case Event::EOS:
+		if (answer (sck, c.buffer_, true))
+			return;
+		break;
+	default:
+		break;
+	}
+
+	drop (sck);
+}
+
+void ProxyMonitor::on_reply (Event e, Socket* sck)
+{
+	std::map<Socket*, Client>::iterator it = clients_.find (sck);
+	if (it == clients_.end ())
+		return;
+	if (it->second.action_)
+		it->second.action_->cancel (), it->second.action_ = 0;
+
+	if (e.type_ != Event::Done)
+		DEBUG(log_) << "Statistics not delivered: " << e;
+	drop (sck);
+}
+
+/*
+ * Sends the reply once the request is complete, which for HTTP means up
+ * to the blank line after the headers and otherwise just a first line.
+ */
+
+bool ProxyMonitor::answer (Socket* sck, Buffer& request, bool eos)
+{
+	Buffer data (request), line;
+	std::vector<Buffer> words;
+	HTTPProtocol::ParseStatus rv;
+	bool http = false;
+
+	if (HTTPProtocol::ExtractLine (&line, &data) == HTTPProtocol::ParseSuccess)
+	{
+		words = line.split (' ', false);
+		if ((http = (words.size () == 3 && words[2].prefix ("HTTP/"))))
+		{
+			do
+				line.clear (), rv = HTTPProtocol::ExtractLine (&line, &data);
+			while (rv == HTTPProtocol::ParseSuccess && ! line.empty ());
+			if (rv != HTTPProtocol::ParseSuccess && ! eos)
+				return false;
+		}
+	}
+	else if (! eos)
+	{
+		return false;
+	}
+
+	// the recent events of the connections are asked for by name
+	std::string body;
+	if (http ? words[1].equal ("/recorder") : line.equal ("recorder"))
+	{
+		body = wanproxy.recordings ();
+	}
+	else
+	{
+		std::ostringstream os;
+		wanproxy.report (os);
+		body = os.str ();
+	}
+
+	Buffer reply;
+	if (http)
+	{
+		if (words[1].equal ("/") || words[1].equal ("/metrics") || words[1].equal ("/recorder"))
+		{
+			std::ostringstream hdr;
+			hdr << "HTTP/1.0 200 OK\r\n";
+			hdr << "Content-Type: text/plain; version=0.0.4\r\n";
+			hdr << "Content-Length: " << body.length () << "\r\n";
+			hdr << "Connection: close\r\n\r\n";
+			reply.append (hdr.str ());
+			if (! words[0].equal ("HEAD"))
+				reply.append (body);
+		}
+		else
+		{
+			reply.append (std::string ("HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n"));
+		}
+	}
+	else
+	{
+		reply.append (body);
+	}
+
+	Client& c = clients_[sck];
+	c.action_ = sck->write (reply, callback (this, &ProxyMonitor::on_reply, sck));
+	return true;
+}
+
+void ProxyMonitor::drop (Socket* sck)
+{
+	std::map<Socket*, Client>::iterator it = clients_.find (sck);
+	if (it != clients_.end ())
+	{
+		if (it->second.action_)
+			it->second.action_->cancel ();
+		clients_.erase (it);
+	}
+	sck->close ();
+	delete sck;
+}
+
+void ProxyMonitor::shutdown ()
+{
+	if (stop_action_)
+		stop_action_->cancel (), stop_action_ = 0;
+	if (accept_action_)
+		accept_action_->cancel (), accept_action_ = 0;
+	while (! clients_.empty ())
+		drop (clients_.begin ()->first);
+	if (tcp_server_)
+	{
+		tcp_server_->close ();
+		delete tcp_server_;
+		tcp_server_ = 0;
+	}
+	if (unix_server_)
+	{
+		unix_server_->close (0);
+		::unlink (address_.c_str ());
+		delete unix_server_;
+		unix_server_ = 0;
+	}
+}
@@ -0,0 +1,64 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// File:           proxy_monitor.h                                            //
+// Description:    serves the live statistics of the proxies on a socket     //
+// Project:        WANProxy XTech                                             //
+// Author:         Andreu Vidal Bramfeld-Software                             //
+// Last modified:  2026-10-19                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef	PROGRAMS_WANPROXY_PROXY_MONITOR_H
+#define	PROGRAMS_WANPROXY_PROXY_MONITOR_H
+
+#include <map>
+#include <event/action.h>
+#include <event/event.h>
+#include <io/net/tcp_server.h>
+#include <io/socket/unix_server.h>
+
+#define MONITOR_REQUEST_LIMIT		8192
+
+/*
+ * Answers each connection with the current figures as "name value" lines,
+ * and then closes it. A client speaking HTTP, as a metrics scraper does,
+ * gets them as the body of a text/plain response; anything else, even an
+ * empty request, gets the bare lines. Asking for "/recorder", or sending a
+ * "recorder" line, gives the recent events of the live connections instead.
+ * An address with a slash in it names a local socket, any other one is
+ * taken as "[host]:port".
+ */
+
+class ProxyMonitor
+{
+	struct Client
+	{
+		Action* action_;
+		Buffer buffer_;
+		Client () : action_(0)   { }
+	};
+
+	LogHandle log_;
+	std::string address_;
+	TCPServer* tcp_server_;
+	UnixServer* unix_server_;
+	std::map<Socket*, Client> clients_;
+	Action* accept_action_;
+	Action* stop_action_;
+
+public:
+	ProxyMonitor ();
+	~ProxyMonitor ();
+
+	bool listen (const std::string& address);
+
+private:
+	void accept_complete (Event e, Socket* sck);
+	void on_request (Event e, Socket* sck);
+	void on_reply (Event e, Socket* sck);
+	bool answer (Socket* sck, Buffer& request, bool eos);
+	void drop (Socket* sck);
+	void shutdown ();
+};
+
+#endif /* !PROGRAMS_WANPROXY_PROXY_MONITOR_H */
@@ -0,0 +1,217 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// File:           proxy_replay.cc                                            //
+// Description:    feeds a captured connection through the proxy chains       //
+// Project:        WANProxy XTech                                             //
+// Author:         Andreu Vidal Bramfeld-Software                             //
+// Last modified:  2026-10-19                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <time.h>
+#include <sys/resource.h>
+#include <iostream>
+#include <event/event_system.h>
+#include "wanproxy.h"
+#include "proxy_connector.h"
+#include "proxy_replay.h"
+
+static const char* chain_names[2] = { "request", "response" };
+
+// takes the place of the socket at the end of a chain
+class ReplaySink : public Filter
+{
+	ProxyReplay* replay_;
+	CaptureChain chain_;
+
+public:
+	ReplaySink (ProxyReplay* rpl, CaptureChain chain) : replay_(rpl), chain_(chain)   { }
+	virtual ~ReplaySink ()   { replay_->released (); }
+
+	virtual bool consume (Buffer& buf, int flg)   { replay_->output (chain_, buf.length ()); buf.clear (); return true; }
+	virtual void flush (int flg)   { replay_->drained (chain_, flg); Filter::flush (flg); }
+};
+
+static double replay_clock ()
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+ProxyReplay::ProxyReplay () : log_("/wanproxy/replay")
+{
+	connector_ = 0;
+	action_ = 0;
+	paced_ = false;
+	loaded_ = false;
+	records_ = segments_ = 0;
+	input_[0] = input_[1] = output_[0] = output_[1] = 0;
+	ended_[0] = ended_[1] = drained_[0] = drained_[1] = aborted_ = false;
+	started_ = 0;
+}
+
+ProxyReplay::~ProxyReplay ()
+{
+	close ();
+}
+
+bool ProxyReplay::start (const std::string& path, bool paced)
+{
+	if (! capture_.open (path))
+		return false;
+
+	WanProxyInstance* prx = wanproxy.find_proxy (capture_.proxy ());
+	if (! prx)
+	{
+		ERROR(log_) << "No proxy " << capture_.proxy () << " in the configuration";
+		return false;
+	}
+	if (prx->proxy_secure_)
+	{
+		ERROR(log_) << "Captures of SSH proxies cannot be replayed";
+		return false;
+	}
+
+	INFO(log_) << "Replaying " << capture_.label () << " through proxy " << prx->proxy_name_;
+	connector_ = new ProxyConnector (prx->proxy_name_, &prx->local_codec_, &prx->remote_codec_, prx->proxy_client_,
+												new ReplaySink (this, CaptureRequest), new ReplaySink (this, CaptureResponse));
+	paced_ = paced;
+	started_ = replay_clock ();
+	loaded_ = load ();
+	schedule (delay ());
+	return true;
+}
+
+void ProxyReplay::drained (CaptureChain chain, int flg)
+{
+	if (flg & FILTER_ABORT)
+	{
+		INFO(log_) << "The " << chain_names[chain] << " chain aborted";
+		aborted_ = true;
+		schedule (0, true);
+		return;
+	}
+	drained_[chain] = true;
+	if (drained_[CaptureRequest] && drained_[CaptureResponse])
+		schedule (0, true);
+}
+
+/*
+ * Timers only fire every so often, so all the records already due are fed
+ * at once, which when not pacing means the whole capture.
+ */
+
+void ProxyReplay::next (Event e)
+{
+	if (action_)
+		action_->cancel (), action_ = 0;
+	if (aborted_ || ! connector_)
+	{
+		schedule (0, true);
+		return;
+	}
+
+	while (loaded_)
+	{
+		feed (record_);
+		records_++;
+		if ((drained_[CaptureRequest] && drained_[CaptureResponse]) || aborted_)
+			return;
+		if ((loaded_ = load ()) && delay () > 0)
+		{
+			schedule (delay ());
+			return;
+		}
+	}
+
+	for (int i = 0; i < 2; ++i)
+	{
+		if (! ended_[i])
+		{
+			Record eos = { (CaptureChain) i, 0, Buffer (), CaptureEnd };
+			feed (eos);
+		}
+	}
+	if (! action_)
+		schedule (REPLAY_DRAIN_WAIT, true);
+}
+
+void ProxyReplay::finish (Event e)
+{
+	struct rusage ru;
+	double cpu = 0;
+	int i;
+
+	if (action_)
+		action_->cancel (), action_ = 0;
+	if (! drained_[CaptureRequest] || ! drained_[CaptureResponse])
+		INFO(log_) << "Chains not flushed at the end of the capture";
+
+	if (getrusage (RUSAGE_SELF, &ru) == 0)
+		cpu = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+
+	std::cout << "wanproxy_replay_records " << records_ << "\n";
+	std::cout << "wanproxy_replay_segments " << segments_ << "\n";
+	std::cout << "wanproxy_replay_seconds " << (replay_clock () - started_) << "\n";
+	std::cout << "wanproxy_replay_cpu_seconds " << cpu << "\n";
+	for (i = 0; i < 2; ++i)
+	{
+		std::cout << "wanproxy_replay_input_bytes{chain=\"" << chain_names[i] << "\"} " << input_[i] << "\n";
+		std::cout << "wanproxy_replay_output_bytes{chain=\"" << chain_names[i] << "\"} " << output_[i] << "\n";
+	}
+	wanproxy.report (std::cout);
+	std::cout.flush ();
+
+	event_system.stop ();
+}
+
+// the connector goes before the caches and coordinators its chains refer to
+void ProxyReplay::close ()
+{
+	if (action_)
+		action_->cancel (), action_ = 0;
+	delete connector_;
+	connector_ = 0;
+}
+
+bool ProxyReplay::load ()
+{
+	return capture_.next (record_.chain_, record_.time_, record_.buffer_, record_.kind_);
+}
+
+// the recorded gaps are kept from the start, so that they do not add up
+int ProxyReplay::delay ()
+{
+	double ms;
+
+	if (! paced_)
+		return 0;
+	ms = (started_ + record_.time_ / 1e6 - replay_clock ()) * 1000;
+	return (ms > 0 ? (int) ms : 0);
+}
+
+void ProxyReplay::feed (Record& rec)
+{
+	Event e ((rec.kind_ == CaptureEnd ? Event::EOS : Event::Done), rec.buffer_);
+
+	if (rec.kind_ == CaptureSegment)
+	{
+		segments_++;
+		connector_->learn (rec.chain_, rec.buffer_);
+		return;
+	}
+	ended_[rec.chain_] = (rec.kind_ == CaptureEnd);
+	input_[rec.chain_] += rec.buffer_.length ();
+	if (rec.chain_ == CaptureRequest)
+		connector_->on_request_data (e);
+	else
+		connector_->on_response_data (e);
+}
+
+void ProxyReplay::schedule (int ms, bool finishing)
+{
+	if (action_)
+		action_->cancel ();
+	action_ = event_system.track (ms, StreamModeWait, callback (this, (finishing ? &ProxyReplay::finish : &ProxyReplay::next)));
+}
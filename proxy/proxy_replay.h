@@ -0,0 +1,81 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// File:           proxy_replay.h                                             //
+// Description:    feeds a captured connection through the proxy chains       //
+// Project:        WANProxy XTech                                             //
+// Author:         Andreu Vidal Bramfeld-Software                             //
+// Last modified:  2026-10-19                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef	PROGRAMS_WANPROXY_PROXY_REPLAY_H
+#define	PROGRAMS_WANPROXY_PROXY_REPLAY_H
+
+#include <event/action.h>
+#include <event/event.h>
+#include "proxy_capture.h"
+
+#define REPLAY_DRAIN_WAIT		5000		// ms
+
+class ProxyConnector;
+
+/*
+ * Builds a connector for the proxy named in a capture, with the chains and
+ * caches of the current configuration but no sockets, and hands it the
+ * captured reads one at a time from the event loop, either as fast as the
+ * chains take them or keeping the recorded gaps, which the flush timers of
+ * the encoder depend on. Captured segments go to the decoders, standing in
+ * for the <LEARN>s of the peer, whose <ASK>s are lost with the rest of what
+ * the chains output, which is only counted. Once both chains are flushed,
+ * as soon as one of them aborts, or some time after the last record if the
+ * capture does not end cleanly, the figures are written out and the event
+ * system is stopped. The sinks tell when the connector deletes itself, so
+ * that nothing more is fed to it.
+ */
+
+class ProxyReplay
+{
+	struct Record
+	{
+		CaptureChain chain_;
+		uint64_t time_;
+		Buffer buffer_;
+		CaptureKind kind_;
+	};
+
+	LogHandle log_;
+	ProxyCapture capture_;
+	ProxyConnector* connector_;
+	Action* action_;
+	Record record_;
+	bool loaded_;
+	bool paced_;
+	uintmax_t records_;
+	uintmax_t segments_;
+	uintmax_t input_[2];
+	uintmax_t output_[2];
+	bool ended_[2];
+	bool drained_[2];
+	bool aborted_;
+	double started_;
+
+public:
+	ProxyReplay ();
+	~ProxyReplay ();
+
+	bool start (const std::string& path, bool paced);
+	void close ();
+	void output (CaptureChain chain, size_t len)   { output_[chain] += len; }
+	void drained (CaptureChain chain, int flg);
+	void released ()   { connector_ = 0; }
+
+private:
+	void next (Event e);
+	void finish (Event e);
+	bool load ();
+	int delay ();
+	void feed (Record& rec);
+	void schedule (int ms, bool finishing = false);
+};
+
+#endif /* !PROGRAMS_WANPROXY_PROXY_REPLAY_H */
@@ -0,0 +1,421 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// File:           proxy_stripe.cc                                            //
+// Description:    spreading of a connection stream over parallel sockets     //
+// Project:        WANProxy XTech                                             //
+// Author:         Andreu Vidal Bramfeld-Software                             //
+// Last modified:  2026-10-19                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <common/endian.h>
+#include <event/event_system.h>
+#include <io/sink_filter.h>
+#include "proxy_stripe.h"
+
+/*
+ * Every socket of a stripe starts with a greeting telling the other side
+ * which group it belongs to:
+ *
+ * 	magic[uint32_t] session[UUID] index[uint8_t] count[uint8_t]
+ *
+ * and then carries chunks of the stream, each sent over the socket with
+ * the least data waiting to be written, so that a slow flow gets fewer of
+ * them, and put back in order by the receiver:
+ *
+ * 	sequence[uint32_t] length[uint16_t] data[uint8_t x length]
+ *
+ * The chunks of each socket come in order, so one that has brought a chunk
+ * past the next one expected cannot be carrying that one. Such sockets stop
+ * being read while too much is held out of order, until the gap is filled.
+ */
+#define	STRIPE_MAGIC			((uint32_t)0x57505354)
+
+class StripeFilter : public BufferedFilter
+{
+	class Joint : public Filter
+	{
+		StripeFilter* owner_;
+		bool done_;
+	public:
+		Joint (StripeFilter* f) : owner_(f), done_(false)   { }
+		virtual void flush (int flg)   { if (! done_) done_ = true, owner_->sink_flushed (); }
+	};
+
+	std::vector<SinkFilter*> sinks_;
+	std::vector<Joint*> joints_;
+	uint32_t seq_;
+	unsigned next_;
+	unsigned flushed_;
+
+public:
+	StripeFilter (const std::vector<Socket*>& sockets) : BufferedFilter ("/wanproxy/stripe")
+	{
+		seq_ = next_ = flushed_ = 0;
+		for (unsigned i = 0; i < sockets.size (); ++i)
+		{
+			sinks_.push_back (new SinkFilter ("/wanproxy/stripe", sockets[i]));
+			joints_.push_back (new Joint (this));
+			sinks_[i]->chain (joints_[i]);
+		}
+	}
+
+	virtual ~StripeFilter ()
+	{
+		for (unsigned i = 0; i < sinks_.size (); ++i)
+			delete sinks_[i], delete joints_[i];
+	}
+
+	bool greet (const UUID& session)
+	{
+		for (unsigned i = 0; i < sinks_.size (); ++i)
+		{
+			Buffer hdr;
+			uint32_t magic = BigEndian::encode (STRIPE_MAGIC);
+			hdr.append (&magic);
+			session.encode (hdr);
+			hdr.append ((uint8_t) i);
+			hdr.append ((uint8_t) sinks_.size ());
+			if (! sinks_[i]->consume (hdr))
+				return false;
+		}
+		return true;
+	}
+
+	virtual bool consume (Buffer& buf, int flg = 0)
+	{
+		while (! buf.empty ())
+		{
+			uint16_t len = (buf.length () > STRIPE_CHUNK_SIZE ? STRIPE_CHUNK_SIZE : buf.length ());
+			uint32_t seq = BigEndian::encode (seq_++);
+			uint16_t n = BigEndian::encode (len);
+			Buffer chunk;
+			chunk.append (&seq);
+			chunk.append (&n);
+			chunk.append (buf, len);
+			buf.skip (len);
+			unsigned k = least_backlogged ();
+			if (! sinks_[k]->consume (chunk))
+				return false;
+			next_ = (k + 1) % sinks_.size ();
+		}
+		return true;
+	}
+
+	// ties go round-robin, as all sockets are idle on a fast link
+	unsigned least_backlogged ()
+	{
+		unsigned best = next_;
+		for (unsigned n = 1; n < sinks_.size (); ++n)
+		{
+			unsigned i = (next_ + n) % sinks_.size ();
+			if (sinks_[i]->backlog () < sinks_[best]->backlog ())
+				best = i;
+		}
+		return best;
+	}
+
+	virtual void flush (int flg)
+	{
+		flushing_ = true;
+		flush_flags_ |= flg;
+		for (unsigned i = 0; i < sinks_.size (); ++i)
+			sinks_[i]->flush (0);
+	}
+
+	void sink_flushed ()
+	{
+		if (++flushed_ == sinks_.size ())
+			Filter::flush (flush_flags_);
+	}
+};
+
+ProxyStripe::ProxyStripe (const std::string& name, int count)
+ : log_("/wanproxy/" + name + "/stripe"),
+   count_(count),
+   sockets_(count),
+   actions_(count),
+   input_(count),
+   last_seq_(count),
+   paused_(count),
+   reordered_(0),
+   next_seq_(0),
+   connected_(0),
+   ended_(0),
+	greeting_(true),
+	failed_(false),
+   connect_request_(0),
+   read_request_(0)
+{
+	session_.generate ();
+}
+
+ProxyStripe::ProxyStripe (const std::string& name, const UUID& session, int count)
+ : log_("/wanproxy/" + name + "/stripe"),
+   session_(session),
+   count_(count),
+   sockets_(count),
+   actions_(count),
+   input_(count),
+   last_seq_(count),
+   paused_(count),
+   reordered_(0),
+   next_seq_(0),
+   connected_(0),
+   ended_(0),
+	greeting_(false),
+	failed_(false),
+   connect_request_(0),
+   read_request_(0)
+{
+}
+
+ProxyStripe::~ProxyStripe ()
+{
+	if (connect_request_)
+		connect_request_->cancel ();
+	if (read_request_)
+		read_request_->cancel ();
+	for (int i = 0; i < count_; ++i)
+	{
+		if (actions_[i])
+			actions_[i]->cancel ();
+		if (sockets_[i])
+			sockets_[i]->close ();
+		delete sockets_[i];
+	}
+}
+
+Action* ProxyStripe::connect (SocketAddressFamily family, const std::string& address, EventCallback* cb)
+{
+	for (int i = 0; i < count_; ++i)
+	{
+		if (! (sockets_[i] = Socket::create (family, SocketTypeStream, "tcp", address)))
+		{
+			connect_cancel ();
+			delete cb;
+			return 0;
+		}
+		actions_[i] = sockets_[i]->connect (address, callback (this, &ProxyStripe::connect_complete, i));
+	}
+
+	return (connect_request_ = new StripeAction (this, &ProxyStripe::connect_cancel, cb));
+}
+
+void ProxyStripe::connect_complete (Event e, int index)
+{
+	if (actions_[index])
+		actions_[index]->cancel (), actions_[index] = 0;
+
+	if (e.type_ == Event::Done && ++connected_ < count_)
+		return;
+
+	if (e.type_ != Event::Done)
+	{
+		for (int i = 0; i < count_; ++i)
+			if (actions_[i])
+				actions_[i]->cancel (), actions_[i] = 0;
+	}
+
+	/*
+	 * The requester normally cancels its action from within the callback,
+	 * so the callback is taken out of it before running it.
+	 */
+	EventCallback* cb = (connect_request_ ? connect_request_->callback_ : 0);
+	if (cb)
+	{
+		connect_request_->callback_ = 0;
+		cb->param () = e;
+		cb->execute ();
+		delete cb;
+	}
+}
+
+void ProxyStripe::connect_cancel ()
+{
+	for (int i = 0; i < count_; ++i)
+		if (actions_[i])
+			actions_[i]->cancel (), actions_[i] = 0;
+
+	delete connect_request_;
+	connect_request_ = 0;
+}
+
+bool ProxyStripe::attach (Socket* sck, int index, Buffer& data)
+{
+	if (index < 0 || index >= count_ || sockets_[index])
+		return false;
+
+	sockets_[index] = sck;
+	input_[index] = data;
+	connected_++;
+	return receive (index);
+}
+
+bool ProxyStripe::complete () const
+{
+	return (connected_ == count_);
+}
+
+Action* ProxyStripe::read (EventCallback* cb)
+{
+	read_request_ = new StripeAction (this, &ProxyStripe::read_cancel, cb);
+
+	for (int i = 0; i < count_; ++i)
+		if (sockets_[i] && ! actions_[i])
+			actions_[i] = sockets_[i]->read (callback (this, &ProxyStripe::read_complete, i));
+
+	// data that came along with the greetings may already be complete
+	release ();
+	return read_request_;
+}
+
+void ProxyStripe::read_complete (Event e, int index)
+{
+	if (actions_[index])
+		actions_[index]->cancel (), actions_[index] = 0;
+	if (failed_)
+		return;
+
+	switch (e.type_)
+	{
+	case Event::Done:
+		input_[index].append (e.buffer_);
+		if (! receive (index))
+			break;
+		release ();
+		if (failed_ || ! read_request_ || actions_[index])
+			return;
+		if (reordered_ > STRIPE_REORDER_LIMIT && ahead (index))
+			paused_[index] = true;
+		else
+			actions_[index] = sockets_[index]->read (callback (this, &ProxyStripe::read_complete, index));
+		return;
+	case Event::EOS:
+		if (++ended_ < count_)
+			return;
+		if (reorder_.empty ())
+		{
+			deliver (e);
+			return;
+		}
+		ERROR(log_) << "Stripe ended with missing chunks.";
+		break;
+	default:
+		DEBUG(log_) << "Unexpected event: " << e;
+		break;
+	}
+
+	failed_ = true;
+	deliver (Event (Event::Error, e.error_));
+}
+
+void ProxyStripe::read_cancel ()
+{
+	for (int i = 0; i < count_; ++i)
+		if (actions_[i])
+			actions_[i]->cancel (), actions_[i] = 0;
+
+	delete read_request_;
+	read_request_ = 0;
+}
+
+bool ProxyStripe::receive (int index)
+{
+	Buffer& input = input_[index];
+	uint32_t seq;
+	uint16_t len;
+
+	while (input.length () >= sizeof seq + sizeof len)
+	{
+		input.extract (&len, sizeof seq);
+		len = BigEndian::decode (len);
+		if (input.length () < sizeof seq + sizeof len + len)
+			break;
+		input.extract (&seq);
+		seq = BigEndian::decode (seq);
+		if (seq - next_seq_ > 0x7fffffff || reorder_.find (seq) != reorder_.end ())
+		{
+			ERROR(log_) << "Invalid chunk sequence: " << seq;
+			return false;
+		}
+		input.moveout (&reorder_[seq], sizeof seq + sizeof len, len);
+		last_seq_[index] = seq;
+		reordered_ += len;
+	}
+
+	return true;
+}
+
+void ProxyStripe::release ()
+{
+	std::map<uint32_t, Buffer>::iterator it;
+	Buffer output;
+
+	while ((it = reorder_.begin ()) != reorder_.end () && it->first == next_seq_)
+	{
+		reordered_ -= it->second.length ();
+		output.append (it->second);
+		reorder_.erase (it);
+		next_seq_++;
+	}
+
+	if (reordered_ <= STRIPE_REORDER_LIMIT && read_request_)
+	{
+		for (int i = 0; i < count_; ++i)
+			if (paused_[i] && ! actions_[i])
+				paused_[i] = false, actions_[i] = sockets_[i]->read (callback (this, &ProxyStripe::read_complete, i));
+	}
+
+	if (! output.empty ())
+		deliver (Event (Event::Done, output));
+}
+
+bool ProxyStripe::ahead (int index) const
+{
+	return (! reorder_.empty () && (int32_t) (last_seq_[index] - next_seq_) > 0);
+}
+
+void ProxyStripe::deliver (Event e)
+{
+	if (read_request_ && read_request_->callback_)
+	{
+		read_request_->callback_->param () = e;
+		read_request_->callback_->execute ();
+	}
+}
+
+Filter* ProxyStripe::sink ()
+{
+	StripeFilter* f = new StripeFilter (sockets_);
+	if (greeting_ && ! f->greet (session_))
+		ERROR(log_) << "Could not send stripe greeting.";
+	return f;
+}
+
+std::string ProxyStripe::getpeername () const
+{
+	for (int i = 0; i < count_; ++i)
+		if (sockets_[i])
+			return sockets_[i]->getpeername ();
+	return std::string ();
+}
+
+bool ProxyStripe::decode_header (Buffer& buf, UUID& session, int& index, int& count)
+{
+	uint32_t magic;
+
+	if (buf.length () < STRIPE_HEADER_SIZE)
+		return false;
+	buf.extract (&magic);
+	if (BigEndian::decode (magic) != STRIPE_MAGIC)
+		return false;
+	buf.skip (sizeof magic);
+	if (! session.decode (buf))
+		return false;
+	index = buf.peek ();
+	buf.skip (1);
+	count = buf.peek ();
+	buf.skip (1);
+	return (count > 1 && count <= STRIPE_MAX_COUNT && index < count);
+}
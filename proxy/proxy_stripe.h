@@ -0,0 +1,74 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// File:           proxy_stripe.h                                             //
+// Description:    spreading of a connection stream over parallel sockets     //
+// Project:        WANProxy XTech                                             //
+// Author:         Andreu Vidal Bramfeld-Software                             //
+// Last modified:  2026-10-19                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef	PROGRAMS_WANPROXY_PROXY_STRIPE_H
+#define	PROGRAMS_WANPROXY_PROXY_STRIPE_H
+
+#include <map>
+#include <vector>
+#include <common/filter.h>
+#include <common/uuid/uuid.h>
+#include <event/action.h>
+#include <event/event.h>
+#include <event/event_callback.h>
+#include <io/socket/socket.h>
+
+#define STRIPE_MAX_COUNT		(16)
+#define STRIPE_CHUNK_SIZE		(16384)
+#define STRIPE_HEADER_SIZE		(sizeof (uint32_t) + UUID_STRING_SIZE + 2)
+#define STRIPE_REORDER_LIMIT	(4 << 20)	// bytes held out of order before the sockets ahead stop reading
+#define STRIPE_SESSION_TIMEOUT	10000		// ms an incomplete stripe may wait for its other sockets
+
+class ProxyStripe
+{
+	typedef CallbackAction<ProxyStripe, EventCallback> StripeAction;
+
+	LogHandle log_;
+	UUID session_;
+	int count_;
+	std::vector<Socket*> sockets_;
+	std::vector<Action*> actions_;
+	std::vector<Buffer> input_;
+	std::map<uint32_t, Buffer> reorder_;
+	std::vector<uint32_t> last_seq_;
+	std::vector<bool> paused_;
+	size_t reordered_;
+	uint32_t next_seq_;
+	int connected_, ended_;
+	bool greeting_, failed_;
+	StripeAction* connect_request_;
+	StripeAction* read_request_;
+
+public:
+	ProxyStripe (const std::string& name, int count);
+	ProxyStripe (const std::string& name, const UUID& session, int count);
+	~ProxyStripe ();
+
+	Action* connect (SocketAddressFamily family, const std::string& address, EventCallback* cb);
+	bool attach (Socket* sck, int index, Buffer& data);
+	bool complete () const;
+	Action* read (EventCallback* cb);
+	Filter* sink ();
+	std::string getpeername () const;
+
+	static bool decode_header (Buffer& buf, UUID& session, int& index, int& count);
+
+private:
+	void connect_complete (Event e, int index);
+	void connect_cancel ();
+	void read_complete (Event e, int index);
+	void read_cancel ();
+	bool receive (int index);
+	void release ();
+	bool ahead (int index) const;
+	void deliver (Event e);
+};
+
+#endif /* !PROGRAMS_WANPROXY_PROXY_STRIPE_H */
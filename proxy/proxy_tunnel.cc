@@ -0,0 +1,619 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// File:           proxy_tunnel.cc                                            //
+// Description:    persistent encoded connection multiplexing client streams  //
+// Project:        WANProxy XTech                                             //
+// Author:         Andreu Vidal Bramfeld-Software                             //
+// Last modified:  2026-10-19                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <common/endian.h>
+#include <common/count_filter.h>
+#include <event/event_system.h>
+#include <io/socket/socket.h>
+#include <io/sink_filter.h>
+#include <xcodec/xcodec_filter.h>
+#include "proxy_tunnel.h"
+#include "proxy_dictionary.h"
+
+/*
+ * Streams are multiplexed inside the plain data going through the codec, so
+ * that all of them share the same encoder, cache and TCP connection:
+ *
+ * 	<OPEN> id[uint32_t]				new stream (client side only)
+ * 	<DATA> id[uint32_t] length[uint16_t] data[uint8_t x length]
+ * 	<CLOSE> id[uint32_t]				no more data will be sent
+ * 	<CREDIT> id[uint32_t] count[uint32_t]	bytes delivered to the endpoint
+ * 	<RESET> id[uint32_t]				stream aborted
+ *
+ * A stream stops reading from its endpoint once it has sent a whole window of
+ * data not yet credited by the other side.
+ */
+#define	TUNNEL_OP_OPEN			((uint8_t)0x01)
+#define	TUNNEL_OP_DATA			((uint8_t)0x02)
+#define	TUNNEL_OP_CLOSE		((uint8_t)0x03)
+#define	TUNNEL_OP_CREDIT		((uint8_t)0x04)
+#define	TUNNEL_OP_RESET		((uint8_t)0x05)
+
+// Streams
+
+TunnelStream::TunnelStream (ProxyTunnel* tnl, uint32_t id, Socket* sck, bool connected)
+ : log_("/wanproxy/tunnel/stream"),
+   tunnel_(tnl),
+   id_(id),
+   socket_(sck),
+   connect_action_(0),
+   read_action_(0),
+   write_action_(0),
+   written_(0),
+   credit_(TUNNEL_STREAM_WINDOW),
+   held_(0),
+	connected_(connected),
+	sent_close_(false),
+	received_close_(false),
+	down_(false)
+{
+	if (connected_)
+		start_reading ();
+}
+
+TunnelStream::~TunnelStream ()
+{
+	if (connect_action_)
+		connect_action_->cancel ();
+	if (read_action_)
+		read_action_->cancel ();
+	if (write_action_)
+		write_action_->cancel ();
+	if (socket_)
+		socket_->close ();
+	delete socket_;
+	if (held_)
+		tunnel_->input_account ()->add (-held_);
+}
+
+Action* TunnelStream::connect (const std::string& name)
+{
+	return (connect_action_ = socket_->connect (name, callback (this, &TunnelStream::connect_complete)));
+}
+
+void TunnelStream::connect_complete (Event e)
+{
+	if (connect_action_)
+		connect_action_->cancel (), connect_action_ = 0;
+
+	if (e.type_ != Event::Done)
+	{
+		INFO(log_) << "Connect failed: " << e;
+		tunnel_->send (TUNNEL_OP_RESET, id_);
+		tunnel_->release (id_);
+		return;
+	}
+
+	connected_ = true;
+	write_pending ();
+	start_reading ();
+}
+
+void TunnelStream::on_read (Event e)
+{
+	if (read_action_)
+		read_action_->cancel (), read_action_ = 0;
+
+	switch (e.type_)
+	{
+	case Event::Done:
+		credit_ -= e.buffer_.length ();
+		if (tunnel_->send (TUNNEL_OP_DATA, id_, &e.buffer_))
+			start_reading ();
+		break;
+	case Event::EOS:
+		sent_close_ = true;
+		tunnel_->send (TUNNEL_OP_CLOSE, id_);
+		if (finished ())
+			tunnel_->release (id_);
+		break;
+	default:
+		DEBUG(log_) << "Unexpected event: " << e;
+		tunnel_->send (TUNNEL_OP_RESET, id_);
+		tunnel_->release (id_);
+		break;
+	}
+}
+
+void TunnelStream::on_write (Event e)
+{
+	if (write_action_)
+		write_action_->cancel (), write_action_ = 0;
+
+	if (e.type_ != Event::Done)
+	{
+		DEBUG(log_) << "Write failed: " << e;
+		tunnel_->send (TUNNEL_OP_RESET, id_);
+		tunnel_->release (id_);
+		return;
+	}
+
+	tunnel_->send (TUNNEL_OP_CREDIT, id_, 0, written_);
+	write_pending ();
+	if (finished ())
+		tunnel_->release (id_);
+}
+
+void TunnelStream::deliver (Buffer& buf)
+{
+	pending_.append (buf);
+	write_pending ();
+}
+
+void TunnelStream::grant (int n)
+{
+	credit_ += n;
+	start_reading ();
+}
+
+void TunnelStream::close ()
+{
+	received_close_ = true;
+	write_pending ();
+}
+
+void TunnelStream::start_reading ()
+{
+	if (connected_ && ! read_action_ && ! sent_close_ && credit_ > 0)
+		read_action_ = socket_->read (callback (this, &TunnelStream::on_read));
+}
+
+void TunnelStream::write_pending ()
+{
+	if (! connected_ || write_action_)
+		return;
+
+	if (! pending_.empty ())
+	{
+		written_ = pending_.length ();
+		write_action_ = socket_->write (pending_, callback (this, &TunnelStream::on_write));
+		pending_.clear ();
+	}
+	else if (received_close_ && ! down_)
+	{
+		down_ = socket_->shutdown (false, true);
+	}
+	weigh ();
+}
+
+// what waits to be written to the endpoint counts against the tunnel input
+void TunnelStream::weigh ()
+{
+	intmax_t now = pending_.length () + (write_action_ ? written_ : 0);
+
+	if (now != held_)
+		tunnel_->input_account ()->add (now - held_), held_ = now;
+}
+
+// Tunnels
+
+ProxyTunnel::ProxyTunnel (const std::string& name,
+          WANProxyCodec* codec,
+			 SocketAddressFamily family,
+			 const std::string& peer_address,
+			 std::list<ProxyTunnel*>* pool)
+ : log_("/wanproxy/" + name + "/tunnel"),
+   codec_(codec),
+   tunnel_socket_(0),
+	is_cln_(true),
+	target_family_(family),
+	input_account_(this),
+	output_chain_(this),
+	input_chain_(this),
+	pool_(pool),
+	next_stream_(1),
+   connect_action_(0),
+   stop_action_(0),
+	read_action_(0),
+	close_action_(0),
+	ready_(false),
+	broken_(false),
+	retiring_(false)
+{
+	budget (name);
+	if ((tunnel_socket_ = Socket::create (family, SocketTypeStream, "tcp", peer_address)))
+		connect_action_ = tunnel_socket_->connect (peer_address, callback (this, &ProxyTunnel::connect_complete));
+	stop_action_ = event_system.register_interest (EventInterestStop, callback (this, &ProxyTunnel::conclude));
+	if (! connect_action_)
+		shutdown ();
+	if (pool_)
+		pool_->push_back (this);
+}
+
+ProxyTunnel::ProxyTunnel (const std::string& name,
+          WANProxyCodec* codec,
+          Socket* tunnel_socket,
+			 SocketAddressFamily family,
+			 const std::string& target_address)
+ : log_("/wanproxy/" + name + "/tunnel"),
+   codec_(codec),
+   tunnel_socket_(tunnel_socket),
+	is_cln_(false),
+	target_family_(family),
+	target_address_(target_address),
+	input_account_(this),
+	output_chain_(this),
+	input_chain_(this),
+	pool_(0),
+	next_stream_(0),
+   connect_action_(0),
+   stop_action_(0),
+	read_action_(0),
+	close_action_(0),
+	ready_(false),
+	broken_(false),
+	retiring_(false)
+{
+	budget (name);
+	stop_action_ = event_system.register_interest (EventInterestStop, callback (this, &ProxyTunnel::conclude));
+	if (build_chains ())
+		read_action_ = tunnel_socket_->read (callback (this, &ProxyTunnel::on_tunnel_data));
+	else
+		shutdown ();
+}
+
+ProxyTunnel::~ProxyTunnel ()
+{
+	input_account_.owner_ = 0;
+	std::map<uint32_t, TunnelStream*>::iterator it;
+	for (it = streams_.begin (); it != streams_.end (); ++it)
+		delete it->second;
+	streams_.clear ();
+
+	if (pool_)
+		pool_->remove (this);
+   if (connect_action_)
+      connect_action_->cancel ();
+   if (stop_action_)
+      stop_action_->cancel ();
+   if (read_action_)
+      read_action_->cancel ();
+	if (close_action_)
+		close_action_->cancel ();
+	if (tunnel_socket_)
+		tunnel_socket_->close ();
+   delete tunnel_socket_;
+}
+
+bool ProxyTunnel::attach (Socket* sck)
+{
+	if (! available () || ! sck)
+		return false;
+
+	uint32_t id = next_stream_++;
+	if (! send (TUNNEL_OP_OPEN, id))
+		return false;
+
+	streams_[id] = new TunnelStream (this, id, sck, true);
+	DEBUG(log_) << "Opened stream " << id << " (" << streams_.size () << " active)";
+	return true;
+}
+
+void ProxyTunnel::retire ()
+{
+	retiring_ = true;
+	if (streams_.empty ())
+		shutdown ();
+}
+
+void ProxyTunnel::connect_complete (Event e)
+{
+	if (connect_action_)
+		connect_action_->cancel (), connect_action_ = 0;
+
+	switch (e.type_)
+	{
+	case Event::Done:
+		break;
+	case Event::Error:
+		INFO(log_) << "Connect failed: " << e;
+		shutdown ();
+		return;
+	default:
+		ERROR(log_) << "Unexpected event: " << e;
+		shutdown ();
+		return;
+	}
+
+	if (! build_chains ())
+	{
+		shutdown ();
+		return;
+	}
+	
+	INFO(log_) << "Tunnel established to: " << tunnel_socket_->getpeername ();
+	read_action_ = tunnel_socket_->read (callback (this, &ProxyTunnel::on_tunnel_data));
+	if (! backlog_.empty ())
+	{
+		Buffer buf = backlog_;
+		backlog_.clear ();
+		if (! output_chain_.consume (buf))
+			shutdown ();
+	}
+}
+
+bool ProxyTunnel::build_chains ()
+{
+	WANProxyCodec* cdc = codec_;
+	EncodeFilter* enc = 0;
+	
+	if (! tunnel_socket_)
+		return false;
+
+	if (cdc && cdc->counting_)
+	{
+		output_chain_.append (new CountFilter (is_cln_ ? cdc->request_input_bytes_ : cdc->response_input_bytes_));
+		input_chain_.append (new CountFilter (is_cln_ ? cdc->response_input_bytes_ : cdc->request_input_bytes_));
+	}
+
+	if (cdc && cdc->xcache_)
+		output_chain_.append ((enc = new EncodeFilter ("/wanproxy/" + cdc->name_ + "/enc", cdc, (is_cln_ ? 0 : 1))));
+
+	if (cdc && cdc->compressor_)
+	{
+		Filter* cmp = cdc->compress_filter ();
+		Filter* dcmp = cdc->decompress_filter ();
+		output_chain_.append (cmp);
+		if (cdc->compressor_dictionary_)
+		{
+			output_chain_.append (new DictionarySendFilter (cdc, cmp, is_cln_));
+			input_chain_.append (new DictionaryReceiveFilter (cdc, dcmp));
+		}
+		input_chain_.append (dcmp);
+	}
+
+	if (cdc && cdc->xcache_)
+	{
+		DecodeFilter* dec;
+		input_chain_.append ((dec = new DecodeFilter ("/wanproxy/" + cdc->name_ + "/dec", cdc)));
+		dec->set_upstream (enc);
+	}
+
+	if (cdc && cdc->counting_)
+	{
+		output_chain_.append (new CountFilter (is_cln_ ? cdc->request_output_bytes_ : cdc->response_output_bytes_));
+		input_chain_.append (new CountFilter (is_cln_ ? cdc->response_output_bytes_ : cdc->request_output_bytes_));
+	}
+
+	output_chain_.append (new SinkFilter ("/wanproxy/tunnel", tunnel_socket_));
+
+	ready_ = true;
+	return true;
+}
+
+/*
+ * Like those of a connector, the chains of a tunnel and what its streams
+ * still have to write are charged to the pool of the proxy, and reading
+ * from the tunnel stops while the pool is over its budget. There is no
+ * limit of its own, which would let one slow stream hold up all others;
+ * their windows bound what each of them may have waiting.
+ */
+
+void ProxyTunnel::budget (const std::string& name)
+{
+	WanProxyTally* tally = wanproxy.tally (name);
+
+	output_account_.join (&tally->memory_);
+	input_account_.join (&tally->memory_);
+	output_chain_.charge (&output_account_);
+	input_chain_.charge (&input_account_);
+}
+
+void ProxyTunnel::resume ()
+{
+	if (ready_ && ! broken_ && ! read_action_)
+		read_action_ = tunnel_socket_->read (callback (this, &ProxyTunnel::on_tunnel_data));
+}
+
+bool ProxyTunnel::send (uint8_t op, uint32_t id, Buffer* data, uint32_t val)
+{
+	if (broken_)
+		return false;
+
+	Buffer frame;
+	uint32_t sid = BigEndian::encode (id);
+
+	if (op == TUNNEL_OP_DATA && data)
+	{
+		while (! data->empty ())
+		{
+			uint16_t len = (data->length () > TUNNEL_MAX_FRAME ? TUNNEL_MAX_FRAME : data->length ());
+			frame.append (op);
+			frame.append (&sid);
+			uint16_t n = BigEndian::encode (len);
+			frame.append (&n);
+			frame.append (*data, len);
+			data->skip (len);
+		}
+	}
+	else
+	{
+		frame.append (op);
+		frame.append (&sid);
+		if (op == TUNNEL_OP_CREDIT)
+		{
+			uint32_t n = BigEndian::encode (val);
+			frame.append (&n);
+		}
+	}
+
+	if (! ready_)
+	{
+		backlog_.append (frame);
+		return true;
+	}
+	if (! output_chain_.consume (frame))
+	{
+		shutdown ();
+		return false;
+	}
+	return true;
+}
+
+void ProxyTunnel::release (uint32_t id)
+{
+	std::map<uint32_t, TunnelStream*>::iterator it = streams_.find (id);
+	if (it != streams_.end ())
+	{
+		delete it->second;
+		streams_.erase (it);
+		DEBUG(log_) << "Closed stream " << id << " (" << streams_.size () << " active)";
+	}
+	if (retiring_ && streams_.empty ())
+		shutdown ();
+}
+
+bool ProxyTunnel::consume (Buffer& buf, int flg)
+{
+	pending_.append (buf);
+
+	while (! pending_.empty ())
+	{
+		uint8_t op;
+		uint32_t id, val = 0;
+		uint16_t len = 0;
+		Buffer data;
+
+		if (pending_.length () < sizeof op + sizeof id)
+			return true;
+		pending_.extract (&id, sizeof op);
+		id = BigEndian::decode (id);
+		op = pending_.peek ();
+
+		switch (op)
+		{
+		case TUNNEL_OP_DATA:
+			if (pending_.length () < sizeof op + sizeof id + sizeof len)
+				return true;
+			pending_.extract (&len, sizeof op + sizeof id);
+			len = BigEndian::decode (len);
+			if (pending_.length () < sizeof op + sizeof id + sizeof len + len)
+				return true;
+			pending_.moveout (&data, sizeof op + sizeof id + sizeof len, len);
+			break;
+		case TUNNEL_OP_CREDIT:
+			if (pending_.length () < sizeof op + sizeof id + sizeof val)
+				return true;
+			pending_.extract (&val, sizeof op + sizeof id);
+			val = BigEndian::decode (val);
+			pending_.skip (sizeof op + sizeof id + sizeof val);
+			break;
+		case TUNNEL_OP_OPEN:
+		case TUNNEL_OP_CLOSE:
+		case TUNNEL_OP_RESET:
+			pending_.skip (sizeof op + sizeof id);
+			break;
+		default:
+			ERROR(log_) << "Unsupported operation in tunnel stream.";
+			return false;
+		}
+
+		if (! dispatch (op, id, data, val))
+			return false;
+	}
+
+	return true;
+}
+
+bool ProxyTunnel::dispatch (uint8_t op, uint32_t id, Buffer& data, uint32_t val)
+{
+	std::map<uint32_t, TunnelStream*>::iterator it = streams_.find (id);
+	TunnelStream* stream = (it != streams_.end () ? it->second : 0);
+
+	switch (op)
+	{
+	case TUNNEL_OP_OPEN:
+		if (is_cln_ || stream)
+		{
+			ERROR(log_) << "Unexpected <OPEN> for stream " << id;
+			return false;
+		}
+		else
+		{
+			Socket* sck = Socket::create (target_family_, SocketTypeStream, "tcp", target_address_);
+			if (sck)
+			{
+				streams_[id] = (stream = new TunnelStream (this, id, sck, false));
+				if (stream->connect (target_address_))
+					break;
+				streams_.erase (id), delete stream;
+			}
+			send (TUNNEL_OP_RESET, id);
+		}
+		break;
+	case TUNNEL_OP_DATA:
+		if (stream)
+			stream->deliver (data);
+		break;
+	case TUNNEL_OP_CREDIT:
+		if (stream)
+			stream->grant (val);
+		break;
+	case TUNNEL_OP_CLOSE:
+		if (stream)
+		{
+			stream->close ();
+			if (stream->finished ())
+				release (id);
+		}
+		break;
+	case TUNNEL_OP_RESET:
+		if (stream)
+			release (id);
+		break;
+	}
+
+	return true;
+}
+
+void ProxyTunnel::on_tunnel_data (Event e)
+{
+	if (read_action_)
+		read_action_->cancel (), read_action_ = 0;
+	if (broken_)
+		return;
+
+	switch (e.type_)
+	{
+	case Event::Done:
+		if (! input_chain_.consume (e.buffer_))
+			shutdown ();
+		else if (! read_action_ && ! input_account_.pause ())
+			read_action_ = tunnel_socket_->read (callback (this, &ProxyTunnel::on_tunnel_data));
+		break;
+	case Event::EOS:
+		DEBUG(log_) << "Tunnel closed by peer";
+		shutdown ();
+		break;
+	default:
+		DEBUG(log_) << "Unexpected event: " << e;
+		shutdown ();
+		break;
+	}
+}
+
+void ProxyTunnel::flush (int flg)
+{
+	shutdown ();
+}
+
+void ProxyTunnel::shutdown ()
+{
+	broken_ = true;
+	if (! close_action_)
+		close_action_ = event_system.track (0, StreamModeWait, callback (this, &ProxyTunnel::conclude));
+}
+
+void ProxyTunnel::conclude (Event e)
+{
+	if (! streams_.empty ())
+		INFO(log_) << "Tunnel closed with " << streams_.size () << " active streams";
+   delete this;
+}
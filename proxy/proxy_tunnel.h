@@ -0,0 +1,124 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// File:           proxy_tunnel.h                                             //
+// Description:    persistent encoded connection multiplexing client streams  //
+// Project:        WANProxy XTech                                             //
+// Author:         Andreu Vidal Bramfeld-Software                             //
+// Last modified:  2026-10-19                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef	PROGRAMS_WANPROXY_PROXY_TUNNEL_H
+#define	PROGRAMS_WANPROXY_PROXY_TUNNEL_H
+
+#include <map>
+#include <list>
+#include <common/filter.h>
+#include <event/action.h>
+#include <event/event.h>
+#include <io/socket/socket_types.h>
+#include "wanproxy_codec.h"
+
+#define TUNNEL_STREAM_WINDOW		(256 * 1024)
+#define TUNNEL_MAX_FRAME			(16384)
+
+class ProxyTunnel;
+
+class TunnelStream
+{
+	LogHandle log_;
+	ProxyTunnel* tunnel_;
+	uint32_t id_;
+	Socket* socket_;
+	Buffer pending_;
+	Action* connect_action_;
+	Action* read_action_;
+	Action* write_action_;
+	int written_;
+	int credit_;
+	intmax_t held_;
+	bool connected_, sent_close_, received_close_, down_;
+
+public:
+	TunnelStream (ProxyTunnel* tnl, uint32_t id, Socket* sck, bool connected);
+	~TunnelStream ();
+
+	Action* connect (const std::string& name);
+	void connect_complete (Event e);
+	void on_read (Event e);
+	void on_write (Event e);
+
+	void deliver (Buffer& buf);
+	void grant (int n);
+	void close ();
+	bool finished () const   { return (sent_close_ && received_close_ && ! write_action_ && pending_.empty ()); }
+
+private:
+	void start_reading ();
+	void write_pending ();
+	void weigh ();
+};
+
+class ProxyTunnel : public Filter
+{
+	class TunnelAccount : public MemoryAccount
+	{
+	public:
+		ProxyTunnel* owner_;
+		
+		TunnelAccount (ProxyTunnel* owner) : owner_(owner)   { }
+		virtual void relieved ()   { if (owner_) owner_->resume (); }
+	};
+	
+	LogHandle log_;
+	WANProxyCodec* codec_;
+	Socket* tunnel_socket_;
+	bool is_cln_;
+	SocketAddressFamily target_family_;
+	std::string target_address_;
+	MemoryAccount output_account_;
+	TunnelAccount input_account_;
+	FilterChain output_chain_;
+	FilterChain input_chain_;
+	std::map<uint32_t, TunnelStream*> streams_;
+	std::list<ProxyTunnel*>* pool_;
+	uint32_t next_stream_;
+	Buffer pending_;
+	Buffer backlog_;
+	Action* connect_action_;
+	Action* stop_action_;
+	Action* read_action_;
+	Action* close_action_;
+	bool ready_, broken_, retiring_;
+
+public:
+	ProxyTunnel (const std::string&, WANProxyCodec*, SocketAddressFamily, const std::string&, std::list<ProxyTunnel*>* pool);
+	ProxyTunnel (const std::string&, WANProxyCodec*, Socket*, SocketAddressFamily, const std::string&);
+	virtual ~ProxyTunnel ();
+
+	bool attach (Socket* sck);
+	void retire ();
+	void detach ()   { pool_ = 0; }
+	size_t stream_count () const   { return streams_.size (); }
+	bool available () const   { return (! broken_ && ! retiring_); }
+	MemoryAccount* input_account ()   { return &input_account_; }
+
+	bool send (uint8_t op, uint32_t id, Buffer* data = 0, uint32_t val = 0);
+	void release (uint32_t id);
+
+	virtual bool consume (Buffer& buf, int flg = 0);
+	virtual void flush (int flg);
+
+	void connect_complete (Event e);
+	void on_tunnel_data (Event e);
+	void conclude (Event e);
+
+private:
+	bool build_chains ();
+	void budget (const std::string& name);
+	void resume ();
+	bool dispatch (uint8_t op, uint32_t id, Buffer& data, uint32_t val);
+	void shutdown ();
+};
+
+#endif /* !PROGRAMS_WANPROXY_PROXY_TUNNEL_H */
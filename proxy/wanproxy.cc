@@ -27,6 +27,7 @@
 #include <common/log.h>
 #include <event/event_system.h>
 #include "wanproxy.h"
+#include "proxy_replay.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 //                                                                            //
@@ -47,18 +48,19 @@ static void usage(void);
 
 int main (int argc, char *argv[])
 {
-	std::string configfile;
-	bool quiet, verbose;
+	std::string configfile, statsaddress, replayfile;
+	ProxyReplay replay;
+	bool quiet, verbose, paced;
 	int ch;
 
-	quiet = verbose = false;
+	quiet = verbose = paced = false;
 
 	INFO("/wanproxy") << "WANProxy MT " << PROGRAM_VERSION;
 	INFO("/wanproxy") << "Copyright (c) 2008-2013 WANProxy.org";
 	INFO("/wanproxy") << "Copyright (c) 2013-2018 Bramfeld-Software";
 	INFO("/wanproxy") << "All rights reserved.";
 
-	while ((ch = getopt(argc, argv, "c:qv")) != -1) 
+	while ((ch = getopt(argc, argv, "c:qr:R:s:v")) != -1) 
 	{
 		switch (ch) 
 		{
@@ -68,6 +70,15 @@ int main (int argc, char *argv[])
 		case 'q':
 			quiet = true;
 			break;
+		case 'R':
+			paced = true;
+			// fall through
+		case 'r':
+			replayfile = optarg;
+			break;
+		case 's':
+			statsaddress = optarg;
+			break;
 		case 'v':
 			verbose = true;
 			break;
@@ -89,6 +100,9 @@ int main (int argc, char *argv[])
 	else
 		Log::mask (".?", Log::Info);
 
+	if (! replayfile.empty ())
+		wanproxy.replaying ();
+
 	if (! wanproxy.configure (configfile)) 
 	{
 		ERROR("/wanproxy") << "Could not configure proxies.";
@@ -96,8 +110,23 @@ int main (int argc, char *argv[])
 		return 1;
 	}
 	
+	if (! statsaddress.empty () && ! wanproxy.monitor (statsaddress))
+	{
+		ERROR("/wanproxy") << "Could not serve statistics on: " << statsaddress;
+		wanproxy.terminate ();
+		return 1;
+	}
+	
+	if (! replayfile.empty () && ! replay.start (replayfile, paced))
+	{
+		ERROR("/wanproxy") << "Could not replay capture: " << replayfile;
+		wanproxy.terminate ();
+		return 1;
+	}
+	
 	event_system.run ();
 	
+	replay.close ();
 	wanproxy.terminate ();
 	
 	return 0;
@@ -105,7 +134,7 @@ int main (int argc, char *argv[])
 
 static void usage(void)
 {
-	INFO("/wanproxy/usage") << "wanproxy [-q | -v] -c configfile";
+	INFO("/wanproxy/usage") << "wanproxy [-q | -v] [-s statsaddress] [-r | -R capturefile] -c configfile";
 	exit(1);
 }
 
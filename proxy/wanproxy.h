@@ -11,21 +11,33 @@
 #ifndef	PROGRAMS_WANPROXY_WANPROXY_CORE_H
 #define	PROGRAMS_WANPROXY_WANPROXY_CORE_H
 
+#include <sstream>
 #include <event/event_system.h>
 #include <common/uuid/uuid.h>
+#include <common/filter_stage.h>
 #include <xcodec/xcodec.h>
 #include <xcodec/xcodec_cache.h>
+#include <xcodec/xcodec_coordinator.h>
 #include <xcodec/cache/coss/xcodec_cache_coss.h>
 #include "wanproxy_codec.h"
 #include "wanproxy_config.h"
 #include "wanproxy_config_type_codec.h"
 #include "proxy_listener.h"
+#include "proxy_monitor.h"
 
 struct WanProxyInstance
 {
 	std::string proxy_name_;
 	bool proxy_client_;
 	bool proxy_secure_;
+	int proxy_tunnels_;
+	int proxy_stripes_;
+	int proxy_pool_;
+	int proxy_listeners_;
+	int proxy_backlog_;
+	std::string proxy_capture_;
+	intmax_t proxy_memory_limit_;
+	intmax_t proxy_memory_budget_;
 	SocketAddressFamily local_protocol_;
 	std::string local_address_;
 	WANProxyCodec local_codec_;
@@ -37,6 +49,10 @@ struct WanProxyInstance
 	WanProxyInstance ()
 	{
 		proxy_client_ = proxy_secure_ = false; 
+		proxy_tunnels_ = proxy_stripes_ = proxy_pool_ = 0;
+		proxy_listeners_ = 1;
+		proxy_backlog_ = SOCKET_LISTEN_BACKLOG;
+		proxy_memory_limit_ = proxy_memory_budget_ = 0;
 		local_protocol_ = remote_protocol_ = SocketAddressFamilyIP;
 		listener_ = 0;
 	}
@@ -47,18 +63,37 @@ struct WanProxyInstance
 	}
 };
 
+// kept apart from the instances, which a reload replaces
+struct WanProxyTally
+{
+	intmax_t active_;
+	intmax_t total_;
+	intmax_t rejected_;
+	MemoryAccount memory_;
+	
+	WanProxyTally () : active_(0), total_(0), rejected_(0)   { }
+};
+
 struct WanProxyCore
 {
 private:
 	std::string config_file_;
 	Action* reload_action_;
+	Action* dump_action_;
 	std::map<UUID, XCodecCache*> caches_;
+	std::map<UUID, XCodecLearnCoordinator*> coordinators_;
 	std::map<std::string, WanProxyInstance> proxies_;
+	std::map<std::string, WanProxyTally> tallies_;
+	ProxyMonitor* monitor_;
+	bool replaying_;
 
 public:
 	WanProxyCore ()
 	{
 		reload_action_ = 0;
+		dump_action_ = 0;
+		monitor_ = 0;
+		replaying_ = false;
 	}
 	
 	bool configure (const std::string& file)
@@ -68,6 +103,8 @@ public:
 		if (reload_action_)
 			reload_action_->cancel ();
 		reload_action_ = event_system.register_interest (EventInterestReload, callback (this, &WanProxyCore::reload));
+		if (! dump_action_)
+			dump_action_ = event_system.register_interest (EventInterestDump, callback (this, &WanProxyCore::dump));
 		return config.read_file (config_file_); 
 	}
 	
@@ -79,6 +116,26 @@ public:
 			INFO("wanproxy/core") << "Could not reconfigure proxies.";
 	}	
 	
+	void dump ()
+	{
+		if (dump_action_)
+			dump_action_->cancel ();
+		dump_action_ = event_system.register_interest (EventInterestDump, callback (this, &WanProxyCore::dump));
+		
+		// far more lines than the log queue holds, so they wait for room
+		std::istringstream is (recordings ());
+		std::string line;
+		while (std::getline (is, line))
+			Log::log (Log::Info, "wanproxy/recorder", line, true);
+	}
+	
+	std::string recordings ()
+	{
+		std::ostringstream os;
+		FlightRecorder::dump_all (os);
+		return os.str ();
+	}
+	
 	void add_proxy (std::string& name, WanProxyInstance& data)
 	{
 	   WanProxyInstance& prx = proxies_[name];
@@ -86,21 +143,36 @@ public:
 	   prx.proxy_name_ = data.proxy_name_;
 	   prx.proxy_client_ = data.proxy_client_;
 	   prx.proxy_secure_ = data.proxy_secure_;
+	   prx.proxy_tunnels_ = data.proxy_tunnels_;
+	   prx.proxy_stripes_ = data.proxy_stripes_;
+	   prx.proxy_pool_ = data.proxy_pool_;
+	   prx.proxy_listeners_ = data.proxy_listeners_;
+	   prx.proxy_backlog_ = data.proxy_backlog_;
+	   prx.proxy_capture_ = data.proxy_capture_;
+	   prx.proxy_memory_limit_ = data.proxy_memory_limit_;
+	   prx.proxy_memory_budget_ = data.proxy_memory_budget_;
 	   prx.local_protocol_ = data.local_protocol_;
 	   prx.local_address_ = data.local_address_;
 	   prx.local_codec_ = data.local_codec_;
 	   prx.remote_protocol_ = data.remote_protocol_;
 	   prx.remote_address_ = data.remote_address_;
 	   prx.remote_codec_ = data.remote_codec_;
+	   tally (name)->memory_.limit (prx.proxy_memory_budget_);
 	   
+	   if (replaying_)
+			return;
 	   if (! prx.listener_)
 			prx.listener_ = new ProxyListener (prx.proxy_name_, &prx.local_codec_, &prx.remote_codec_, 
 														  prx.local_protocol_, prx.local_address_, prx.remote_protocol_, prx.remote_address_,
-														  prx.proxy_client_, prx.proxy_secure_);
+														  prx.proxy_client_, prx.proxy_secure_, 
+														  prx.proxy_tunnels_, prx.proxy_stripes_, prx.proxy_pool_,
+														  prx.proxy_listeners_, prx.proxy_backlog_);
 	   else
 			prx.listener_->refresh (prx.proxy_name_, &prx.local_codec_, &prx.remote_codec_, 
 											prx.local_protocol_, prx.local_address_, prx.remote_protocol_, prx.remote_address_, 
-											prx.proxy_client_, prx.proxy_secure_);
+											prx.proxy_client_, prx.proxy_secure_, 
+											prx.proxy_tunnels_, prx.proxy_stripes_, prx.proxy_pool_,
+											prx.proxy_listeners_, prx.proxy_backlog_);
 	}
 	
 	XCodecCache* add_cache (WANProxyConfigCache type, std::string& path, size_t size, UUID& uuid)
@@ -129,10 +201,60 @@ public:
 		return 0;
 	}
 
+	XCodecLearnCoordinator* find_coordinator (UUID uuid)
+	{
+		XCodecLearnCoordinator*& crd = coordinators_[uuid];
+		if (! crd)
+			crd = new XCodecLearnCoordinator ();
+		return crd;
+	}
+
+	WanProxyTally* tally (const std::string& name)
+	{
+		return &tallies_[name];
+	}
+
+	WanProxyInstance* find_proxy (const std::string& name)
+	{
+		std::map<std::string, WanProxyInstance>::iterator it = proxies_.find (name);
+		if (it != proxies_.end ())
+			return &it->second;
+		return 0;
+	}
+
+	// proxies are only set up to be fed from a capture, not to listen
+	void replaying ()
+	{
+		replaying_ = true;
+	}
+
+	std::string capture (const std::string& name)
+	{
+		WanProxyInstance* prx = find_proxy (name);
+		return (prx && ! replaying_ ? prx->proxy_capture_ : std::string ());
+	}
+
+	intmax_t memory_limit (const std::string& name)
+	{
+		WanProxyInstance* prx = find_proxy (name);
+		return (prx && ! replaying_ ? prx->proxy_memory_limit_ : 0);
+	}
+
+	bool monitor (const std::string& address)
+	{
+		delete monitor_;
+		monitor_ = new ProxyMonitor ();
+		return monitor_->listen (address);
+	}
+
 	void terminate ()
 	{
 		if (reload_action_)
 			reload_action_->cancel (), reload_action_ = 0;
+		if (dump_action_)
+			dump_action_->cancel (), dump_action_ = 0;
+		delete monitor_;
+		monitor_ = 0;
 			
 		std::map<std::string, WanProxyInstance>::iterator prx;
 		for (prx = proxies_.begin(); prx != proxies_.end(); prx++)
@@ -143,6 +265,11 @@ public:
 		for (it = caches_.begin(); it != caches_.end(); it++)
 			delete it->second;
 		caches_.clear ();
+		   
+		std::map<UUID, XCodecLearnCoordinator*>::iterator crd;
+		for (crd = coordinators_.begin(); crd != coordinators_.end(); crd++)
+			delete crd->second;
+		coordinators_.clear ();
 	}
 	
 	void print_stream_counts (WanProxyInstance& prx)
@@ -166,6 +293,82 @@ public:
 			INFO("wanproxy/core") << "Remote codec response output bytes: " << prx.remote_codec_.response_output_bytes_;
 		}
 	}
+
+	void report (std::ostream& os)
+	{
+		std::map<std::string, WanProxyTally>::iterator tly;
+		for (tly = tallies_.begin(); tly != tallies_.end(); tly++)
+		{
+			os << "wanproxy_connections_active{proxy=\"" << tly->first << "\"} " << tly->second.active_ << "\n";
+			os << "wanproxy_connections_total{proxy=\"" << tly->first << "\"} " << tly->second.total_ << "\n";
+			os << "wanproxy_connections_rejected_total{proxy=\"" << tly->first << "\"} " << tly->second.rejected_ << "\n";
+			os << "wanproxy_memory_bytes{proxy=\"" << tly->first << "\"} " << tly->second.memory_.held () << "\n";
+		}
+		os << "wanproxy_memory_total_bytes " << MemoryAccount::total () << "\n";
+		os << "wanproxy_memory_peak_bytes " << MemoryAccount::peak () << "\n";
+		
+		std::map<std::string, WanProxyInstance>::iterator prx;
+		for (prx = proxies_.begin(); prx != proxies_.end(); prx++)
+		{
+			report_stream_counts (os, prx->first, "local", prx->second.local_codec_);
+			report_stream_counts (os, prx->first, "remote", prx->second.remote_codec_);
+		}
+		
+		std::map<UUID, XCodecCache*>::iterator it;
+		for (it = caches_.begin(); it != caches_.end(); it++)
+		{
+			XCodecCacheStatistics stats;
+			it->second->statistics (stats);
+			XCodecCacheStatistics::iterator st;
+			for (st = stats.begin(); st != stats.end(); st++)
+				os << "wanproxy_cache_" << st->first << "{cache=\"" << it->first << "\"} " << st->second << "\n";
+		}
+		
+		std::map<std::string, FilterStage*>::const_iterator stg;
+		for (stg = FilterStage::stages ().begin(); stg != FilterStage::stages ().end(); stg++)
+			report_filter_stage (os, *stg->second);
+	}
+	
+	void report_filter_stage (std::ostream& os, const FilterStage& stg)
+	{
+		uintmax_t n = 0;
+		int i;
+		
+		for (i = 0; i < FILTER_STAGE_TIME_BUCKETS; ++i)
+		{
+			os << "wanproxy_filter_microseconds_bucket{filter=\"" << stg.name () << "\",le=\"";
+			if (i < FILTER_STAGE_TIME_BUCKETS - 1)
+				os << FilterStage::time_limit (i);
+			else
+				os << "+Inf";
+			os << "\"} " << (n += stg.time_bucket (i)) << "\n";
+		}
+		os << "wanproxy_filter_microseconds_sum{filter=\"" << stg.name () << "\"} " << stg.time () << "\n";
+		os << "wanproxy_filter_microseconds_count{filter=\"" << stg.name () << "\"} " << stg.calls () << "\n";
+		
+		for (n = 0, i = 0; i < FILTER_STAGE_SIZE_BUCKETS; ++i)
+		{
+			os << "wanproxy_filter_bytes_bucket{filter=\"" << stg.name () << "\",le=\"";
+			if (i < FILTER_STAGE_SIZE_BUCKETS - 1)
+				os << FilterStage::size_limit (i);
+			else
+				os << "+Inf";
+			os << "\"} " << (n += stg.size_bucket (i)) << "\n";
+		}
+		os << "wanproxy_filter_bytes_sum{filter=\"" << stg.name () << "\"} " << stg.bytes () << "\n";
+		os << "wanproxy_filter_bytes_count{filter=\"" << stg.name () << "\"} " << stg.calls () << "\n";
+	}
+	
+	void report_stream_counts (std::ostream& os, const std::string& name, const char* side, WANProxyCodec& cdc)
+	{
+		if (! cdc.counting_)
+			return;
+		
+		os << "wanproxy_bytes{proxy=\"" << name << "\",codec=\"" << side << "\",stream=\"request\",stage=\"input\"} " << cdc.request_input_bytes_ << "\n";
+		os << "wanproxy_bytes{proxy=\"" << name << "\",codec=\"" << side << "\",stream=\"request\",stage=\"output\"} " << cdc.request_output_bytes_ << "\n";
+		os << "wanproxy_bytes{proxy=\"" << name << "\",codec=\"" << side << "\",stream=\"response\",stage=\"input\"} " << cdc.response_input_bytes_ << "\n";
+		os << "wanproxy_bytes{proxy=\"" << name << "\",codec=\"" << side << "\",stream=\"response\",stage=\"output\"} " << cdc.response_output_bytes_ << "\n";
+	}
 };
 
 extern WanProxyCore wanproxy;	
@@ -0,0 +1,118 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// File:           wanproxy_codec.cc                                          //
+// Description:    compression filters selected by each codec                 //
+// Project:        WANProxy XTech                                             //
+// Author:         Andreu Vidal Bramfeld-Software                             //
+// Last modified:  2026-10-19                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <zlib/zlib_filter.h>
+#include <zlib/deflate_pool.h>
+#if !defined(NO_ZSTD)
+#include <zstd/zstd_filter.h>
+#endif
+#if !defined(NO_LZ4)
+#include <lz4/lz4_filter.h>
+#endif
+#include <xcodec/xcodec.h>
+#include <xcodec/xcodec_encoder.h>
+#include "wanproxy_codec.h"
+
+Filter* WANProxyCodec::compress_filter () const
+{
+	switch (compressor_)
+	{
+#if !defined(NO_ZSTD)
+	case WANProxyConfigCompressorZstd:
+		return new ZstdCompressFilter (compressor_level_, compressor_long_);
+#endif
+#if !defined(NO_LZ4)
+	case WANProxyConfigCompressorLZ4:
+		return new LZ4CompressFilter (compressor_level_);
+#endif
+	default:
+		if (compressor_threads_ > 0)
+			return new ParallelDeflateFilter (compressor_level_, compressor_threads_, compressor_threshold_);
+		return new DeflateFilter (compressor_level_);
+	}
+}
+
+Filter* WANProxyCodec::decompress_filter () const
+{
+	switch (compressor_)
+	{
+#if !defined(NO_ZSTD)
+	case WANProxyConfigCompressorZstd:
+		return new ZstdDecompressFilter ();
+#endif
+#if !defined(NO_LZ4)
+	case WANProxyConfigCompressorLZ4:
+		return new LZ4DecompressFilter ();
+#endif
+	default:
+		return new InflateFilter ();
+	}
+}
+
+bool WANProxyCodec::prime_compressor (Filter* f, const Buffer& dict) const
+{
+	switch (compressor_)
+	{
+	case WANProxyConfigCompressorZlib:
+		return ((DeflateFilter*) f)->prime (dict);
+#if !defined(NO_ZSTD)
+	case WANProxyConfigCompressorZstd:
+		return ((ZstdCompressFilter*) f)->prime (dict);
+#endif
+	default:
+		return false;
+	}
+}
+
+bool WANProxyCodec::prime_decompressor (Filter* f, const Buffer& dict) const
+{
+	switch (compressor_)
+	{
+	case WANProxyConfigCompressorZlib:
+		return ((InflateFilter*) f)->prime (dict);
+#if !defined(NO_ZSTD)
+	case WANProxyConfigCompressorZstd:
+		return ((ZstdDecompressFilter*) f)->prime (dict);
+#endif
+	default:
+		return false;
+	}
+}
+
+/*
+ * Segments sent in a stream the peer has acknowledged are known to be in
+ * its cache, the most recent ones serving as dictionary for new streams.
+ */
+void WANProxyCodec::confirm (const std::deque<uint64_t>& hashes)
+{
+	for (std::deque<uint64_t>::const_iterator it = hashes.begin (); it != hashes.end (); ++it)
+	{
+		for (std::deque<uint64_t>::iterator d = dictionary_.begin (); d != dictionary_.end (); ++d)
+			if (*d == *it)
+			{
+				dictionary_.erase (d);
+				break;
+			}
+		dictionary_.push_back (*it);
+	}
+	
+	while (dictionary_.size () > XCODEC_ENCODER_RECENT)
+		dictionary_.pop_front ();
+}
+
+/*
+ * Round trips to the peer, in microseconds, taken from the connections
+ * as they are set up and smoothed like TCP does.
+ */
+void WANProxyCodec::measure (unsigned rtt)
+{
+	if (rtt > 0)
+		round_trip_ = (round_trip_ > 0 ? (round_trip_ * 7 + rtt) / 8 : rtt);
+}
@@ -26,8 +26,10 @@
 #ifndef	PROGRAMS_WANPROXY_WANPROXY_CODEC_H
 #define	PROGRAMS_WANPROXY_WANPROXY_CODEC_H
 
+#include <deque>
 #include "wanproxy_config_type_codec.h"
 #include "wanproxy_config_type_compressor.h"
+#include <common/filter.h>
 #include <xcodec/xcodec_cache.h>
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -44,11 +46,20 @@ struct WANProxyCodec {
 	std::string name_;
 	WANProxyConfigCache cache_type_;
 	std::string cache_path_;
+	std::string cache_trace_;
 	size_t cache_size_;
 	UUID cache_uuid_;
 	XCodecCache* xcache_;
-	bool compressor_;
+	WANProxyConfigCompressor compressor_;
 	char compressor_level_;
+	bool compressor_long_;
+	bool compressor_dictionary_;
+	int compressor_threads_;
+	size_t compressor_threshold_;
+	intmax_t flush_wait_;
+	bool interactive_;
+	intmax_t round_trip_;
+	std::deque<uint64_t> dictionary_;
    bool counting_;
 	intmax_t request_input_bytes_;
 	intmax_t request_output_bytes_;
@@ -60,14 +71,28 @@ struct WANProxyCodec {
 	  cache_type_(WANProxyConfigCacheMemory),
 	  cache_size_(0),
 	  xcache_(NULL),
-	  compressor_(false),
+	  compressor_(WANProxyConfigCompressorNone),
 	  compressor_level_(0),
+	  compressor_long_(false),
+	  compressor_dictionary_(false),
+	  compressor_threads_(0),
+	  compressor_threshold_(0),
+	  flush_wait_(150),
+	  interactive_(false),
+	  round_trip_(0),
      counting_(false),
 	  request_input_bytes_(0),
 	  request_output_bytes_(0),
 	  response_input_bytes_(0),
 	  response_output_bytes_(0)
 	{ }
+
+	Filter* compress_filter () const;
+	Filter* decompress_filter () const;
+	bool prime_compressor (Filter* f, const Buffer& dict) const;
+	bool prime_decompressor (Filter* f, const Buffer& dict) const;
+	void confirm (const std::deque<uint64_t>& hashes);
+	void measure (unsigned rtt);
 };
 
 #endif /* !PROGRAMS_WANPROXY_WANPROXY_CODEC_H */
@@ -75,11 +75,17 @@ WANProxyConfigClassCodec::Instance::activate(const ConfigObject *co)
 
 		codec_.cache_type_ = cache_type_;
 		codec_.cache_path_ = cache_path_;
+		codec_.cache_trace_ = cache_trace_;
 		codec_.cache_size_ = local_size_;
 		codec_.cache_uuid_ = uuid;
 
 		if (! (cache = wanproxy.find_cache (uuid)))
 			cache = wanproxy.add_cache (cache_type_, cache_path_, local_size_, uuid);
+		if (cache && ! cache_trace_.empty () && ! cache->trace (cache_trace_))
+		{
+			ERROR("/wanproxy/config/codec") << "Could not write cache trace in " << cache_trace_;
+			return (false);
+		}
 		codec_.xcache_ = cache;
 		break;
 	case WANProxyConfigCodecNone:
@@ -102,16 +108,46 @@ WANProxyConfigClassCodec::Instance::activate(const ConfigObject *co)
 			return (false);
 		}
 
-		codec_.compressor_ = true;
+		codec_.compressor_ = compressor_;
+		codec_.compressor_level_ = (char) compressor_level_;
+		break;
+#if defined(NO_ZSTD)
+	case WANProxyConfigCompressorZstd:
+		ERROR("/wanproxy/config/codec") << "This build has no zstd support.";
+		return (false);
+#else
+	case WANProxyConfigCompressorZstd:
+		if (compressor_level_ < 0 || compressor_level_ > 19) {
+			ERROR("/wanproxy/config/codec") << "Compressor level must be in range 0..19 (inclusive.)";
+			return (false);
+		}
+
+		codec_.compressor_ = compressor_;
 		codec_.compressor_level_ = (char) compressor_level_;
 		break;
+#endif
+#if defined(NO_LZ4)
+	case WANProxyConfigCompressorLZ4:
+		ERROR("/wanproxy/config/codec") << "This build has no LZ4 support.";
+		return (false);
+#else
+	case WANProxyConfigCompressorLZ4:
+		if (compressor_level_ < 0 || compressor_level_ > 12) {
+			ERROR("/wanproxy/config/codec") << "Compressor level must be in range 0..12 (inclusive.)";
+			return (false);
+		}
+
+		codec_.compressor_ = compressor_;
+		codec_.compressor_level_ = (char) compressor_level_;
+		break;
+#endif
 	case WANProxyConfigCompressorNone:
 		if (compressor_level_ > 0) {
 			ERROR("/wanproxy/config/codec") << "Compressor level set but no compressor.";
 			return (false);
 		}
 
-		codec_.compressor_ = false;
+		codec_.compressor_ = WANProxyConfigCompressorNone;
 		codec_.compressor_level_ = 0;
 		break;
 	default:
@@ -119,6 +155,49 @@ WANProxyConfigClassCodec::Instance::activate(const ConfigObject *co)
 		return (false);
 	}
 
+	if (compressor_long_ != 0 && compressor_ != WANProxyConfigCompressorZstd) {
+		ERROR("/wanproxy/config/codec") << "Long distance matching is only available with zstd.";
+		return (false);
+	}
+	codec_.compressor_long_ = (compressor_long_ != 0);
+
+	if (compressor_dictionary_ != 0 && compressor_ != WANProxyConfigCompressorZlib && compressor_ != WANProxyConfigCompressorZstd) {
+		ERROR("/wanproxy/config/codec") << "Compression dictionary is only available with zlib or zstd.";
+		return (false);
+	}
+	if (compressor_dictionary_ != 0 && codec_type_ != WANProxyConfigCodecXCodec) {
+		ERROR("/wanproxy/config/codec") << "Compression dictionary requires XCodec.";
+		return (false);
+	}
+	codec_.compressor_dictionary_ = (compressor_dictionary_ != 0);
+
+	if (compressor_threads_ < 0 || compressor_threads_ > 64) {
+		ERROR("/wanproxy/config/codec") << "Compressor threads must be in range 0..64 (inclusive.)";
+		return (false);
+	}
+	if (compressor_threads_ != 0 && compressor_ != WANProxyConfigCompressorZlib) {
+		ERROR("/wanproxy/config/codec") << "Parallel compression is only available with zlib.";
+		return (false);
+	}
+	if (compressor_threshold_ < 0) {
+		ERROR("/wanproxy/config/codec") << "Compressor threshold must not be negative.";
+		return (false);
+	}
+	codec_.compressor_threads_ = (int) compressor_threads_;
+	codec_.compressor_threshold_ = (size_t) compressor_threshold_ << 10;
+
+	if (flush_wait_ < 0 || flush_wait_ > 10000) {
+		ERROR("/wanproxy/config/codec") << "Flush wait must be in range 0..10000 (inclusive.)";
+		return (false);
+	}
+	codec_.flush_wait_ = flush_wait_;
+
+	if (interactive_ != 0 && codec_type_ != WANProxyConfigCodecXCodec) {
+		ERROR("/wanproxy/config/codec") << "Interactive passthrough requires XCodec.";
+		return (false);
+	}
+	codec_.interactive_ = (interactive_ != 0);
+
    codec_.counting_ = (byte_counts_ != 0);
 
 	return (true);
@@ -51,9 +51,16 @@ public:
 		WANProxyConfigCodec codec_type_;
 		WANProxyConfigCompressor compressor_;
 		intmax_t compressor_level_;
+		intmax_t compressor_long_;
+		intmax_t compressor_dictionary_;
+		intmax_t compressor_threads_;
+		intmax_t compressor_threshold_;
+		intmax_t flush_wait_;
+		intmax_t interactive_;
 		intmax_t byte_counts_;
 		WANProxyConfigCache cache_type_;
 		std::string cache_path_;
+		std::string cache_trace_;
 		intmax_t local_size_;
 		intmax_t remote_size_;
 
@@ -61,6 +68,12 @@ public:
 		: codec_type_(WANProxyConfigCodecNone),
 		  compressor_(WANProxyConfigCompressorNone),
 		  compressor_level_(0),
+		  compressor_long_(0),
+		  compressor_dictionary_(0),
+		  compressor_threads_(0),
+		  compressor_threshold_(4096),
+		  flush_wait_(150),
+		  interactive_(0),
 		  byte_counts_(0),
 		  cache_type_(WANProxyConfigCacheMemory),
 		  local_size_(0),
@@ -77,10 +90,17 @@ public:
 		add_member("codec", &wanproxy_config_type_codec, &Instance::codec_type_);
 		add_member("compressor", &wanproxy_config_type_compressor, &Instance::compressor_);
 		add_member("compressor_level", &config_type_int, &Instance::compressor_level_);
+		add_member("compressor_long", &config_type_int, &Instance::compressor_long_);
+		add_member("compressor_dictionary", &config_type_int, &Instance::compressor_dictionary_);
+		add_member("compressor_threads", &config_type_int, &Instance::compressor_threads_);
+		add_member("compressor_threshold", &config_type_int, &Instance::compressor_threshold_);
+		add_member("flush_wait", &config_type_int, &Instance::flush_wait_);
+		add_member("interactive", &config_type_int, &Instance::interactive_);
 		add_member("byte_counts", &config_type_int, &Instance::byte_counts_);
 
 		add_member("cache", &wanproxy_config_type_cache, &Instance::cache_type_);
 		add_member("cache_path", &config_type_string, &Instance::cache_path_);
+		add_member("cache_trace", &config_type_string, &Instance::cache_trace_);
 		add_member("local_size", &config_type_int, &Instance::local_size_);
 		add_member("remote_size", &config_type_int, &Instance::remote_size_);
 	}
@@ -54,6 +54,13 @@ WANProxyConfigClassProxy wanproxy_config_class_proxy;
 bool
 WANProxyConfigClassProxy::Instance::activate(const ConfigObject *co)
 {
+	if (stripes_ < 0 || stripes_ > STRIPE_MAX_COUNT || pool_ < 0)
+		return (false);
+	if (listeners_ < 1 || listeners_ > 64 || backlog_ < 1)
+		return (false);
+	if (memory_limit_ < 0 || memory_budget_ < 0)
+		return (false);
+
 	WANProxyConfigClassInterface::Instance *interface =
 		dynamic_cast<WANProxyConfigClassInterface::Instance *>(interface_->instance_);
 	if (interface == NULL)
@@ -105,6 +112,14 @@ WANProxyConfigClassProxy::Instance::activate(const ConfigObject *co)
 	ins.remote_protocol_ = peer->family_;
 	ins.remote_address_ = '[' + peer->host_ + ']' + ':' + peer->port_;
 	ins.remote_codec_ = (peer_codec ? *peer_codec : WANProxyCodec ());
+	ins.proxy_tunnels_ = tunnels_;
+	ins.proxy_stripes_ = tunnels_ ? 0 : stripes_;
+	ins.proxy_pool_ = pool_;
+	ins.proxy_listeners_ = listeners_;
+	ins.proxy_backlog_ = backlog_;
+	ins.proxy_capture_ = capture_;
+	ins.proxy_memory_limit_ = memory_limit_ << 10;
+	ins.proxy_memory_budget_ = memory_budget_ << 20;
 	wanproxy.add_proxy (ins.proxy_name_, ins);
 	
 	return (true);
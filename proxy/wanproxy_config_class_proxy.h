@@ -26,7 +26,10 @@
 #ifndef	PROGRAMS_WANPROXY_WANPROXY_CONFIG_CLASS_PROXY_H
 #define	PROGRAMS_WANPROXY_WANPROXY_CONFIG_CLASS_PROXY_H
 
+#include <config/config_type_int.h>
 #include <config/config_type_pointer.h>
+#include <config/config_type_string.h>
+#include <io/socket/socket.h>
 
 #include "wanproxy_config_type_proxy_type.h"
 #include "wanproxy_config_type_proxy_role.h"
@@ -49,6 +52,14 @@ class WANProxyConfigClassProxy : public ConfigClass {
 		ConfigObject *interface_codec_;
 		ConfigObject *peer_;
 		ConfigObject *peer_codec_;
+		intmax_t tunnels_;
+		intmax_t stripes_;
+		intmax_t pool_;
+		intmax_t listeners_;
+		intmax_t backlog_;
+		std::string capture_;
+		intmax_t memory_limit_;
+		intmax_t memory_budget_;
 
 		Instance(void)
 		: type_(WANProxyConfigProxyTypeTCPTCP),
@@ -56,7 +67,14 @@ class WANProxyConfigClassProxy : public ConfigClass {
 		  interface_(NULL),
 		  interface_codec_(NULL),
 		  peer_(NULL),
-		  peer_codec_(NULL)
+		  peer_codec_(NULL),
+		  tunnels_(0),
+		  stripes_(0),
+		  pool_(0),
+		  listeners_(1),
+		  backlog_(SOCKET_LISTEN_BACKLOG),
+		  memory_limit_(0),
+		  memory_budget_(0)
 		{ }
 
 		bool activate(const ConfigObject *);
@@ -71,6 +89,14 @@ public:
 		add_member("interface_codec", &config_type_pointer, &Instance::interface_codec_);
 		add_member("peer", &config_type_pointer, &Instance::peer_);
 		add_member("peer_codec", &config_type_pointer, &Instance::peer_codec_);
+		add_member("tunnels", &config_type_int, &Instance::tunnels_);
+		add_member("stripes", &config_type_int, &Instance::stripes_);
+		add_member("pool", &config_type_int, &Instance::pool_);
+		add_member("listeners", &config_type_int, &Instance::listeners_);
+		add_member("backlog", &config_type_int, &Instance::backlog_);
+		add_member("capture", &config_type_string, &Instance::capture_);
+		add_member("memory_limit", &config_type_int, &Instance::memory_limit_);
+		add_member("memory_budget", &config_type_int, &Instance::memory_budget_);
 	}
 
 	/* XXX So wrong.  */
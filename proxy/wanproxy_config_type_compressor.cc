@@ -27,6 +27,8 @@
 
 static struct WANProxyConfigTypeCompressor::Mapping wanproxy_config_type_compressor_map[] = {
 	{ "zlib",	WANProxyConfigCompressorZlib },
+	{ "zstd",	WANProxyConfigCompressorZstd },
+	{ "lz4",		WANProxyConfigCompressorLZ4 },
 	{ "None",	WANProxyConfigCompressorNone },
 	{ NULL,		WANProxyConfigCompressorNone }
 };
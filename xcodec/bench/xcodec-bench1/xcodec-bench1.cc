@@ -0,0 +1,344 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// File:           xcodec-bench1.cc                                           //
+// Description:    throughput of the xcodec encoder and decoder               //
+// Project:        WANProxy XTech                                             //
+// Author:         Andreu Vidal Bramfeld-Software                             //
+// Last modified:  2026-10-19                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <new>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <common/buffer.h>
+#include <common/uuid/uuid.h>
+#include <xcodec/xcodec.h>
+#include <xcodec/xcodec_cache.h>
+#include <xcodec/xcodec_decoder.h>
+#include <xcodec/xcodec_encoder.h>
+#include <xcodec/cache/coss/xcodec_cache_coss.h>
+
+#define BENCH_CORPUS_SIZE		16		// MB
+#define BENCH_BLOCK_SIZE		64		// KB
+#define BENCH_BASE_SIZE			(1 << 20)
+#define BENCH_EDIT_SPACING		8192
+#define BENCH_ROUNDS				3
+
+/*
+ * Each corpus is run through an encoder and then through a decoder, each
+ * with a fresh cache of its own as the two ends of a link would have, in
+ * blocks flushed one by one as the encoding filter does with every read.
+ * Results are written one line per corpus and cache type, as "key=value"
+ * fields, so that runs can be compared by a script. Times are the best of
+ * the rounds, and allocations those of the codec alone.
+ */
+
+static uint64_t allocations = 0;
+
+void* operator new (size_t size)
+{
+	void* p = malloc (size ? size : 1);
+	if (! p)
+		throw std::bad_alloc ();
+	allocations++;
+	return p;
+}
+
+void* operator new[] (size_t size)
+{
+	return operator new (size);
+}
+
+void operator delete (void* p) throw ()
+{
+	free (p);
+}
+
+void operator delete[] (void* p) throw ()
+{
+	free (p);
+}
+
+void operator delete (void* p, size_t) throw ()
+{
+	free (p);
+}
+
+void operator delete[] (void* p, size_t) throw ()
+{
+	free (p);
+}
+
+struct BenchResult
+{
+	uint64_t encoded_;
+	uint64_t encode_ns_;
+	uint64_t decode_ns_;
+	uint64_t encode_allocs_;
+	uint64_t decode_allocs_;
+	bool ok_;
+};
+
+static uint64_t random_state = 0x9e3779b97f4a7c15ULL;
+
+static uint8_t random_byte ()
+{
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 7;
+	random_state ^= random_state << 17;
+	return (uint8_t) (random_state >> 24);
+}
+
+static uint64_t now_ns ()
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * The "random" corpus never repeats, nor does "escape", which has one byte
+ * in 16 set to the xcodec magic and is fed in blocks shorter than a segment
+ * (see split), so that all of it is escaped as a short tail would be. The
+ * others are copies of a random base of 1 MB, the "shifted" copies preceded
+ * by a few bytes so that segments fall at other offsets each time, and the
+ * "edited" ones with a byte changed every few KB.
+ */
+
+static bool make_corpus (const std::string& name, size_t size, std::vector<uint8_t>& data)
+{
+	std::vector<uint8_t> base (BENCH_BASE_SIZE);
+	size_t i;
+
+	data.clear ();
+	data.reserve (size + XCODEC_SEGMENT_LENGTH);
+
+	if (name == "random" || name == "escape")
+	{
+		while (data.size () < size)
+			data.push_back ((name == "escape" && data.size () % 16 == 0) ? XCODEC_MAGIC : random_byte ());
+		return true;
+	}
+
+	if (name != "repeated" && name != "shifted" && name != "edited")
+		return false;
+	for (i = 0; i < base.size (); ++i)
+		base[i] = random_byte ();
+
+	while (data.size () < size)
+	{
+		size_t start = data.size ();
+		if (name == "shifted")
+			for (i = 1 + random_byte () % 251; i > 0; --i)
+				data.push_back (random_byte ());
+		data.insert (data.end (), base.begin (), base.end ());
+		if (name == "edited" && start > 0)
+			for (i = start + random_byte (); i < data.size (); i += BENCH_EDIT_SPACING)
+				data[i] ^= 1 + random_byte () % 255;
+	}
+	data.resize (size);
+	return true;
+}
+
+/*
+ * Any data left after the last segment declared in a block is escaped when
+ * the block is flushed, so for "escape" the blocks are cut to lengths just
+ * short of a segment, varying so that they never line up with one.
+ */
+
+static void split (const std::string& name, const std::vector<uint8_t>& data, size_t block, std::vector<Buffer>& input)
+{
+	size_t off, len, k;
+
+	for (off = 0, k = 0; off < data.size (); off += len, ++k)
+	{
+		len = (name == "escape" ? XCODEC_SEGMENT_LENGTH - 1 - (k * 257) % 1024 : block);
+		if (len > data.size () - off)
+			len = data.size () - off;
+		input.push_back (Buffer (&data[off], len));
+	}
+}
+
+static XCodecCache* make_cache (const std::string& type, const std::string& dir, std::string& path)
+{
+	uint8_t str[UUID_STRING_SIZE + 1];
+	UUID uuid;
+
+	uuid.generate ();
+	if (type == "memory")
+		return new XCodecMemoryCache (uuid, 0);
+
+	uuid.to_string (str);
+	path = dir + "/" + std::string ((const char*) str, UUID_STRING_SIZE) + ".wpc";
+	return new XCodecCacheCOSS (uuid, dir, 0);
+}
+
+static void run (const std::string& type, const std::string& dir, const std::string& name,
+					  const std::vector<uint8_t>& data, size_t block, BenchResult& result)
+{
+	std::string enc_path, dec_path;
+	std::set<uint64_t> unknown;
+	std::vector<Buffer> input, frames;
+	Buffer original (&data[0], data.size ()), output;
+	size_t n, i;
+	uint64_t start, allocs;
+
+	split (name, data, block, input);
+	n = input.size ();
+	frames.resize (n);
+
+	XCodecCache* enc_cache = make_cache (type, dir, enc_path);
+	XCodecCache* dec_cache = make_cache (type, dir, dec_path);
+	XCodecEncoder* encoder = new XCodecEncoder (enc_cache);
+	XCodecDecoder* decoder = new XCodecDecoder (dec_cache);
+
+	allocs = allocations;
+	start = now_ns ();
+	for (i = 0; i < n; ++i)
+	{
+		encoder->encode (frames[i], input[i]);
+		encoder->flush (frames[i]);
+	}
+	result.encode_ns_ = now_ns () - start;
+	result.encode_allocs_ = allocations - allocs;
+
+	result.encoded_ = 0;
+	for (i = 0; i < n; ++i)
+		result.encoded_ += frames[i].length ();
+
+	result.ok_ = true;
+	allocs = allocations;
+	start = now_ns ();
+	for (i = 0; i < n && result.ok_; ++i)
+		if (! decoder->decode (output, frames[i], unknown) || ! unknown.empty () || ! frames[i].empty ())
+			result.ok_ = false;
+	result.decode_ns_ = now_ns () - start;
+	result.decode_allocs_ = allocations - allocs;
+
+	if (result.ok_ && ! output.equal (&original))
+		result.ok_ = false;
+
+	delete decoder;
+	delete encoder;
+	delete dec_cache;
+	delete enc_cache;
+	if (! enc_path.empty ())
+		::unlink (enc_path.c_str ());
+	if (! dec_path.empty ())
+		::unlink (dec_path.c_str ());
+}
+
+static void report (const std::string& type, const std::string& name, size_t size, const BenchResult& r)
+{
+	double enc_ns = (r.encode_ns_ ? r.encode_ns_ : 1), dec_ns = (r.decode_ns_ ? r.decode_ns_ : 1);
+
+	printf ("xcodec-bench1 cache=%s corpus=%s bytes=%lu encoded=%lu ratio=%.3f"
+			  " encode_mbps=%.1f encode_ns_per_byte=%.2f decode_mbps=%.1f decode_ns_per_byte=%.2f"
+			  " encode_allocs=%lu decode_allocs=%lu ok=%d\n",
+			  type.c_str (), name.c_str (), (unsigned long) size, (unsigned long) r.encoded_,
+			  (r.encoded_ ? (double) size / r.encoded_ : 0.0),
+			  size / enc_ns * 1e9 / 1048576, enc_ns / size, size / dec_ns * 1e9 / 1048576, dec_ns / size,
+			  (unsigned long) r.encode_allocs_, (unsigned long) r.decode_allocs_, (r.ok_ ? 1 : 0));
+	fflush (stdout);
+}
+
+static void usage ()
+{
+	fprintf (stderr, "usage: xcodec-bench1 [-c memory|coss] [-d cachedir] [-p corpus] [-s MB] [-b KB] [-r rounds] [-v]\n"
+						  "corpora: random repeated shifted edited escape\n");
+	exit (1);
+}
+
+int main (int argc, char* argv[])
+{
+	static const char* corpora[] = { "random", "repeated", "shifted", "edited", "escape" };
+	std::vector<std::string> types, names;
+	std::string dir = "/tmp";
+	size_t size = BENCH_CORPUS_SIZE, block = BENCH_BLOCK_SIZE;
+	int rounds = BENCH_ROUNDS, ch, i, k;
+	bool verbose = false;
+
+	while ((ch = getopt (argc, argv, "c:d:p:s:b:r:v")) != -1)
+	{
+		switch (ch)
+		{
+		case 'c':
+			if (strcmp (optarg, "memory") && strcmp (optarg, "coss"))
+				usage ();
+			types.push_back (optarg);
+			break;
+		case 'd':
+			dir = optarg;
+			break;
+		case 'p':
+			names.push_back (optarg);
+			break;
+		case 's':
+			size = strtoul (optarg, 0, 10);
+			break;
+		case 'b':
+			block = strtoul (optarg, 0, 10);
+			break;
+		case 'r':
+			rounds = atoi (optarg);
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			usage ();
+		}
+	}
+
+	if (size < 1 || block < 1 || rounds < 1)
+		usage ();
+	size <<= 20, block <<= 10;
+	Log::mask (".?", (verbose ? Log::Debug : Log::Error));
+
+	if (types.empty ())
+		types.push_back ("memory"), types.push_back ("coss");
+	if (names.empty ())
+		names.assign (corpora, corpora + sizeof corpora / sizeof corpora[0]);
+
+	for (i = 0; i < (int) names.size (); ++i)
+	{
+		std::vector<uint8_t> data;
+		if (! make_corpus (names[i], size, data))
+		{
+			fprintf (stderr, "xcodec-bench1: unknown corpus %s\n", names[i].c_str ());
+			return 1;
+		}
+
+		for (std::vector<std::string>::iterator t = types.begin (); t != types.end (); ++t)
+		{
+			BenchResult best, r;
+			memset (&best, 0, sizeof best);
+			for (k = 0; k < rounds; ++k)
+			{
+				run (*t, dir, names[i], data, block, r);
+				if (k == 0 || ! r.ok_)
+					best = r;
+				else if (best.ok_)
+				{
+					if (r.encode_ns_ < best.encode_ns_)
+						best.encode_ns_ = r.encode_ns_;
+					if (r.decode_ns_ < best.decode_ns_)
+						best.decode_ns_ = r.decode_ns_;
+				}
+			}
+			report (*t, names[i], size, best);
+			if (! best.ok_)
+				return 1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,748 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// File:           xcodec-cachesim1.cc                                        //
+// Description:    replays cache traces against several eviction policies     //
+// Project:        WANProxy XTech                                             //
+// Author:         Andreu Vidal Bramfeld-Software                             //
+// Last modified:  2026-10-19                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <list>
+#include <string>
+#include <vector>
+
+#include <xcodec/xcodec.h>
+#include <xcodec/xcodec_cache.h>
+#include <xcodec/xcodec_cache_trace.h>
+#include <xcodec/cache/coss/xcodec_cache_coss.h>
+
+#define SIM_WINDOW_PERCENT			1
+#define SIM_PROTECTED_PERCENT		80
+#define SIM_SKETCH_ROWS				4
+#define SIM_SKETCH_RESET			10		// samples per entry before halving
+
+/*
+ * The traces written by caches with "cache_trace" set are fed, enter by
+ * enter and lookup by lookup, to a model of each policy at each size, and
+ * a line of "key=value" fields is written for every run.
+ *
+ * The COSS model follows XCodecCacheCOSS step by step on the stripe headers
+ * alone, with the number of stripes held in memory and the segments per
+ * stripe as parameters; a disk read is the load of a whole stripe. The
+ * other policies keep single segments, and are given as much memory as
+ * COSS in loaded stripes, used as a plain LRU in front of the disk, so
+ * that a hit outside it costs the read of one segment. Disk reads are
+ * given per GB of segments entered or looked up.
+ */
+
+struct SimCounts
+{
+	uint64_t enters_;
+	uint64_t lookups_;
+	uint64_t hits_;
+	uint64_t disk_reads_;
+	uint64_t disk_bytes_;
+
+	SimCounts ()   { enters_ = lookups_ = hits_ = disk_reads_ = disk_bytes_ = 0; }
+};
+
+class SimPolicy
+{
+public:
+	SimCounts counts_;
+
+	virtual ~SimPolicy ()   { }
+
+	virtual bool lookup (uint64_t hash) = 0;
+	virtual void enter (uint64_t hash) = 0;
+};
+
+// recency list with constant time access to any of its hashes
+class SimList
+{
+	typedef std::list<uint64_t> list_t;
+	typedef __gnu_cxx::hash_map<Hash64, list_t::iterator> index_t;
+	list_t list_;
+	index_t index_;
+	size_t size_;
+
+public:
+	SimList () : size_(0)   { }
+
+	size_t size () const   { return size_; }
+	bool contains (uint64_t hash) const   { return index_.find (hash) != index_.end (); }
+	uint64_t back () const   { return list_.back (); }
+
+	void push_front (uint64_t hash)
+	{
+		list_.push_front (hash);
+		index_[hash] = list_.begin ();
+		size_++;
+	}
+
+	bool touch (uint64_t hash)
+	{
+		index_t::iterator it = index_.find (hash);
+		if (it == index_.end ())
+			return false;
+		list_.splice (list_.begin (), list_, it->second);
+		return true;
+	}
+
+	bool erase (uint64_t hash)
+	{
+		index_t::iterator it = index_.find (hash);
+		if (it == index_.end ())
+			return false;
+		list_.erase (it->second);
+		index_.erase (it);
+		size_--;
+		return true;
+	}
+
+	uint64_t pop_back ()
+	{
+		uint64_t hash = list_.back ();
+		erase (hash);
+		return hash;
+	}
+};
+
+class SegmentPolicy : public SimPolicy
+{
+	SimList front_;
+	size_t front_size_;
+
+protected:
+	size_t capacity_;
+
+	SegmentPolicy (size_t capacity, size_t front) : front_size_(front), capacity_(capacity)   { }
+
+	void touched (uint64_t hash, bool entered)
+	{
+		if (front_.touch (hash))
+			return;
+		if (! entered)
+			counts_.disk_reads_++, counts_.disk_bytes_ += XCODEC_SEGMENT_LENGTH;
+		front_.push_front (hash);
+		if (front_.size () > front_size_)
+			front_.pop_back ();
+	}
+
+	void evicted (uint64_t hash)
+	{
+		front_.erase (hash);
+	}
+};
+
+class LRUPolicy : public SegmentPolicy
+{
+	SimList cache_;
+
+public:
+	LRUPolicy (size_t capacity, size_t front) : SegmentPolicy (capacity, front)   { }
+
+	bool lookup (uint64_t hash)
+	{
+		if (! cache_.touch (hash))
+			return false;
+		touched (hash, false);
+		return true;
+	}
+
+	void enter (uint64_t hash)
+	{
+		if (! cache_.touch (hash))
+			cache_.push_front (hash);
+		touched (hash, true);
+		while (cache_.size () > capacity_)
+			evicted (cache_.pop_back ());
+	}
+};
+
+/*
+ * Adaptive replacement as given by Megiddo and Modha. A lookup cannot
+ * bring in a missing segment, only the enter that follows does, so ghost
+ * hits are taken into account there.
+ */
+
+class ARCPolicy : public SegmentPolicy
+{
+	SimList t1_, t2_, b1_, b2_;
+	size_t p_;
+
+public:
+	ARCPolicy (size_t capacity, size_t front) : SegmentPolicy (capacity, front), p_(0)   { }
+
+	bool lookup (uint64_t hash)
+	{
+		if (t1_.erase (hash))
+			t2_.push_front (hash);
+		else if (! t2_.touch (hash))
+			return false;
+		touched (hash, false);
+		return true;
+	}
+
+	void enter (uint64_t hash)
+	{
+		size_t d;
+
+		if (t1_.erase (hash))
+			t2_.push_front (hash);
+		else if (t2_.touch (hash))
+			;
+		else if (b1_.contains (hash))
+		{
+			d = (b2_.size () > b1_.size () ? b2_.size () / b1_.size () : 1);
+			p_ = (p_ + d < capacity_ ? p_ + d : capacity_);
+			replace (false);
+			b1_.erase (hash);
+			t2_.push_front (hash);
+		}
+		else if (b2_.contains (hash))
+		{
+			d = (b1_.size () > b2_.size () ? b1_.size () / b2_.size () : 1);
+			p_ = (p_ > d ? p_ - d : 0);
+			replace (true);
+			b2_.erase (hash);
+			t2_.push_front (hash);
+		}
+		else
+		{
+			if (t1_.size () + b1_.size () >= capacity_)
+			{
+				if (t1_.size () < capacity_)
+				{
+					b1_.pop_back ();
+					replace (false);
+				}
+				else
+					evicted (t1_.pop_back ());
+			}
+			else if (t1_.size () + t2_.size () + b1_.size () + b2_.size () >= capacity_)
+			{
+				if (t1_.size () + t2_.size () + b1_.size () + b2_.size () >= 2 * capacity_)
+					b2_.pop_back ();
+				replace (false);
+			}
+			t1_.push_front (hash);
+		}
+		touched (hash, true);
+	}
+
+private:
+	void replace (bool in_b2)
+	{
+		uint64_t hash;
+
+		if (t1_.size () > 0 && (t1_.size () > p_ || (in_b2 && t1_.size () == p_) || t2_.size () == 0))
+		{
+			hash = t1_.pop_back ();
+			b1_.push_front (hash);
+			evicted (hash);
+		}
+		else if (t2_.size () > 0)
+		{
+			hash = t2_.pop_back ();
+			b2_.push_front (hash);
+			evicted (hash);
+		}
+	}
+};
+
+/*
+ * Window TinyLFU: new segments go through a small LRU window, and leave it
+ * for the probation part of a segmented LRU only if the frequency sketch
+ * rates them above the segment they would displace. The sketch is halved
+ * every so many accesses, so that it follows changes in the traffic.
+ */
+
+class TinyLFUPolicy : public SegmentPolicy
+{
+	SimList window_, probation_, protected_;
+	size_t window_size_;
+	size_t protected_size_;
+	std::vector<uint8_t> sketch_;
+	size_t width_;
+	uint64_t samples_;
+
+public:
+	TinyLFUPolicy (size_t capacity, size_t front) : SegmentPolicy (capacity, front), samples_(0)
+	{
+		window_size_ = capacity * SIM_WINDOW_PERCENT / 100;
+		if (window_size_ < 1)
+			window_size_ = 1;
+		protected_size_ = (capacity - window_size_) * SIM_PROTECTED_PERCENT / 100;
+		for (width_ = 16; width_ < capacity; width_ <<= 1)
+			;
+		sketch_.resize (width_ * SIM_SKETCH_ROWS);
+	}
+
+	bool lookup (uint64_t hash)
+	{
+		increment (hash);
+		if (! access (hash))
+			return false;
+		touched (hash, false);
+		return true;
+	}
+
+	void enter (uint64_t hash)
+	{
+		uint64_t candidate, victim;
+
+		increment (hash);
+		if (! access (hash))
+		{
+			window_.push_front (hash);
+			if (window_.size () > window_size_)
+			{
+				candidate = window_.pop_back ();
+				if (window_.size () + probation_.size () + protected_.size () < capacity_)
+					probation_.push_front (candidate);
+				else
+				{
+					SimList& main = (probation_.size () > 0 ? probation_ : protected_);
+					victim = main.back ();
+					if (frequency (candidate) > frequency (victim))
+					{
+						main.erase (victim);
+						evicted (victim);
+						probation_.push_front (candidate);
+					}
+					else
+						evicted (candidate);
+				}
+			}
+		}
+		touched (hash, true);
+	}
+
+private:
+	bool access (uint64_t hash)
+	{
+		if (window_.touch (hash) || protected_.touch (hash))
+			return true;
+		if (! probation_.erase (hash))
+			return false;
+		protected_.push_front (hash);
+		if (protected_.size () > protected_size_)
+			probation_.push_front (protected_.pop_back ());
+		return true;
+	}
+
+	size_t cell (uint64_t hash, int row) const
+	{
+		uint64_t h = (hash + row) * 0x9e3779b97f4a7c15ULL;
+		return row * width_ + ((h ^ (h >> 29)) & (width_ - 1));
+	}
+
+	unsigned frequency (uint64_t hash) const
+	{
+		unsigned f = 255;
+		for (int row = 0; row < SIM_SKETCH_ROWS; ++row)
+			if (sketch_[cell (hash, row)] < f)
+				f = sketch_[cell (hash, row)];
+		return f;
+	}
+
+	void increment (uint64_t hash)
+	{
+		for (int row = 0; row < SIM_SKETCH_ROWS; ++row)
+		{
+			uint8_t& c = sketch_[cell (hash, row)];
+			if (c < 15)
+				c++;
+		}
+		if (++samples_ >= (uint64_t) SIM_SKETCH_RESET * capacity_)
+		{
+			for (std::vector<uint8_t>::iterator it = sketch_.begin (); it != sketch_.end (); ++it)
+				*it >>= 1;
+			samples_ /= 2;
+		}
+	}
+};
+
+/*
+ * Same decisions as XCodecCacheCOSS, the hashes and flags of every stripe
+ * being kept in the arrays of the model "disk", which loaded stripes use
+ * in place; as a loaded stripe is always stored back before its slot is
+ * reused, the result is the same.
+ */
+
+class COSSPolicy : public SimPolicy
+{
+	size_t segments_;
+	uint64_t stripe_bytes_;
+	uint64_t stripe_limit_;
+	uint64_t stored_;
+	uint64_t serial_number_;
+	uint64_t stripe_range_;
+	uint64_t freshness_level_;
+	std::vector<uint64_t> hashes_;
+	std::vector<uint32_t> flags_;
+	std::vector<COSSMetadata> directory_;
+	std::vector<COSSMetadata> disk_;
+	std::vector<COSSMetadata> slots_;
+	int active_;
+	__gnu_cxx::hash_map<Hash64, COSSIndexEntry> index_;
+	uint64_t window_[XCODEC_WINDOW_COUNT];
+	unsigned cursor_;
+
+public:
+	COSSPolicy (size_t mb, size_t loaded, size_t segments) : segments_(segments), slots_(loaded)
+	{
+		stripe_bytes_ = segments * XCODEC_SEGMENT_LENGTH +
+							 ROUND_UP(segments * (sizeof (uint64_t) + sizeof (uint32_t)) + METADATA_SIZE, CACHE_ALIGNEMENT);
+		stripe_limit_ = ROUND_UP((uint64_t) mb * 1048576, stripe_bytes_) / stripe_bytes_;
+		stored_ = serial_number_ = stripe_range_ = freshness_level_ = 0;
+		hashes_.resize (stripe_limit_ * segments);
+		flags_.resize (stripe_limit_ * segments);
+		directory_.resize (stripe_limit_);
+		disk_.resize (stripe_limit_);
+		memset (&directory_[0], 0, stripe_limit_ * sizeof (COSSMetadata));
+		memset (&slots_[0], 0, loaded * sizeof (COSSMetadata));
+		memset (window_, 0, sizeof window_);
+		cursor_ = 0;
+		active_ = 0;
+		initialize_stripe (0, active_);
+	}
+
+	bool lookup (uint64_t hash)
+	{
+		__gnu_cxx::hash_map<Hash64, COSSIndexEntry>::const_iterator it;
+		size_t slot;
+		uint64_t range, pos;
+
+		for (int i = 0; i < XCODEC_WINDOW_COUNT; ++i)
+			if (window_[i] == hash)
+				return true;
+
+		if ((it = index_.find (hash)) == index_.end ())
+			return false;
+		range = it->second.stripe_range;
+		pos = range * segments_ + it->second.position;
+
+		for (slot = 0; slot < slots_.size (); ++slot)
+			if (slots_[slot].signature && slots_[slot].stripe_range == range)
+				break;
+		if (slot >= slots_.size ())
+		{
+			slot = best_unloadable_slot ();
+			detach_stripe (slot);
+			if (! load_stripe (range, slot))
+				return false;
+		}
+
+		if (hashes_[pos] != hash)
+			return false;
+
+		COSSMetadata& m = slots_[slot];
+		m.freshness = ++freshness_level_;
+		m.uses++, m.credits++, m.load_uses++;
+		flags_[pos] |= 3;
+		window_[cursor_] = hash;
+		cursor_ = (cursor_ + 1) & (XCODEC_WINDOW_COUNT - 1);
+		return true;
+	}
+
+	void enter (uint64_t hash)
+	{
+		COSSIndexEntry entry;
+
+		while (slots_[active_].segment_index >= segments_)
+			new_active ();
+
+		COSSMetadata& m = slots_[active_];
+		uint64_t base = m.stripe_range * segments_;
+		hashes_[base + m.segment_index] = hash;
+		entry.stripe_range = m.stripe_range;
+		entry.position = m.segment_index;
+
+		m.segment_index++;
+		while (m.segment_index < segments_ && hashes_[base + m.segment_index])
+			m.segment_index++;
+		m.segment_count++;
+		m.freshness = ++freshness_level_;
+
+		index_[hash] = entry;
+	}
+
+private:
+	void initialize_stripe (uint64_t range, int slot)
+	{
+		COSSMetadata& m = slots_[slot];
+		memset (&m, 0, sizeof m);
+		m.signature = CACHE_SIGNATURE;
+		m.version = CACHE_VERSION;
+		m.serial_number = ++serial_number_;
+		m.stripe_range = range;
+		m.state = 1;
+		memset (&hashes_[range * segments_], 0, segments_ * sizeof (uint64_t));
+		memset (&flags_[range * segments_], 0, segments_ * sizeof (uint32_t));
+		directory_[range] = m;
+	}
+
+	bool load_stripe (uint64_t range, int slot)
+	{
+		if (range >= stored_)
+			return false;
+		COSSMetadata& m = slots_[slot];
+		m = disk_[range];
+		m.stripe_range = range;
+		m.load_uses = 0;
+		m.state = 1;
+		directory_[range].state = 1;
+		counts_.disk_reads_++;
+		counts_.disk_bytes_ += stripe_bytes_;
+		return true;
+	}
+
+	void store_stripe (int slot)
+	{
+		uint64_t range = slots_[slot].stripe_range;
+		disk_[range] = slots_[slot];
+		if (range >= stored_)
+			stored_ = range + 1;
+	}
+
+	void new_active ()
+	{
+		store_stripe (active_);
+		active_ = best_unloadable_slot ();
+		detach_stripe (active_);
+		stripe_range_ = best_erasable_stripe ();
+		if (load_stripe (stripe_range_, active_))
+			purge_stripe (active_);
+		else
+			initialize_stripe (stripe_range_, active_);
+	}
+
+	int best_unloadable_slot ()
+	{
+		uint64_t v, n = 0xFFFFFFFFFFFFFFFFull;
+		int j = 0;
+
+		for (int i = 0; i < (int) slots_.size (); ++i)
+		{
+			if (i == active_)
+				continue;
+			if (slots_[i].signature == 0)
+				return i;
+			if ((v = slots_[i].freshness + slots_[i].load_uses) < n)
+				j = i, n = v;
+		}
+		return j;
+	}
+
+	uint64_t best_erasable_stripe ()
+	{
+		uint64_t v, n = 0xFFFFFFFFFFFFFFFFull;
+		uint64_t i, j = 0;
+
+		for (i = 0; i < stripe_limit_; ++i)
+		{
+			const COSSMetadata& m = directory_[i];
+			if (m.state == 1)
+				continue;
+			if (m.signature == 0)
+				return i;
+			if ((v = m.freshness + m.uses) < n)
+				j = i, n = v;
+		}
+		return j;
+	}
+
+	void detach_stripe (int slot)
+	{
+		COSSMetadata& m = slots_[slot];
+		if (m.state != 1)
+			return;
+
+		uint64_t base = m.stripe_range * segments_;
+		directory_[m.stripe_range] = m;
+		directory_[m.stripe_range].state = 2;
+		for (size_t i = 0; i < segments_; ++i)
+		{
+			if (flags_[base + i] & 1)
+			{
+				for (int k = 0; k < XCODEC_WINDOW_COUNT; ++k)
+					if (window_[k] == hashes_[base + i])
+						window_[k] = 0;
+				flags_[base + i] &= ~1;
+			}
+		}
+		m.state = 0;
+		store_stripe (slot);
+	}
+
+	void purge_stripe (int slot)
+	{
+		COSSMetadata& m = slots_[slot];
+		uint64_t base = m.stripe_range * segments_;
+
+		for (int i = (int) segments_ - 1; i >= 0; --i)
+		{
+			uint64_t hash = hashes_[base + i];
+			if (hash && ! (flags_[base + i] & 2))
+			{
+				index_.erase (hash);
+				hashes_[base + i] = 0;
+				flags_[base + i] = 0;
+				m.segment_count--;
+			}
+			flags_[base + i] &= ~2;
+			if (! hashes_[base + i])
+				m.segment_index = i;
+		}
+		m.serial_number = ++serial_number_;
+		m.uses = m.credits;
+		m.credits = 0;
+	}
+};
+
+static SimPolicy* make_policy (const std::string& name, size_t mb, size_t loaded, size_t segments)
+{
+	size_t capacity = (uint64_t) mb * 1048576 / XCODEC_SEGMENT_LENGTH;
+	size_t front = loaded * segments;
+
+	if (name == "coss")
+		return new COSSPolicy (mb, loaded, segments);
+	if (name == "lru")
+		return new LRUPolicy (capacity, front);
+	if (name == "arc")
+		return new ARCPolicy (capacity, front);
+	if (name == "tinylfu")
+		return new TinyLFUPolicy (capacity, front);
+	return 0;
+}
+
+static bool run (const std::vector<std::string>& traces, SimPolicy* policy, uint64_t* recorded)
+{
+	XCodecTraceKind kind;
+	uint64_t hash;
+
+	for (std::vector<std::string>::const_iterator it = traces.begin (); it != traces.end (); ++it)
+	{
+		XCodecCacheTraceReader reader;
+		if (! reader.open (*it))
+		{
+			fprintf (stderr, "xcodec-cachesim1: not a cache trace: %s\n", it->c_str ());
+			return false;
+		}
+		while (reader.next (kind, hash))
+		{
+			if (recorded)
+				recorded[kind]++;
+			if (kind == XCodecTraceEnter)
+			{
+				policy->counts_.enters_++;
+				policy->enter (hash);
+			}
+			else
+			{
+				policy->counts_.lookups_++;
+				if (policy->lookup (hash))
+					policy->counts_.hits_++;
+			}
+		}
+	}
+	return true;
+}
+
+static void report (const std::string& name, size_t mb, const SimCounts& c)
+{
+	double gb = (c.enters_ + c.lookups_) * (double) XCODEC_SEGMENT_LENGTH / 1073741824;
+
+	if (gb <= 0)
+		gb = 1;
+	printf ("xcodec-cachesim1 policy=%s size_mb=%lu enters=%lu lookups=%lu hits=%lu hit_ratio=%.4f"
+			  " disk_reads=%lu disk_reads_per_gb=%.1f disk_mb_per_gb=%.1f\n",
+			  name.c_str (), (unsigned long) mb, (unsigned long) c.enters_, (unsigned long) c.lookups_,
+			  (unsigned long) c.hits_, (c.lookups_ ? (double) c.hits_ / c.lookups_ : 0.0),
+			  (unsigned long) c.disk_reads_, c.disk_reads_ / gb, c.disk_bytes_ / 1048576.0 / gb);
+	fflush (stdout);
+}
+
+static void usage ()
+{
+	fprintf (stderr, "usage: xcodec-cachesim1 [-p policy] [-s MB] [-l loadedstripes] [-g stripesegments] tracefile ...\n"
+						  "policies: coss lru arc tinylfu\n");
+	exit (1);
+}
+
+int main (int argc, char* argv[])
+{
+	static const char* policies[] = { "coss", "lru", "arc", "tinylfu" };
+	std::vector<std::string> names, traces;
+	std::vector<size_t> sizes;
+	size_t loaded = LOADED_STRIPE_COUNT, segments = STRIPE_SEGMENT_COUNT;
+	uint64_t recorded[XCodecTraceKinds];
+	bool first = true;
+	int ch;
+
+	while ((ch = getopt (argc, argv, "p:s:l:g:")) != -1)
+	{
+		switch (ch)
+		{
+		case 'p':
+			names.push_back (optarg);
+			break;
+		case 's':
+			sizes.push_back (strtoul (optarg, 0, 10));
+			if (sizes.back () < 1)
+				usage ();
+			break;
+		case 'l':
+			loaded = strtoul (optarg, 0, 10);
+			break;
+		case 'g':
+			segments = strtoul (optarg, 0, 10);
+			break;
+		default:
+			usage ();
+		}
+	}
+
+	if (loaded < 2 || segments < 1 || segments > 65535 || optind >= argc)
+		usage ();
+	traces.assign (argv + optind, argv + argc);
+	if (names.empty ())
+		names.assign (policies, policies + sizeof policies / sizeof policies[0]);
+	if (sizes.empty ())
+		sizes.push_back (256), sizes.push_back (1024), sizes.push_back (4096);
+
+	memset (recorded, 0, sizeof recorded);
+	for (std::vector<std::string>::iterator n = names.begin (); n != names.end (); ++n)
+	{
+		for (std::vector<size_t>::iterator s = sizes.begin (); s != sizes.end (); ++s)
+		{
+			SimPolicy* policy = make_policy (*n, *s, loaded, segments);
+			if (! policy)
+			{
+				fprintf (stderr, "xcodec-cachesim1: unknown policy %s\n", n->c_str ());
+				return 1;
+			}
+			if (! run (traces, policy, (first ? recorded : 0)))
+				return 1;
+			if (first)
+			{
+				printf ("xcodec-cachesim1 recorded enters=%lu misses=%lu window=%lu memory=%lu disk=%lu\n",
+						  (unsigned long) recorded[XCodecTraceEnter], (unsigned long) recorded[XCodecTraceMiss],
+						  (unsigned long) recorded[XCodecTraceWindow], (unsigned long) recorded[XCodecTraceMemory],
+						  (unsigned long) recorded[XCodecTraceDisk]);
+				first = false;
+			}
+			report (*n, *s, policy->counts_);
+			delete policy;
+		}
+	}
+
+	return 0;
+}
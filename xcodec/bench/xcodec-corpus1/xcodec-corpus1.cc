@@ -0,0 +1,402 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// File:           xcodec-corpus1.cc                                          //
+// Description:    savings of the xcodec protocol on a corpus of files        //
+// Project:        WANProxy XTech                                             //
+// Author:         Andreu Vidal Bramfeld-Software                             //
+// Last modified:  2026-10-19                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <common/buffer.h>
+#include <common/filter.h>
+#include <common/uuid/uuid.h>
+#include <xcodec/xcodec.h>
+#include <xcodec/xcodec_cache.h>
+#include <xcodec/xcodec_decoder.h>
+#include <xcodec/xcodec_encoder.h>
+#include <xcodec/cache/coss/xcodec_cache_coss.h>
+#include <zlib/zlib_filter.h>
+#if !defined(NO_ZSTD)
+#include <zstd/zstd_filter.h>
+#endif
+
+#define CORPUS_BLOCK_SIZE		64		// KB
+
+/*
+ * Every file is sent as a connection of its own would be: read in blocks,
+ * each one encoded and flushed, then compressed with a flush, so that the
+ * figures are those of the link. The same frames are decompressed and
+ * decoded again, both to check them and to time that side. All files go
+ * through the same pair of caches, the way connections to one peer share
+ * them; a hash the decoder no longer has is learnt from the encoder cache,
+ * as the peer would ask for it. With "-k" COSS caches are kept in their
+ * directory, so that successive runs show what a site gains from day to
+ * day.
+ */
+
+enum CorpusCompressor
+{
+	CorpusNone,
+	CorpusZlib,
+	CorpusZstd
+};
+
+struct CorpusCounts
+{
+	uint64_t files_;
+	uint64_t bytes_;
+	uint64_t encoded_;
+	uint64_t wire_;
+	uint64_t asks_;
+	uint64_t encode_ns_;
+	uint64_t decode_ns_;
+
+	CorpusCounts ()   { files_ = bytes_ = encoded_ = wire_ = asks_ = encode_ns_ = decode_ns_ = 0; }
+};
+
+// keeps what comes out of the end of a compressor or decompressor
+class CorpusSink : public Filter
+{
+	Buffer& output_;
+
+public:
+	CorpusSink (Buffer& output) : output_(output)   { }
+
+	virtual bool consume (Buffer& buf, int flg)   { buf.moveout (&output_); return true; }
+	virtual void flush (int flg)   { }
+};
+
+class Corpus
+{
+	CorpusCompressor compressor_;
+	int level_;
+	size_t block_;
+	bool verbose_;
+	XCodecCache* encoder_cache_;
+	XCodecCache* decoder_cache_;
+
+public:
+	CorpusCounts counts_;
+	bool ok_;
+
+	Corpus (CorpusCompressor cmp, int level, size_t block, bool verbose, XCodecCache* enc, XCodecCache* dec)
+		: compressor_(cmp), level_(level), block_(block), verbose_(verbose), encoder_cache_(enc), decoder_cache_(dec), ok_(true)
+	{ }
+
+	bool run (const std::string& path);
+
+private:
+	Filter* compress_filter () const;
+	Filter* decompress_filter () const;
+	bool learn (const std::set<uint64_t>& unknown);
+};
+
+static uint64_t now_ns ()
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+Filter* Corpus::compress_filter () const
+{
+	switch (compressor_)
+	{
+	case CorpusZlib:
+		return new DeflateFilter (level_);
+#if !defined(NO_ZSTD)
+	case CorpusZstd:
+		return new ZstdCompressFilter (level_);
+#endif
+	default:
+		return 0;
+	}
+}
+
+Filter* Corpus::decompress_filter () const
+{
+	switch (compressor_)
+	{
+	case CorpusZlib:
+		return new InflateFilter ();
+#if !defined(NO_ZSTD)
+	case CorpusZstd:
+		return new ZstdDecompressFilter ();
+#endif
+	default:
+		return 0;
+	}
+}
+
+bool Corpus::learn (const std::set<uint64_t>& unknown)
+{
+	for (std::set<uint64_t>::const_iterator it = unknown.begin (); it != unknown.end (); ++it)
+	{
+		Buffer seg;
+		if (! encoder_cache_->lookup (*it, seg))
+			return false;
+		decoder_cache_->enter (*it, seg, 0);
+		counts_.asks_++;
+	}
+	return true;
+}
+
+bool Corpus::run (const std::string& path)
+{
+	std::vector<uint8_t> data (block_);
+	std::set<uint64_t> unknown;
+	Buffer frame, wire, pending, output;
+	uint64_t start, encoded = 0, sent = 0, total = 0;
+	bool good = true;
+	size_t n;
+
+	FILE* f = fopen (path.c_str (), "rb");
+	if (! f)
+	{
+		fprintf (stderr, "xcodec-corpus1: cannot read %s\n", path.c_str ());
+		return false;
+	}
+
+	XCodecEncoder* encoder = new XCodecEncoder (encoder_cache_);
+	XCodecDecoder* decoder = new XCodecDecoder (decoder_cache_);
+	Filter* compress = compress_filter ();
+	Filter* decompress = decompress_filter ();
+	CorpusSink wire_sink (wire), frame_sink (pending);
+	if (compress)
+		compress->chain (&wire_sink), decompress->chain (&frame_sink);
+
+	while (good && (n = fread (&data[0], 1, block_, f)) > 0)
+	{
+		Buffer input (&data[0], n), original (&data[0], n);
+		total += n;
+
+		start = now_ns ();
+		encoder->encode (frame, input);
+		encoder->flush (frame);
+		encoded += frame.length ();
+		if (compress)
+		{
+			good = compress->consume (frame);
+			frame.clear ();
+		}
+		else
+			frame.moveout (&wire);
+		counts_.encode_ns_ += now_ns () - start;
+		sent += wire.length ();
+
+		start = now_ns ();
+		if (decompress)
+			good = good && decompress->consume (wire);
+		else
+			wire.moveout (&pending);
+		while (good && ! pending.empty ())
+		{
+			unknown.clear ();
+			if (! decoder->decode (output, pending, unknown))
+				good = false;
+			else if (unknown.empty ())
+				break;
+			else if (! learn (unknown))
+				good = false;
+		}
+		counts_.decode_ns_ += now_ns () - start;
+
+		if (good && (! pending.empty () || ! output.equal (&original)))
+			good = false;
+		wire.clear ();
+		output.clear ();
+	}
+	fclose (f);
+
+	// the end of the compressed stream, as when the connection closes
+	if (compress && good)
+	{
+		compress->flush (0);
+		sent += wire.length ();
+		good = decompress->consume (wire);
+		decompress->flush (0);
+	}
+
+	delete decompress;
+	delete compress;
+	delete decoder;
+	delete encoder;
+
+	counts_.files_++;
+	counts_.bytes_ += total;
+	counts_.encoded_ += encoded;
+	counts_.wire_ += sent;
+	if (verbose_)
+		printf ("xcodec-corpus1 file=%s bytes=%lu encoded=%lu wire=%lu ok=%d\n", path.c_str (),
+				  (unsigned long) total, (unsigned long) encoded, (unsigned long) sent, (good ? 1 : 0));
+	if (! good)
+	{
+		fprintf (stderr, "xcodec-corpus1: %s did not decode back to its contents\n", path.c_str ());
+		ok_ = false;
+	}
+	return true;
+}
+
+// regular files under the paths given, in name order so runs are repeatable
+static void collect (const std::string& path, std::vector<std::string>& files)
+{
+	struct stat st;
+	DIR* dir;
+	struct dirent* ent;
+	std::vector<std::string> names;
+
+	if (::stat (path.c_str (), &st) != 0)
+	{
+		fprintf (stderr, "xcodec-corpus1: cannot find %s\n", path.c_str ());
+		return;
+	}
+	if (S_ISREG (st.st_mode))
+	{
+		files.push_back (path);
+		return;
+	}
+	if (! S_ISDIR (st.st_mode) || ! (dir = opendir (path.c_str ())))
+		return;
+	while ((ent = readdir (dir)))
+		if (strcmp (ent->d_name, ".") && strcmp (ent->d_name, ".."))
+			names.push_back (path + "/" + ent->d_name);
+	closedir (dir);
+
+	std::sort (names.begin (), names.end ());
+	for (std::vector<std::string>::iterator it = names.begin (); it != names.end (); ++it)
+		collect (*it, files);
+}
+
+static XCodecCache* make_cache (const std::string& type, const std::string& dir, size_t mb, bool keep,
+										  const char* side, std::string& path)
+{
+	std::string uuid_path = dir + "/UUID." + side;
+	uint8_t str[UUID_STRING_SIZE + 1];
+	UUID uuid;
+
+	if (! keep || ! uuid.from_file (uuid_path))
+	{
+		uuid.generate ();
+		if (keep)
+			uuid.to_file (uuid_path);
+	}
+	if (type == "memory")
+		return new XCodecMemoryCache (uuid, mb);
+
+	uuid.to_string (str);
+	if (! keep)
+		path = dir + "/" + std::string ((const char*) str, UUID_STRING_SIZE) + ".wpc";
+	return new XCodecCacheCOSS (uuid, dir, mb);
+}
+
+static void usage ()
+{
+	fprintf (stderr, "usage: xcodec-corpus1 [-c memory|coss] [-d cachedir] [-m MB] [-k] [-z none|zlib|zstd] [-l level]\n"
+						  "                      [-b KB] [-v] file|directory ...\n"
+						  "(-m only bounds COSS caches, -k keeps them in cachedir between runs)\n");
+	exit (1);
+}
+
+int main (int argc, char* argv[])
+{
+	std::vector<std::string> files;
+	std::string type = "memory", dir = "/tmp", enc_path, dec_path;
+	CorpusCompressor cmp = CorpusNone;
+	size_t mb = 0, block = CORPUS_BLOCK_SIZE;
+	int level = -1, ch, i;
+	bool keep = false, verbose = false;
+
+	while ((ch = getopt (argc, argv, "c:d:m:kz:l:b:v")) != -1)
+	{
+		switch (ch)
+		{
+		case 'c':
+			if (strcmp (optarg, "memory") && strcmp (optarg, "coss"))
+				usage ();
+			type = optarg;
+			break;
+		case 'd':
+			dir = optarg;
+			break;
+		case 'm':
+			mb = strtoul (optarg, 0, 10);
+			break;
+		case 'k':
+			keep = true;
+			break;
+		case 'z':
+			if (! strcmp (optarg, "zlib"))
+				cmp = CorpusZlib;
+#if !defined(NO_ZSTD)
+			else if (! strcmp (optarg, "zstd"))
+				cmp = CorpusZstd;
+#endif
+			else if (strcmp (optarg, "none"))
+				usage ();
+			break;
+		case 'l':
+			level = atoi (optarg);
+			break;
+		case 'b':
+			block = strtoul (optarg, 0, 10);
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			usage ();
+		}
+	}
+
+	if (block < 1 || optind >= argc)
+		usage ();
+	if (level < 0)
+		level = (cmp == CorpusZlib ? 6 : 0);
+	if ((cmp == CorpusZlib && (level < 0 || level > 9)) || (cmp == CorpusZstd && (level < 0 || level > 19)))
+		usage ();
+	Log::mask (".?", Log::Error);
+
+	for (i = optind; i < argc; ++i)
+		collect (argv[i], files);
+
+	XCodecCache* enc_cache = make_cache (type, dir, mb, keep, "encoder", enc_path);
+	XCodecCache* dec_cache = make_cache (type, dir, mb, keep, "decoder", dec_path);
+	Corpus corpus (cmp, level, block << 10, verbose, enc_cache, dec_cache);
+
+	for (std::vector<std::string>::iterator it = files.begin (); it != files.end (); ++it)
+		corpus.run (*it);
+
+	const CorpusCounts& c = corpus.counts_;
+	const XCodecCacheCounters& k = enc_cache->counters ();
+	double enc_ns = (c.encode_ns_ ? c.encode_ns_ : 1), dec_ns = (c.decode_ns_ ? c.decode_ns_ : 1);
+	printf ("xcodec-corpus1 cache=%s compressor=%s files=%lu bytes=%lu encoded=%lu wire=%lu saved_pct=%.2f"
+			  " references=%lu declarations=%lu escapes=%lu asks=%lu encode_mbps=%.1f decode_mbps=%.1f ok=%d\n",
+			  type.c_str (), (cmp == CorpusZlib ? "zlib" : cmp == CorpusZstd ? "zstd" : "none"),
+			  (unsigned long) c.files_, (unsigned long) c.bytes_, (unsigned long) c.encoded_, (unsigned long) c.wire_,
+			  (c.bytes_ ? 100.0 * ((double) c.bytes_ - c.wire_) / c.bytes_ : 0.0),
+			  (unsigned long) k.references_, (unsigned long) k.declarations_, (unsigned long) k.escapes_,
+			  (unsigned long) c.asks_, c.bytes_ / enc_ns * 1e9 / 1048576, c.bytes_ / dec_ns * 1e9 / 1048576,
+			  (corpus.ok_ ? 1 : 0));
+
+	delete dec_cache;
+	delete enc_cache;
+	if (! enc_path.empty ())
+		::unlink (enc_path.c_str ());
+	if (! dec_path.empty ())
+		::unlink (dec_path.c_str ());
+
+	return (corpus.ok_ ? 0 : 1);
+}
@@ -183,12 +183,14 @@ void XCodecCacheCOSS::enter (const uint64_t& hash, const Buffer& buf, unsigned o
 	act.header.metadata.freshness = ++freshness_level_;
 	
 	cache_index_.insert (hash, entry);
+	note (XCodecTraceEnter, hash);
 }
 
 bool XCodecCacheCOSS::lookup (const uint64_t& hash, Buffer& buf)
 {
 	const COSSIndexEntry* entry;
 	const uint8_t* data;
+	XCodecTraceKind layer = XCodecTraceMemory;
 	int slot;
 
 	stats_.lookups++;
@@ -198,12 +200,16 @@ bool XCodecCacheCOSS::lookup (const uint64_t& hash, Buffer& buf)
 	{
 		buf.append (data, XCODEC_SEGMENT_LENGTH);
 		stats_.found_1++;
+		note (XCodecTraceWindow, hash);
 		return true;
 	}
 #endif
 		
 	if (! (entry = cache_index_.lookup (hash)))
+	{
+		note (XCodecTraceMiss, hash);
 		return false;
+	}
 	
 	for (slot = 0; slot < LOADED_STRIPE_COUNT; ++slot)
 		if (stripe_[slot].header.metadata.stripe_range == entry->stripe_range)
@@ -214,10 +220,14 @@ bool XCodecCacheCOSS::lookup (const uint64_t& hash, Buffer& buf)
 		slot = best_unloadable_slot ();
 		detach_stripe (slot);
 		load_stripe (entry->stripe_range, slot);
+		layer = XCodecTraceDisk;
 	}
 	
 	if (stripe_[slot].header.hash_array[entry->position] != hash)
+	{
+		note (XCodecTraceMiss, hash);
 		return false;
+	}
 		
 	stripe_[slot].header.metadata.freshness = ++freshness_level_;
 	stripe_[slot].header.metadata.uses++;
@@ -231,9 +241,29 @@ bool XCodecCacheCOSS::lookup (const uint64_t& hash, Buffer& buf)
 #endif
 	buf.append (data, XCODEC_SEGMENT_LENGTH);
 	stats_.found_2++;
+	note (layer, hash);
 	return true;
 }
 
+bool XCodecCacheCOSS::contains (const uint64_t& hash) const
+{
+	return cache_index_.contains (hash);
+}
+
+void XCodecCacheCOSS::statistics (XCodecCacheStatistics& stats) const
+{
+	XCodecCache::statistics (stats);
+	stats["segments"] = cache_index_.size ();
+	stats["lookups"] = stats_.lookups;
+	stats["matches"] = stats_.found_1 + stats_.found_2;
+	stats["stripe_loads"] = stats_.loads;
+	stats["stripe_unloads"] = stats_.unloads;
+	stats["stripe_purges"] = stats_.purges;
+	stats["segment_evictions"] = stats_.evictions;
+	stats["memory_bytes"] = sizeof stripe_ + stripe_limit_ * sizeof (COSSMetadata) + 
+									cache_index_.size () * (sizeof (uint64_t) + sizeof (COSSIndexEntry));
+}
+
 void XCodecCacheCOSS::initialize_stripe (uint64_t range, int slot)
 {
 	memset (&stripe_[slot].header, 0, sizeof (COSSStripeHeader));
@@ -258,6 +288,7 @@ bool XCodecCacheCOSS::load_stripe (uint64_t range, int slot)
 			stripe_[slot].header.metadata.load_uses = 0;
 			stripe_[slot].header.metadata.state = 1;
 			directory_[range].state = 1;
+			stats_.loads++;
 			return true;
 		}
 	}
@@ -347,6 +378,7 @@ void XCodecCacheCOSS::detach_stripe (int slot)
 		
 		stripe_[slot].header.metadata.state = 0;
 		store_stripe (slot, sizeof (COSSStripeHeader));
+		stats_.unloads++;
 	}
 }
 
@@ -361,6 +393,7 @@ void XCodecCacheCOSS::purge_stripe (int slot)
 			stripe_[slot].header.hash_array[i] = 0;
 			stripe_[slot].header.flags[i] = 0;
 			stripe_[slot].header.metadata.segment_count--;
+			stats_.evictions++;
 		}
 		
 		stripe_[slot].header.flags[i] &= ~2;
@@ -371,6 +404,7 @@ void XCodecCacheCOSS::purge_stripe (int slot)
 	stripe_[slot].header.metadata.serial_number = ++serial_number_;
 	stripe_[slot].header.metadata.uses = stripe_[slot].header.metadata.credits;
 	stripe_[slot].header.metadata.credits = 0;
+	stats_.purges++;
 	
 	if (stripe_[slot].header.metadata.segment_count >= STRIPE_SEGMENT_COUNT)
 		INFO(log_) << "No more space available in cache";
@@ -111,13 +111,18 @@ public:
 		index_t::iterator it = index.find (hash);
 		return (it != index.end () ? &it->second : 0);
 	}
+
+	bool contains (const uint64_t& hash) const
+	{
+		return (index.find (hash) != index.end ());
+	}
 	
 	void erase (const uint64_t& hash)
 	{
 		index.erase (hash);
 	}
 
-	size_t size()
+	size_t size() const
 	{
 		return index.size();
 	}
@@ -175,9 +180,13 @@ struct COSSStats
 	uint64_t lookups;
 	uint64_t found_1;
 	uint64_t found_2;
+	uint64_t loads;
+	uint64_t unloads;
+	uint64_t purges;
+	uint64_t evictions;
 	
 public:
-	COSSStats()  { lookups = found_1 = found_2 = 0; }
+	COSSStats()  { lookups = found_1 = found_2 = loads = unloads = purges = evictions = 0; }
 };
 
 
@@ -206,6 +215,8 @@ public:
 
 	virtual void enter (const uint64_t& hash, const Buffer& buf, unsigned off);
 	virtual bool lookup (const uint64_t& hash, Buffer& buf);
+	virtual bool contains (const uint64_t& hash) const;
+	virtual void statistics (XCodecCacheStatistics& stats) const;
 
 private:	
 	bool read_file ();
@@ -28,10 +28,12 @@
 
 #include <ext/hash_map>
 #include <map>
+#include <string>
 
 #include <common/buffer.h>
 #include <common/uuid/uuid.h>
 #include <xcodec/xcodec.h>
+#include <xcodec/xcodec_cache_trace.h>
 
 ////////////////////////////////////////////////////////////////////////////////
 //                                                                            //
@@ -86,11 +88,32 @@ namespace __gnu_cxx
 }
 
 
+/*
+ * Activity of the codecs working on a cache, kept here since the cache is
+ * what all the connections to one peer share.
+ */
+struct XCodecCacheCounters
+{
+	uint64_t references_;
+	uint64_t declarations_;
+	uint64_t collisions_;
+	uint64_t escapes_;
+	uint64_t asks_;
+	uint64_t learns_;
+	uint64_t answers_;
+
+	XCodecCacheCounters ()   { references_ = declarations_ = collisions_ = escapes_ = asks_ = learns_ = answers_ = 0; }
+};
+
+typedef std::map<std::string, uint64_t> XCodecCacheStatistics;
+
 class XCodecCache 
 {
 private:
 	UUID uuid_;
 	size_t size_;
+	XCodecCacheCounters counters_;
+	XCodecCacheTrace* trace_;
 #ifdef USING_XCODEC_CACHE_RECENT_WINDOW
 	struct WindowItem {uint64_t hash; const uint8_t* data;};
 	WindowItem window_[XCODEC_WINDOW_COUNT];
@@ -100,7 +123,8 @@ private:
 protected:
 	XCodecCache (const UUID& uuid, size_t size)
 	: uuid_(uuid),
-	  size_(size)
+	  size_(size),
+	  trace_(0)
 	{
 #ifdef USING_XCODEC_CACHE_RECENT_WINDOW
 		memset (window_, 0, sizeof window_);
@@ -110,7 +134,9 @@ protected:
 
 public:
 	virtual ~XCodecCache()
-	{ }
+	{
+		delete trace_;
+	}
 	
 	const UUID& identifier ()
 	{
@@ -122,8 +148,49 @@ public:
 		return size_;
 	}
 
+	XCodecCacheCounters& counters ()
+	{
+		return counters_;
+	}
+
+	virtual void statistics (XCodecCacheStatistics& stats) const
+	{
+		stats["references"] = counters_.references_;
+		stats["declarations"] = counters_.declarations_;
+		stats["collisions"] = counters_.collisions_;
+		stats["escapes"] = counters_.escapes_;
+		stats["asks"] = counters_.asks_;
+		stats["learns"] = counters_.learns_;
+		stats["answers"] = counters_.answers_;
+	}
+
+	// starts writing the trace of this cache into "<dir>/<uuid>.wpt"
+	bool trace (const std::string& dir)
+	{
+		uint8_t str[UUID_STRING_SIZE + 1];
+
+		if (trace_)
+			return true;
+		uuid_.to_string (str);
+		trace_ = new XCodecCacheTrace ();
+		if (trace_->open (dir + "/" + std::string ((const char*) str, UUID_STRING_SIZE) + ".wpt"))
+			return true;
+		delete trace_;
+		trace_ = 0;
+		return false;
+	}
+
 	virtual void enter (const uint64_t& hash, const Buffer& buf, unsigned off) = 0;
 	virtual bool lookup (const uint64_t& hash, Buffer& buf) = 0;
+	// tells whether the hash is known, without counting it as a use
+	virtual bool contains (const uint64_t& hash) const = 0;
+
+protected:
+	void note (XCodecTraceKind kind, const uint64_t& hash)
+	{
+		if (trace_)
+			trace_->record (kind, hash);
+	}
 
 #ifdef USING_XCODEC_CACHE_RECENT_WINDOW
 protected:	
@@ -185,6 +252,7 @@ public:
 		uint8_t* data = new uint8_t[XCODEC_SEGMENT_LENGTH];
 		buf.copyout (data, off, XCODEC_SEGMENT_LENGTH);
 		segment_hash_map_[hash] = data;
+		note (XCodecTraceEnter, hash);
 	}
 
 	bool lookup (const uint64_t& hash, Buffer& buf)
@@ -194,6 +262,7 @@ public:
 		if ((data = find_recent (hash)))
 		{
 			buf.append (data, XCODEC_SEGMENT_LENGTH);
+			note (XCodecTraceWindow, hash);
 			return true;
 		}
 #endif
@@ -204,10 +273,24 @@ public:
 #ifdef USING_XCODEC_CACHE_RECENT_WINDOW
 			remember (hash, it->second);
 #endif
+			note (XCodecTraceMemory, hash);
 			return true;
 		}
+		note (XCodecTraceMiss, hash);
 		return false;
 	}
+
+	bool contains (const uint64_t& hash) const
+	{
+		return (segment_hash_map_.find (hash) != segment_hash_map_.end ());
+	}
+
+	void statistics (XCodecCacheStatistics& stats) const
+	{
+		XCodecCache::statistics (stats);
+		stats["segments"] = segment_hash_map_.size ();
+		stats["memory_bytes"] = segment_hash_map_.size () * XCODEC_SEGMENT_LENGTH;
+	}
 };
 
 #endif /* !XCODEC_XCODEC_CACHE_H */
@@ -0,0 +1,94 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// File:           xcodec_cache_trace.h                                       //
+// Description:    trace of the hashes entered into and looked up in a cache  //
+// Project:        WANProxy XTech                                             //
+// Author:         Andreu Vidal Bramfeld-Software                             //
+// Last modified:  2026-10-19                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef	XCODEC_XCODEC_CACHE_TRACE_H
+#define	XCODEC_XCODEC_CACHE_TRACE_H
+
+#include <string.h>
+#include <fstream>
+#include <string>
+#include <common/endian.h>
+
+#define XCODEC_TRACE_MAGIC			"WPCTRC01"
+#define XCODEC_TRACE_RECORD_SIZE	(1 + sizeof (uint64_t))
+
+/*
+ * Each record is the kind of operation, as one byte, followed by the hash
+ * in big endian order. A lookup is recorded with the layer of the cache
+ * that satisfied it: the window of recent segments, the segments already
+ * in memory, or those that had to be read from disk. A trace is appended
+ * to when the cache is opened again, the magic being written only at the
+ * start of the file, so that it follows a persistent cache across restarts.
+ */
+
+enum XCodecTraceKind
+{
+	XCodecTraceEnter,
+	XCodecTraceMiss,
+	XCodecTraceWindow,
+	XCodecTraceMemory,
+	XCodecTraceDisk,
+	XCodecTraceKinds
+};
+
+class XCodecCacheTrace
+{
+	std::ofstream out_;
+
+public:
+	bool open (const std::string& path)
+	{
+		out_.open (path.c_str (), std::ios::out | std::ios::app | std::ios::binary);
+		if (out_.is_open () && out_.tellp () == 0)
+			out_.write (XCODEC_TRACE_MAGIC, strlen (XCODEC_TRACE_MAGIC));
+		return out_.good ();
+	}
+
+	void record (XCodecTraceKind kind, const uint64_t& hash)
+	{
+		uint8_t rec[XCODEC_TRACE_RECORD_SIZE];
+		uint64_t h = BigEndian::encode (hash);
+
+		rec[0] = (uint8_t) kind;
+		memcpy (rec + 1, &h, sizeof h);
+		out_.write ((const char*) rec, sizeof rec);
+	}
+};
+
+class XCodecCacheTraceReader
+{
+	std::ifstream in_;
+
+public:
+	bool open (const std::string& path)
+	{
+		char magic[sizeof XCODEC_TRACE_MAGIC];
+
+		in_.open (path.c_str (), std::ios::in | std::ios::binary);
+		in_.read (magic, strlen (XCODEC_TRACE_MAGIC));
+		return (in_.good () && memcmp (magic, XCODEC_TRACE_MAGIC, strlen (XCODEC_TRACE_MAGIC)) == 0);
+	}
+
+	bool next (XCodecTraceKind& kind, uint64_t& hash)
+	{
+		uint8_t rec[XCODEC_TRACE_RECORD_SIZE];
+		uint64_t h;
+
+		in_.read ((char*) rec, sizeof rec);
+		if (! in_.good () || rec[0] >= XCodecTraceKinds)
+			return false;
+		kind = (XCodecTraceKind) rec[0];
+		memcpy (&h, rec + 1, sizeof h);
+		hash = BigEndian::decode (h);
+		return true;
+	}
+};
+
+#endif /* !XCODEC_XCODEC_CACHE_TRACE_H */
@@ -0,0 +1,71 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// File:           xcodec_coordinator.cc                                      //
+// Description:    coalescing of <ASK>s among decoders sharing a peer cache   //
+// Project:        WANProxy XTech                                             //
+// Author:         Andreu Vidal Bramfeld-Software                             //
+// Last modified:  2026-10-19                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include "xcodec_filter.h"
+#include "xcodec_coordinator.h"
+
+// Registers a decoder as waiting for a hash, returns whether it has to ask for it
+
+bool XCodecLearnCoordinator::request (uint64_t hash, DecodeFilter* filter)
+{
+	LearnRequest& req = requests_[hash];
+	req.waiters_.insert (filter);
+	if (req.asker_)
+	{
+		DEBUG(log_) << "Joining outstanding <ASK> for hash: " << hash;
+		return false;
+	}
+	req.asker_ = filter;
+	return true;
+}
+
+// Wakes up all the other decoders that were waiting for a hash just learned
+
+void XCodecLearnCoordinator::learned (uint64_t hash, DecodeFilter* filter)
+{
+	std::map<uint64_t, LearnRequest>::iterator it = requests_.find (hash);
+	if (it == requests_.end ())
+		return;
+
+	std::vector<DecodeFilter*> waiters (it->second.waiters_.begin (), it->second.waiters_.end ());
+	requests_.erase (it);
+
+	std::vector<DecodeFilter*>::iterator w;
+	for (w = waiters.begin (); w != waiters.end (); ++w)
+		if (*w != filter)
+			(*w)->resume (hash);
+}
+
+// Removes a decoder, handing its outstanding <ASK>s over to another waiter
+
+void XCodecLearnCoordinator::withdraw (DecodeFilter* filter)
+{
+	std::map<uint64_t, LearnRequest>::iterator it = requests_.begin ();
+	while (it != requests_.end ())
+	{
+		LearnRequest& req = it->second;
+		req.waiters_.erase (filter);
+		if (req.waiters_.empty ())
+		{
+			requests_.erase (it++);
+			continue;
+		}
+		if (req.asker_ == filter)
+		{
+			req.asker_ = 0;
+			std::set<DecodeFilter*>::iterator w;
+			for (w = req.waiters_.begin (); w != req.waiters_.end () && ! req.asker_; ++w)
+				if ((*w)->reask (it->first))
+					req.asker_ = *w;
+		}
+		++it;
+	}
+}
@@ -0,0 +1,48 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// File:           xcodec_coordinator.h                                       //
+// Description:    coalescing of <ASK>s among decoders sharing a peer cache   //
+// Project:        WANProxy XTech                                             //
+// Author:         Andreu Vidal Bramfeld-Software                             //
+// Last modified:  2026-10-19                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef	XCODEC_COORDINATOR_H
+#define	XCODEC_COORDINATOR_H
+
+#include <map>
+#include <set>
+#include <common/log.h>
+
+class DecodeFilter;
+
+/*
+ * All the connections coming from the same peer decode against the same
+ * cache, so when a segment is missing it is usually missing for all of them.
+ * Only the first decoder that stumbles on an unknown hash sends the <ASK>;
+ * the others just wait and are woken up as soon as the <LEARN> arrives.
+ */
+
+class XCodecLearnCoordinator
+{
+	struct LearnRequest
+	{
+		DecodeFilter* asker_;
+		std::set<DecodeFilter*> waiters_;
+
+		LearnRequest () { asker_ = 0; }
+	};
+
+	LogHandle log_;
+	std::map<uint64_t, LearnRequest> requests_;
+
+public:
+	XCodecLearnCoordinator () : log_("/xcodec/coordinator") { }
+
+	bool request (uint64_t hash, DecodeFilter* filter);
+	void learned (uint64_t hash, DecodeFilter* filter);
+	void withdraw (DecodeFilter* filter);
+};
+
+#endif /* !XCODEC_COORDINATOR_H */
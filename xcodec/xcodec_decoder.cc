@@ -44,7 +44,8 @@
 
 XCodecDecoder::XCodecDecoder(XCodecCache* cache)
 : log_("/xcodec/decoder"),
-  cache_(cache)
+  cache_(cache),
+  referenced_(0)
 { }
 
 XCodecDecoder::~XCodecDecoder()
@@ -150,6 +151,11 @@ bool XCodecDecoder::decode (Buffer& output, Buffer& input, std::set<uint64_t>& u
 			if (cache_->lookup (hash, output))
 			{
 				input.skip (sizeof XCODEC_MAGIC + sizeof op + sizeof behash);
+				if (referenced_ && referenced_->find (hash) == referenced_->end ())
+				{
+					output.copyout (data, output.length () - XCODEC_SEGMENT_LENGTH, XCODEC_SEGMENT_LENGTH);
+					(*referenced_)[hash].append (data, XCODEC_SEGMENT_LENGTH);
+				}
 			}
 			else
 			{
@@ -26,6 +26,7 @@
 #ifndef	XCODEC_XCODEC_DECODER_H
 #define	XCODEC_XCODEC_DECODER_H
 
+#include <map>
 #include <set>
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -43,12 +44,14 @@ class XCodecCache;
 class XCodecDecoder {
 	LogHandle log_;
 	XCodecCache* cache_;
+	std::map<uint64_t, Buffer>* referenced_;
 
 public:
 	XCodecDecoder(XCodecCache*);
 	~XCodecDecoder();
 
 	bool decode (Buffer&, Buffer&, std::set<uint64_t>&);
+	void witness (std::map<uint64_t, Buffer>* referenced)   { referenced_ = referenced; }
 };
 
 #endif /* !XCODEC_XCODEC_DECODER_H */
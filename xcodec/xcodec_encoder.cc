@@ -105,10 +105,12 @@ void XCodecEncoder::encode (Buffer& output, Buffer& input)
 
 				/*
 				 * Now attempt to encode this hash as a reference if it
-				 * has been defined before.
+				 * has been defined before. Most offsets hash to nothing
+				 * known, so the index is asked first and only a hash
+				 * found there is looked up, and counted as a use.
 				 */
 				
-				if (cache_->lookup (hash, old))
+				if (cache_->contains (hash) && cache_->lookup (hash, old))
 				{
 					/*
 					 * This segment already exists.  If it's
@@ -134,6 +136,7 @@ void XCodecEncoder::encode (Buffer& output, Buffer& input)
 						 * viable.
 						 */
 						DEBUG(log_) << "Collision in first pass.";
+						cache_->counters().collisions_++;
 					}
 					
 					old.clear ();
@@ -205,11 +208,33 @@ void XCodecEncoder::encode_declaration (Buffer& output, Buffer& input, unsigned
 	if (start > 0)
 		encode_escape (output, input, start);
 		
-	cache_->enter (hash, input, 0);
+	/*
+	 * Another encoder sharing the cache may have declared this segment while
+	 * it was pending here, the peer just takes a repeated declaration as
+	 * redundant unless the hash now names different data. Only then is the
+	 * segment read back, the common case costing no lookup of its own.
+	 */
+	Buffer old;
+	if (! cache_->contains (hash) || ! cache_->lookup (hash, old))
+	{
+		cache_->enter (hash, input, 0);
+	}
+	else
+	{
+		uint8_t data[XCODEC_SEGMENT_LENGTH];
+		input.copyout (data, XCODEC_SEGMENT_LENGTH);
+		if (! old.equal (data, sizeof data))
+		{
+			encode_escape (output, input, XCODEC_SEGMENT_LENGTH);
+			return;
+		}
+	}
 	
 	output.append (XCODEC_MAGIC);
 	output.append (XCODEC_OP_EXTRACT);
 	output.append (input, XCODEC_SEGMENT_LENGTH);
+	cache_->counters().declarations_++;
+	note (hash);
 	
 	input.skip (XCODEC_SEGMENT_LENGTH);
 }
@@ -226,6 +251,7 @@ void XCodecEncoder::encode_escape (Buffer& output, Buffer& input, unsigned lengt
 				output.append (input, 0, pos);
 			output.append (XCODEC_MAGIC);
 			output.append (XCODEC_OP_ESCAPE);
+			cache_->counters().escapes_++;
 			input.skip (pos + 1);
 			length -= pos + 1;
 		}
@@ -252,9 +278,31 @@ bool XCodecEncoder::encode_reference (Buffer& output, Buffer& input, unsigned st
 		output.append (XCODEC_OP_REF);
 		uint64_t behash = BigEndian::encode (hash);
 		output.append (&behash);
+		cache_->counters().references_++;
+		note (hash);
 		input.skip (XCODEC_SEGMENT_LENGTH);
 		return true;
 	}
 	
 	return false;
 }
+
+/*
+ * Keeps the last segments sent in this stream, whether declared or
+ * referenced, so that once the peer has acknowledged the whole stream
+ * they are known to be in its cache.
+ */
+
+void XCodecEncoder::note (uint64_t hash)
+{
+	for (std::deque<uint64_t>::iterator it = recent_.begin (); it != recent_.end (); ++it)
+		if (*it == hash)
+		{
+			recent_.erase (it);
+			break;
+		}
+	
+	recent_.push_back (hash);
+	if (recent_.size () > XCODEC_ENCODER_RECENT)
+		recent_.pop_front ();
+}
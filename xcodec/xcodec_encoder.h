@@ -26,6 +26,7 @@
 #ifndef	XCODEC_XCODEC_ENCODER_H
 #define	XCODEC_XCODEC_ENCODER_H
 
+#include <deque>
 #include <xcodec/xcodec_hash.h>
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -38,6 +39,8 @@
 //                                                                            //
 ////////////////////////////////////////////////////////////////////////////////
 
+#define	XCODEC_ENCODER_RECENT	16
+
 class XCodecCache;
 
 class XCodecEncoder 
@@ -48,6 +51,7 @@ class XCodecEncoder
 	XCodecHash xcodec_hash_;
 	int candidate_start_;
 	uint64_t candidate_symbol_;
+	std::deque<uint64_t> recent_;
 
 public:
 	XCodecEncoder(XCodecCache*);
@@ -56,7 +60,10 @@ public:
 	void encode (Buffer&, Buffer&);
 	bool flush (Buffer&);
 	
+	const std::deque<uint64_t>& recent () const { return recent_; }
+	
 private:
+	void note (uint64_t);
 	void encode_declaration (Buffer&, Buffer&, unsigned, uint64_t);
 	void encode_escape (Buffer&, Buffer&, unsigned);
 	bool encode_reference (Buffer&, Buffer&, unsigned, uint64_t, Buffer&);
@@ -117,6 +117,52 @@
 
 #define	XCODEC_PIPE_MAX_FRAME	(32768)
 
+/*
+ * Usage:
+ * 	<RAW> length[uint16_t] data[uint8_t x length]
+ *
+ * Effects:
+ * 	The `data' is inserted into the output stream as is, after any
+ * 	frame data preceding it.
+ *
+ * Side-effects:
+ * 	None.
+ */
+#define	XCODEC_PIPE_OP_RAW	((uint8_t)0xfa)
+
+/*
+ * Usage:
+ * 	<OP_STANDBY>
+ *
+ * Effects:
+ * 	The connection is kept idle in a pool until a client is handed over,
+ * 	so the other party need not open its side of the path yet.
+ *
+ * Side-effects:
+ * 	An <OP_WAKE> will follow when the connection is put to use.
+ */
+#define	XCODEC_PIPE_OP_STANDBY	((uint8_t)0xf9)
+
+/*
+ * Usage:
+ * 	<OP_WAKE>
+ *
+ * Effects:
+ * 	A connection announced by <OP_STANDBY> is now in use.
+ *
+ * Side-effects:
+ * 	None.
+ */
+#define	XCODEC_PIPE_OP_WAKE	((uint8_t)0xf8)
+
+/*
+ * A run of small inputs arriving at a human or request/response pace marks
+ * an interactive stream, whose messages gain nothing from hashing.
+ */
+#define	XCODEC_INTERACTIVE_SIZE	1024
+#define	XCODEC_INTERACTIVE_RUN	4
+#define	XCODEC_INTERACTIVE_GAP	2000
+
 // Encoding
 
 bool EncodeFilter::consume (Buffer& buf, int flg)
@@ -125,44 +171,70 @@ bool EncodeFilter::consume (Buffer& buf, int flg)
 
 	ASSERT(log_, ! flushing_);
 
-	if (! encoder_) 
-   {
-		if (! cache_ || ! cache_->identifier().is_valid ()) 
-      {
-			ERROR(log_) << "Could not encode UUID for <HELLO>.";
-			return false;
-		}
-		
-		output.append (XCODEC_PIPE_OP_HELLO);
-		uint64_t mb = cache_->nominal_size ();
-		output.append ((uint8_t) (UUID_STRING_SIZE + sizeof mb));
-		cache_->identifier().encode (output);
-		output.append (&mb);
+	if (! encoder_ && ! hello (output))
+		return false;
 
-		if (! (encoder_ = new XCodecEncoder (cache_)))
-			return false;
+	pace (buf.length ());
+	if (interactive_ && buf.length () < XCODEC_INTERACTIVE_SIZE)
+	{
+		if (wait_action_)
+			wait_action_->cancel (), wait_action_ = 0;
+		if (encoder_->flush (enc))
+			while (! enc.empty ())
+				encode_frame (enc, output);
+		while (! buf.empty ())
+			encode_raw (buf, output);
+		trace (TraceEncode, output.length (), 1);
+		return produce (output, flg);
 	}
 
 	encoder_->encode (enc, buf);
 	
 	if (! (flg & TO_BE_CONTINUED))
 	{
-		if (waiting_)
-		{
-			if (wait_action_)
-				wait_action_->cancel ();
-			wait_action_ = event_system.track (150, StreamModeWait, callback (this, &EncodeFilter::on_read_timeout));
-		}
+		int delay = (waiting_ ? flush_delay () : 0);
+		if (wait_action_)
+			wait_action_->cancel (), wait_action_ = 0;
+		if (delay > 0)
+			wait_action_ = event_system.track (delay, StreamModeWait, callback (this, &EncodeFilter::on_read_timeout));
 		else
 			encoder_->flush (enc);
 	}
 	
 	while (! enc.empty ())
 		encode_frame (enc, output);
+	if (! output.empty ())
+		trace (TraceEncode, output.length ());
    
    return (! output.empty () ? produce (output, flg) : true);
 }
 	
+/*
+ * The greeting goes out as soon as the connection is up, not with the first
+ * data, so that the peer knows at once whether to open its side of the path.
+ * It is no input of the stream and leaves its pace alone.
+ */
+bool EncodeFilter::greet (bool standby)
+{
+	Buffer output;
+
+	if (encoder_)
+		return true;
+	if (! hello (output))
+		return false;
+	if (standby)
+		output.append (XCODEC_PIPE_OP_STANDBY);
+	return produce (output);
+}
+
+bool EncodeFilter::wake ()
+{
+	Buffer output;
+
+	output.append (XCODEC_PIPE_OP_WAKE);
+	return produce (output);
+}
+
 void EncodeFilter::flush (int flg)
 {
 	if (flg == XCODEC_PIPE_OP_EOS_ACK)
@@ -186,6 +258,36 @@ void EncodeFilter::flush (int flg)
 		Filter::flush (flush_flags_);
 }
 
+/*
+ * The peer has processed the whole stream, so every segment sent in it is
+ * now in its cache and may serve as compression dictionary. A stream
+ * started with such a dictionary and never acknowledged may mean that the
+ * peer lost its cache, so the dictionary is dropped until confirmed again.
+ */
+void EncodeFilter::confirm ()
+{
+	confirmed_ = true;
+	if (codec_ && codec_->compressor_dictionary_ && encoder_)
+		codec_->confirm (encoder_->recent ());
+}
+
+bool EncodeFilter::hello (Buffer& trg)
+{
+	if (! cache_ || ! cache_->identifier().is_valid ()) 
+	{
+		ERROR(log_) << "Could not encode UUID for <HELLO>.";
+		return false;
+	}
+	
+	trg.append (XCODEC_PIPE_OP_HELLO);
+	uint64_t mb = cache_->nominal_size ();
+	trg.append ((uint8_t) (UUID_STRING_SIZE + sizeof mb));
+	cache_->identifier().encode (trg);
+	trg.append (&mb);
+
+	return ((encoder_ = new XCodecEncoder (cache_)) != 0);
+}
+
 void EncodeFilter::encode_frame (Buffer& src, Buffer& trg)
 {
 	int n = src.length ();
@@ -202,15 +304,87 @@ void EncodeFilter::encode_frame (Buffer& src, Buffer& trg)
 	src.skip (n);
 }
 
+/*
+ * Holding back the tail of a burst lets the next data complete its chunk,
+ * but it is only worth it while data keeps arriving in quick succession.
+ * The wait is twice the usual gap between inputs, and no wait at all when
+ * that exceeds the codec's limit or a quarter of the peer's round trip,
+ * as happens with interactive traffic.
+ */
+int EncodeFilter::flush_delay ()
+{
+	intmax_t limit = (codec_ ? codec_->flush_wait_ * 1000 : 0);
+
+	if (codec_ && codec_->round_trip_ > 0 && codec_->round_trip_ / 4 < limit)
+		limit = codec_->round_trip_ / 4;
+
+	// nothing known yet about this stream
+	if (gap_ < 0)
+		return (int) (limit / 1000);
+	if (gap_ * 2 > limit)
+		return 0;
+	return (gap_ * 2 < 1000 ? 1 : (int) (gap_ * 2 / 1000));
+}
+
+/*
+ * Keeps the average gap between inputs, in microseconds, and tells
+ * interactive streams from bulk ones when the codec allows passing small
+ * messages through. Any larger input brings the stream back to encoding.
+ */
+void EncodeFilter::pace (size_t len)
+{
+	NanoTime now = NanoTime::current_time ();
+	intmax_t gap;
+
+	if (last_input_.seconds_ > 0)
+	{
+		gap = (intmax_t) (now.seconds_ - last_input_.seconds_) * 1000000 + ((intmax_t) now.nanoseconds_ - (intmax_t) last_input_.nanoseconds_) / 1000;
+		gap_ = (gap_ < 0 ? gap : (gap_ * 3 + gap) / 4);
+	}
+	last_input_ = now;
+
+	if (! codec_ || ! codec_->interactive_)
+		return;
+	small_ = (len < XCODEC_INTERACTIVE_SIZE ? small_ + 1 : 0);
+	if (! interactive_ && small_ >= XCODEC_INTERACTIVE_RUN && gap_ >= XCODEC_INTERACTIVE_GAP)
+	{
+		DEBUG(log_) << "Stream looks interactive, passing small messages through.";
+		interactive_ = true;
+	}
+	else if (interactive_ && small_ == 0)
+	{
+		DEBUG(log_) << "Stream carries bulk data, encoding again.";
+		interactive_ = false;
+	}
+}
+
+void EncodeFilter::encode_raw (Buffer& src, Buffer& trg)
+{
+	int n = src.length ();
+	if (n > XCODEC_PIPE_MAX_FRAME)
+		n = XCODEC_PIPE_MAX_FRAME;
+
+	uint16_t len = n;
+	len = BigEndian::encode (len);
+
+	trg.append (XCODEC_PIPE_OP_RAW);
+	trg.append (&len);
+	trg.append (src, n);
+	
+	src.skip (n);
+}
+
 void EncodeFilter::on_read_timeout (Event e)
 {
 	if (wait_action_)
 		wait_action_->cancel (), wait_action_ = 0;
 
 	Buffer enc, output;
+	trace (TraceTimer);
 	if (! flushing_ && encoder_ && encoder_->flush (enc))
 	{
 		encode_frame (enc, output);
+		trace (TraceEncode, output.length ());
 		produce (output);
 	}
 }
@@ -218,12 +392,21 @@ void EncodeFilter::on_read_timeout (Event e)
 // Decoding
 	
 bool DecodeFilter::consume (Buffer& buf, int flg)
+{
+	bool ok = decode_input (buf, flg);
+	weigh ();
+	return ok;
+}
+
+bool DecodeFilter::decode_input (Buffer& buf, int flg)
 {
    if (! upstream_) 
    {
 		ERROR(log_) << "Decoder not configured";
       return false;
    }
+   if (failed_)
+		return false;
    
 	pending_.append (buf);
 
@@ -266,10 +449,15 @@ bool DecodeFilter::consume (Buffer& buf, int flg)
 
 				if (! (decoder_cache_ = wanproxy.find_cache (uuid)))
 					decoder_cache_ = wanproxy.add_cache (codec_->cache_type_, codec_->cache_path_, mb, uuid);
+				if (decoder_cache_ && ! codec_->cache_trace_.empty ())
+					decoder_cache_->trace (codec_->cache_trace_);
 
 		      ASSERT(log_, decoder_ == NULL);
 				if (decoder_cache_)
 					decoder_ = new XCodecDecoder (decoder_cache_);
+				if (decoder_)
+					decoder_->witness (referenced_);
+				coordinator_ = wanproxy.find_coordinator (uuid);
 
 		      DEBUG(log_) << "Peer connected with UUID: " << uuid;
 			}
@@ -296,6 +484,8 @@ bool DecodeFilter::consume (Buffer& buf, int flg)
 		      if (encoder_cache_->lookup (hash, learn))
 				{
 					DEBUG(log_) << "Responding to <ASK> with <LEARN>.";
+					encoder_cache_->counters().answers_++;
+					trace (TraceAnswer);
 					if (! upstream_->produce (learn))
 						return false;
 				}
@@ -347,6 +537,10 @@ bool DecodeFilter::consume (Buffer& buf, int flg)
 		         decoder_cache_->enter (hash, pending_, 0);
 		      }
 		      pending_.skip (XCODEC_SEGMENT_LENGTH);
+				decoder_cache_->counters().learns_++;
+				trace (TraceLearn);
+				if (coordinator_)
+					coordinator_->learned (hash, this);
 		   }
 			break;
          
@@ -370,6 +564,16 @@ bool DecodeFilter::consume (Buffer& buf, int flg)
 			received_eos_ack_ = true;
 			break;
          
+		case XCODEC_PIPE_OP_STANDBY:
+			pending_.skip (sizeof op);
+			standby_ = true;
+			break;
+         
+		case XCODEC_PIPE_OP_WAKE:
+			pending_.skip (sizeof op);
+			standby_ = false;
+			break;
+         
 		case XCODEC_PIPE_OP_FRAME:
 			if (! decoder_) 
          {
@@ -396,65 +600,136 @@ bool DecodeFilter::consume (Buffer& buf, int flg)
 		   }
 			break;
          
+		case XCODEC_PIPE_OP_RAW:
+			{
+		      uint16_t len;
+		      if (pending_.length() < sizeof op + sizeof len)
+		         return true;
+		         
+		      pending_.extract (&len, sizeof op);
+		      len = BigEndian::decode (len);
+		      if (len == 0 || len > XCODEC_PIPE_MAX_FRAME) 
+		      {
+		         ERROR(log_) << "Invalid raw data length.";
+		         return false;
+		      }
+		      if (pending_.length() < sizeof op + sizeof len + len)
+		         return true;
+
+				Buffer raw;
+		      pending_.moveout (&raw, sizeof op + sizeof len, len);
+				if (frame_buffer_.empty () && unknown_hashes_.empty ())
+				{
+					trace (TraceDecode, raw.length (), 1);
+					if (! produce (raw, flg))
+						return false;
+				}
+				else
+					escape (raw, frame_buffer_);
+		   }
+			break;
+         
 		default:
 			ERROR(log_) << "Unsupported operation in pipe stream.";
 			return false;
 		}
 
-		if (frame_buffer_.empty ()) 
-			continue;
+		if (! decode_frames (flg))
+			return false;
+	}
 
-		if (! unknown_hashes_.empty ()) 
-      {
-			DEBUG(log_) << "Waiting for unknown hashes to continue processing data.";
-			continue;
-		}
+	return conclude_stream ();
+}
 
-		Buffer output;
-		if (! decoder_->decode (output, frame_buffer_, unknown_hashes_)) 
-      {
-			ERROR(log_) << "Decoder exiting with error.";
+bool DecodeFilter::decode_frames (int flg)
+{
+	if (frame_buffer_.empty ()) 
+		return true;
+
+	if (! unknown_hashes_.empty ()) 
+   {
+		DEBUG(log_) << "Waiting for unknown hashes to continue processing data.";
+		return true;
+	}
+
+	Buffer output;
+	if (! decoder_->decode (output, frame_buffer_, unknown_hashes_)) 
+   {
+		ERROR(log_) << "Decoder exiting with error.";
+		return false;
+	}
+
+	if (! output.empty ()) 
+   {
+		ASSERT(log_, ! flushing_);
+		trace (TraceDecode, output.length ());
+		if (! produce (output, flg))
 			return false;
-		}
+	} 
+   else 
+   {
+		/*
+		 * We should only get no output from the decoder if
+		 * we're waiting on the next frame or we need an
+		 * unknown hash.  It would be nice to make the
+		 * encoder framing aware so that it would not end
+		 * up with encoded data that straddles a frame
+		 * boundary.  (Fixing that would also allow us to
+		 * simplify length checking within the decoder
+		 * considerably.)
+		 */
+		ASSERT(log_, !frame_buffer_.empty() || !unknown_hashes_.empty());
+	}
 
-		if (! output.empty ()) 
-      {
-			ASSERT(log_, ! flushing_);
-			if (! produce (output, flg))
-				return false;
-		} 
-      else 
-      {
-			/*
-			 * We should only get no output from the decoder if
-			 * we're waiting on the next frame or we need an
-			 * unknown hash.  It would be nice to make the
-			 * encoder framing aware so that it would not end
-			 * up with encoded data that straddles a frame
-			 * boundary.  (Fixing that would also allow us to
-			 * simplify length checking within the decoder
-			 * considerably.)
-			 */
-			ASSERT(log_, !frame_buffer_.empty() || !unknown_hashes_.empty());
-		}
+	/*
+	 * Hashes already asked for by another connection to the same peer
+	 * are not asked again, the coordinator will wake us up when learned.
+	 */
+	Buffer ask;
+	std::set<uint64_t>::const_iterator it;
+	for (it = unknown_hashes_.begin(); it != unknown_hashes_.end(); ++it) 
+   {
+		if (coordinator_ && ! coordinator_->request (*it, this))
+			continue;
+		uint64_t hash = *it;
+		hash = BigEndian::encode (hash);
+		ask.append (XCODEC_PIPE_OP_ASK);
+		ask.append (&hash);
+		decoder_cache_->counters().asks_++;
+	}
+	if (! ask.empty ()) 
+   {
+		DEBUG(log_) << "Sending <ASK>s.";
+		trace (TraceAsk, ask.length () / (1 + sizeof (uint64_t)));
+		if (! upstream_->produce (ask))
+			return false;
+	}
+	
+	return true;
+}
 
-		Buffer ask;
-		std::set<uint64_t>::const_iterator it;
-		for (it = unknown_hashes_.begin(); it != unknown_hashes_.end(); ++it) 
-      {
-			uint64_t hash = *it;
-			hash = BigEndian::encode (hash);
-			ask.append (XCODEC_PIPE_OP_ASK);
-			ask.append (&hash);
-		}
-		if (! ask.empty ()) 
-      {
-			DEBUG(log_) << "Sending <ASK>s.";
-			if (! upstream_->produce (ask))
-				return false;
-		}
+/*
+ * Raw data behind frames still waiting to be decoded is queued after them
+ * in encoded form, where only the magic byte needs escaping.
+ */
+void DecodeFilter::escape (Buffer& src, Buffer& trg)
+{
+	const uint8_t esc[2] = {XCODEC_MAGIC, XCODEC_OP_ESCAPE};
+	unsigned pos;
+
+	while (src.find (XCODEC_MAGIC, &pos))
+	{
+		if (pos > 0)
+			trg.append (src, pos);
+		trg.append (esc, sizeof esc);
+		src.skip (pos + 1);
 	}
+	if (! src.empty ())
+		trg.append (src);
+}
 
+bool DecodeFilter::conclude_stream ()
+{
    if (received_eos_ && ! sent_eos_ack_ && frame_buffer_.empty ()) 
    {
       DEBUG(log_) << "Decoder received <EOS>, sending <EOS_ACK>.";
@@ -505,12 +780,76 @@ bool DecodeFilter::consume (Buffer& buf, int flg)
 		DEBUG(log_) << "Decoder finished, got <EOS_ACK>, shutting down encoder output channel.";
 
 		upflushed_ = true;
+		static_cast<EncodeFilter*> (upstream_)->confirm ();
       upstream_->flush (XCODEC_PIPE_OP_EOS_ACK);
 	}
 	
 	return true;
 }
 
+void DecodeFilter::resume (uint64_t hash)
+{
+	if (flushing_ || failed_ || ! unknown_hashes_.erase (hash))
+		return;
+		
+	DEBUG(log_) << "Hash learned elsewhere, resuming.";
+	
+	if (! decode_frames (0) || ! conclude_stream ())
+	{
+		ERROR(log_) << "Could not resume decoding, closing connection.";
+		failed_ = true;
+		weigh ();
+		flush (FILTER_ABORT);
+		return;
+	}
+	weigh ();
+}
+
+bool DecodeFilter::reask (uint64_t hash)
+{
+	if (flushing_ || failed_ || ! upstream_)
+		return false;
+		
+	DEBUG(log_) << "Taking over <ASK> from a closed connection.";
+	
+	Buffer ask;
+	hash = BigEndian::encode (hash);
+	ask.append (XCODEC_PIPE_OP_ASK);
+	ask.append (&hash);
+	if (decoder_cache_)
+		decoder_cache_->counters().asks_++;
+	trace (TraceAsk, 1, 1);
+	return upstream_->produce (ask);
+}
+
+/*
+ * A segment handed in from outside the stream, as a replay does with those
+ * captured along with it, is entered like a <LEARN> and lets decoding go on
+ * if it was waiting for it.
+ */
+void DecodeFilter::learn (const Buffer& segment)
+{
+	uint8_t data[XCODEC_SEGMENT_LENGTH];
+	Buffer old;
+
+	if (! decoder_cache_ || segment.length () != XCODEC_SEGMENT_LENGTH)
+		return;
+
+	segment.copyout (data, sizeof data);
+	uint64_t hash = XCodecHash::hash (data);
+	if (! decoder_cache_->lookup (hash, old))
+		decoder_cache_->enter (hash, segment, 0);
+	resume (hash);
+}
+
+// the segments found in the cache are added to the given map, by hash
+void DecodeFilter::witness (std::map<uint64_t, Buffer>* referenced)
+{
+	referenced_ = referenced;
+	if (decoder_)
+		decoder_->witness (referenced_);
+}
+
 void DecodeFilter::flush (int flg)
 {
 	flushing_ = true;
@@ -519,8 +858,28 @@ void DecodeFilter::flush (int flg)
 		DEBUG(log_) << "Flushing decoder with data outstanding.";
 	if (! frame_buffer_.empty ())
 		DEBUG(log_) << "Flushing decoder with frame data outstanding.";
+	if (coordinator_)
+		coordinator_->withdraw (this), coordinator_ = 0;
 	if (! upflushed_ && upstream_)
       upflushed_ = true, upstream_->flush (XCODEC_PIPE_OP_EOS_ACK);
+	if (awaiting_)
+		awaiting_ = false, account ()->await (false);
 	Filter::flush (flush_flags_);
 }
 
+/*
+ * What is kept while waiting for unknown segments is charged to the chain,
+ * which however must not stop reading, since the <LEARN> that will let the
+ * decoder go on comes the same way. The pending input is never charged, it
+ * is at most an unfinished frame and only more input can drain it.
+ */
+
+void DecodeFilter::weigh ()
+{
+	bool awaiting = (! unknown_hashes_.empty () && ! flushing_);
+	
+	if (account () && awaiting != awaiting_)
+		awaiting_ = awaiting, account ()->await (awaiting);
+	hold (held_, frame_buffer_.length ());
+}
+
@@ -11,8 +11,10 @@
 #ifndef	XCODEC_FILTER_H
 #define	XCODEC_FILTER_H
 
+#include <map>
 #include <set>
 #include <common/filter.h>
+#include <common/time/time.h>
 #include <event/event.h>
 #include <event/action.h>
 #include <xcodec/xcodec.h>
@@ -20,6 +22,7 @@
 #include <xcodec/xcodec_hash.h>
 #include <xcodec/xcodec_encoder.h>
 #include <xcodec/xcodec_decoder.h>
+#include <xcodec/xcodec_coordinator.h>
 #include <proxy/wanproxy.h>
 
 class EncodeFilter : public BufferedFilter
@@ -29,29 +32,46 @@ private:
 	XCodecCache* cache_;
 	XCodecEncoder* encoder_;
 	Action* wait_action_;
+	NanoTime last_input_;
+	intmax_t gap_;
+	unsigned small_;
+	bool interactive_;
 	bool waiting_;
 	bool sent_eos_;
 	bool eos_ack_;
+	bool primed_;
+	bool confirmed_;
    
 public:
 	EncodeFilter (const LogHandle& log, WANProxyCodec* cdc, int flg = 0) : BufferedFilter (log) 
 	{ 
 		codec_ = cdc; cache_ = (cdc ? cdc->xcache_ : 0); encoder_ = 0; 
-		wait_action_ = 0; waiting_ = (flg & 1); sent_eos_ = eos_ack_ = false;
+		wait_action_ = 0; gap_ = -1; small_ = 0; interactive_ = false; waiting_ = (flg & 1); sent_eos_ = eos_ack_ = false;
+		primed_ = (cdc && cdc->compressor_dictionary_ && ! cdc->dictionary_.empty ()); confirmed_ = false;
 	}
 	
 	virtual ~EncodeFilter ()  
 	{ 
 		if (wait_action_)
 			wait_action_->cancel ();
+		if (primed_ && ! confirmed_)
+			codec_->dictionary_.clear ();
 		delete encoder_; 
 	}
   
    virtual bool consume (Buffer& buf, int flg = 0);
    virtual void flush (int flg);
 	
+	bool greet (bool standby = false);
+	bool wake ();
+	void confirm ();
+	
 private:
+	bool hello (Buffer& trg);
 	void encode_frame (Buffer& src, Buffer& trg);
+	void encode_raw (Buffer& src, Buffer& trg);
+	int flush_delay ();
+	void pace (size_t len);
 	void on_read_timeout (Event e);
 };
 
@@ -62,27 +82,51 @@ private:
 	XCodecCache* encoder_cache_;
 	XCodecDecoder* decoder_;
 	XCodecCache* decoder_cache_;
+	XCodecLearnCoordinator* coordinator_;
 	std::set<uint64_t> unknown_hashes_;
+	std::map<uint64_t, Buffer>* referenced_;
 	Buffer frame_buffer_;
+	intmax_t held_;
+	bool awaiting_;
 	bool received_eos_;
 	bool sent_eos_ack_;
 	bool received_eos_ack_;
 	bool upflushed_;
+	bool failed_;
+	bool standby_;
    
 public:
 	DecodeFilter (const LogHandle& log, WANProxyCodec* cdc) : LogisticFilter (log) 
    { 
-      codec_ = cdc; encoder_cache_ = (cdc ? cdc->xcache_ : 0); decoder_ = 0; decoder_cache_ = 0;   
-      received_eos_ = sent_eos_ack_ = received_eos_ack_ = upflushed_ = false; 
+      codec_ = cdc; encoder_cache_ = (cdc ? cdc->xcache_ : 0); decoder_ = 0; decoder_cache_ = 0; coordinator_ = 0; referenced_ = 0;
+      held_ = 0; awaiting_ = false; received_eos_ = sent_eos_ack_ = received_eos_ack_ = upflushed_ = failed_ = standby_ = false; 
    }
 	
 	~DecodeFilter ()  
 	{ 
+		if (coordinator_)
+			coordinator_->withdraw (this);
+		if (awaiting_)
+			account ()->await (false);
+		hold (held_, 0);
 		delete decoder_; 
 	}
   
    virtual bool consume (Buffer& buf, int flg = 0);
    virtual void flush (int flg);
+	
+	bool standby () const   { return standby_; }
+	void resume (uint64_t hash);
+	bool reask (uint64_t hash);
+	void learn (const Buffer& segment);
+	void witness (std::map<uint64_t, Buffer>* referenced);
+	
+private:
+	bool decode_input (Buffer& buf, int flg);
+	bool decode_frames (int flg);
+	void escape (Buffer& src, Buffer& trg);
+	bool conclude_stream ();
+	void weigh ();
 };
 
 #endif /* !XCODEC_FILTER_H */
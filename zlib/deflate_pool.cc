@@ -0,0 +1,492 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// File:           deflate_pool.cc                                            //
+// Description:    block-parallel deflate on a pool of worker threads         //
+// Project:        WANProxy XTech                                             //
+// Author:         Andreu Vidal Bramfeld-Software                             //
+// Last modified:  2026-10-19                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/errno.h>
+#include <event/event_system.h>
+#include <zlib/deflate_pool.h>
+
+/*
+ * A single deflate stream keeps one core busy at most, which on fast links
+ * becomes the limit of a bulk transfer. Following the same idea as pigz,
+ * each block of input is compressed on its own by a worker thread, using
+ * the 32 KB before it as dictionary, and ended with a sync flush so the
+ * results can be joined in order into one raw deflate stream. The matches
+ * lost at the block edges cost little next to the blocks' size.
+ */
+
+// Worker
+
+DeflateWorker::DeflateWorker (DeflatePool* pool) : Thread ("DeflateWorker"), pool_(pool)
+{
+	stream_.zalloc = Z_NULL;
+	stream_.zfree = Z_NULL;
+	stream_.opaque = Z_NULL;
+	if (deflateInit2 (&stream_, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		stream_.state = Z_NULL;
+}
+
+DeflateWorker::~DeflateWorker ()
+{
+	if (stream_.state)
+		deflateEnd (&stream_);
+}
+
+void DeflateWorker::main ()
+{
+	DeflateJob* job;
+
+	while ((job = pool_->next ()))
+	{
+		compress (job);
+		pool_->finish (job);
+	}
+}
+
+void DeflateWorker::compress (DeflateJob* job)
+{
+	size_t size = deflateBound (&stream_, job->length_) + 64;
+
+	job->failed_ = true;
+	if (! stream_.state || deflateReset (&stream_) != Z_OK || deflateParams (&stream_, job->level_, Z_DEFAULT_STRATEGY) != Z_OK)
+		return;
+	if (job->dictionary_length_ > 0 && deflateSetDictionary (&stream_, job->dictionary_, job->dictionary_length_) != Z_OK)
+		return;
+
+	job->output_ = new uint8_t[size];
+	stream_.next_in = job->input_;
+	stream_.avail_in = job->length_;
+	stream_.next_out = job->output_;
+	stream_.avail_out = size;
+
+	// the bound leaves room for everything, so a single call must do
+	if (deflate (&stream_, Z_SYNC_FLUSH) != Z_OK || stream_.avail_in > 0 || stream_.avail_out == 0)
+		return;
+
+	job->output_length_ = size - stream_.avail_out;
+	job->failed_ = false;
+}
+
+// Pool
+
+DeflatePool::DeflatePool () : log_("/zlib/pool")
+{
+	pthread_mutex_init (&mutex_, 0);
+	pthread_cond_init (&ready_, 0);
+	read_action_ = stop_action_ = 0;
+	rfd_ = wfd_ = -1;
+	stopping_ = false;
+}
+
+DeflatePool::~DeflatePool ()
+{
+	pthread_mutex_destroy (&mutex_);
+	pthread_cond_destroy (&ready_);
+	if (rfd_ >= 0)
+		::close (rfd_);
+	if (wfd_ >= 0)
+		::close (wfd_);
+}
+
+bool DeflatePool::submit (DeflateJob* job, int threads)
+{
+	if (workers_.size () < (size_t) threads && ! launch (threads))
+		return false;
+
+	pthread_mutex_lock (&mutex_);
+	queue_.push_back (job);
+	pthread_cond_signal (&ready_);
+	pthread_mutex_unlock (&mutex_);
+	return true;
+}
+
+/*
+ * Jobs of a filter being destroyed are dropped if they did not start yet,
+ * or else left to be deleted when they come back.
+ */
+void DeflatePool::abandon (DeflateJob* job)
+{
+	std::deque<DeflateJob*>::iterator it;
+
+	pthread_mutex_lock (&mutex_);
+	for (it = queue_.begin (); it != queue_.end () && *it != job; ++it);
+	if (it != queue_.end ())
+		queue_.erase (it), delete job;
+	else
+		job->owner_ = 0;
+	pthread_mutex_unlock (&mutex_);
+}
+
+bool DeflatePool::launch (int threads)
+{
+	int fd[2];
+
+	if (stopping_)
+		return false;
+
+	if (rfd_ < 0)
+	{
+		if (::pipe (fd) != 0)
+		{
+			ERROR(log_) << "Could not create deflate pool pipe: " << strerror (errno);
+			return false;
+		}
+		rfd_ = fd[0], wfd_ = fd[1];
+		::fcntl (rfd_, F_SETFL, ::fcntl (rfd_, F_GETFL) | O_NONBLOCK);
+		::fcntl (wfd_, F_SETFL, ::fcntl (wfd_, F_GETFL) | O_NONBLOCK);
+	}
+
+	if (! read_action_)
+	{
+		read_action_ = event_system.track (rfd_, StreamModeRead, callback (this, &DeflatePool::on_finished));
+		stop_action_ = event_system.register_interest (EventInterestStop, callback (this, &DeflatePool::shutdown));
+	}
+
+	if (threads > DEFLATE_POOL_MAX_THREADS)
+		threads = DEFLATE_POOL_MAX_THREADS;
+	while (workers_.size () < (size_t) threads)
+	{
+		DeflateWorker* w = new DeflateWorker (this);
+		if (! w->start ())
+		{
+			delete w;
+			break;
+		}
+		workers_.push_back (w);
+	}
+
+	DEBUG(log_) << "Deflate pool running " << workers_.size () << " threads.";
+	return (! workers_.empty ());
+}
+
+DeflateJob* DeflatePool::next ()
+{
+	DeflateJob* job = 0;
+
+	pthread_mutex_lock (&mutex_);
+	while (queue_.empty () && ! stopping_)
+		pthread_cond_wait (&ready_, &mutex_);
+	if (! stopping_)
+		job = queue_.front (), queue_.pop_front ();
+	pthread_mutex_unlock (&mutex_);
+	return job;
+}
+
+void DeflatePool::finish (DeflateJob* job)
+{
+	pthread_mutex_lock (&mutex_);
+	finished_.push_back (job);
+	pthread_mutex_unlock (&mutex_);
+	::write (wfd_, "*", 1);
+}
+
+void DeflatePool::on_finished (Event e)
+{
+	if (read_action_)
+		read_action_->cancel (), read_action_ = 0;
+	if (e.type_ != Event::Done)
+	{
+		ERROR(log_) << "Unexpected event: " << e;
+		return;
+	}
+	read_action_ = event_system.track (rfd_, StreamModeRead, callback (this, &DeflatePool::on_finished));
+
+	std::deque<DeflateJob*> finished;
+	pthread_mutex_lock (&mutex_);
+	finished.swap (finished_);
+	pthread_mutex_unlock (&mutex_);
+
+	// an owner may be destroyed while handling its jobs, abandoning the rest
+	while (! finished.empty ())
+	{
+		DeflateJob* job = finished.front ();
+		finished.pop_front ();
+		if (! job->owner_)
+			delete job;
+		else
+			job->done_ = true, job->owner_->complete ();
+	}
+}
+
+void DeflatePool::shutdown ()
+{
+	if (stop_action_)
+		stop_action_->cancel (), stop_action_ = 0;
+	if (read_action_)
+		read_action_->cancel (), read_action_ = 0;
+
+	pthread_mutex_lock (&mutex_);
+	stopping_ = true;
+	pthread_cond_broadcast (&ready_);
+	pthread_mutex_unlock (&mutex_);
+
+	while (! workers_.empty ())
+	{
+		workers_.back ()->stop ();
+		delete workers_.back ();
+		workers_.pop_back ();
+	}
+}
+
+DeflatePool deflate_pool;
+
+// Filter
+
+ParallelDeflateFilter::ParallelDeflateFilter (int level, int threads, size_t threshold) : DeflateFilter (level, true)
+{
+	threads_ = threads;
+	threshold_ = threshold;
+	held_ = 0;
+	window_length_ = 0;
+	adler_ = adler32 (0, Z_NULL, 0);
+	dictid_ = 0;
+	started_ = primed_ = resync_ = failed_ = false;
+	second_ = 0;
+	rate_bytes_ = 0;
+	bulk_ = false;
+}
+
+ParallelDeflateFilter::~ParallelDeflateFilter ()
+{
+	while (! jobs_.empty ())
+	{
+		if (jobs_.front ()->done_)
+			delete jobs_.front ();
+		else
+			deflate_pool.abandon (jobs_.front ());
+		jobs_.pop_front ();
+	}
+	hold (held_, 0);
+}
+
+bool ParallelDeflateFilter::prime (const Buffer& dict)
+{
+	size_t len = dict.length (), n = (len < sizeof window_ ? len : sizeof window_);
+
+	if (started_)
+		return false;
+
+	dict.copyout (window_, len - n, n);
+	window_length_ = n;
+	dictid_ = adler32 (adler32 (0, Z_NULL, 0), window_, n);
+	primed_ = true;
+	return DeflateFilter::prime (dict);
+}
+
+bool ParallelDeflateFilter::consume (Buffer& buf, int flg)
+{
+	size_t len = buf.length ();
+
+	if (failed_)
+		return false;
+	if (! started_)
+		start ();
+
+	// once blocks are out, later data has to queue behind them
+	measure (len);
+	if ((bulk_ || ! jobs_.empty ()) && len > 0 && jobs_.size () < (size_t) threads_ * DEFLATE_POOL_BACKLOG && submit (buf, flg))
+	{
+		remember (buf);
+		weigh ();
+		return true;
+	}
+
+	pending_.clear ();
+	if (jobs_.empty ())
+		pending_.append (header_), header_.clear ();
+	if (resync_)
+	{
+		if (deflateSetDictionary (&stream_, window_, window_length_) != Z_OK)
+		{
+			ERROR(log_) << "Could not resume serial deflate after pooled blocks.";
+			failed_ = true;
+			return false;
+		}
+		resync_ = false;
+	}
+	if (! compress (buf))
+		return false;
+
+	remember (buf);
+	if (jobs_.empty ())
+		return produce (pending_, flg);
+	queue (pending_, flg);
+	weigh ();
+	return true;
+}
+
+void ParallelDeflateFilter::flush (int flg)
+{
+	flushing_ = true;
+	flush_flags_ |= flg;
+	if (jobs_.empty ())
+		conclude ();
+}
+
+void ParallelDeflateFilter::complete ()
+{
+	while (! jobs_.empty () && jobs_.front ()->done_)
+	{
+		DeflateJob* job = jobs_.front ();
+		jobs_.pop_front ();
+		if (job->failed_ && ! failed_)
+		{
+			ERROR(log_) << "Could not deflate block of " << job->length_ << " bytes.";
+			failed_ = true;
+		}
+		if (! failed_)
+		{
+			pending_.clear ();
+			pending_.append (header_), header_.clear ();
+			pending_.append (job->output_, job->output_length_);
+			if (! produce (pending_, job->flags_))
+				failed_ = true;
+		}
+		delete job;
+	}
+
+	weigh ();
+	if (flushing_ && jobs_.empty ())
+		conclude ();
+}
+
+/*
+ * The zlib header and trailer are written here around the raw stream, the
+ * dictionary id telling the peer which data to preset.
+ */
+void ParallelDeflateFilter::start ()
+{
+	uint8_t hdr[6];
+	int flevel = (level_ < 2 ? 0 : (level_ < 6 ? 1 : (level_ == 6 ? 2 : 3)));
+	int n = 2;
+
+	hdr[0] = 0x78;
+	hdr[1] = (flevel << 6) | (primed_ ? 0x20 : 0);
+	hdr[1] += (31 - ((hdr[0] << 8) + hdr[1]) % 31) % 31;
+	if (primed_)
+	{
+		hdr[n++] = dictid_ >> 24, hdr[n++] = dictid_ >> 16;
+		hdr[n++] = dictid_ >> 8, hdr[n++] = dictid_;
+	}
+	header_.append (hdr, n);
+	started_ = true;
+}
+
+void ParallelDeflateFilter::measure (size_t len)
+{
+	time_t now = ::time (0);
+
+	// the rate over the last whole second decides until the threshold is met again
+	if (now != second_)
+	{
+		bulk_ = (now == second_ + 1 && rate_bytes_ >= threshold_);
+		second_ = now;
+		rate_bytes_ = 0;
+	}
+	rate_bytes_ += len;
+	if (rate_bytes_ >= threshold_ && ! bulk_)
+	{
+		DEBUG(log_) << "Compressing in parallel blocks.";
+		bulk_ = true;
+	}
+}
+
+void ParallelDeflateFilter::remember (const Buffer& buf)
+{
+	size_t len = buf.length (), keep;
+
+	for (Buffer::SegmentIterator it = buf.segments (); ! it.end (); it.next ())
+		adler_ = adler32 (adler_, (*it)->data (), (*it)->length ());
+
+	if (len >= sizeof window_)
+	{
+		buf.copyout (window_, len - sizeof window_, sizeof window_);
+		window_length_ = sizeof window_;
+	}
+	else
+	{
+		keep = (window_length_ < sizeof window_ - len ? window_length_ : sizeof window_ - len);
+		memmove (window_, window_ + window_length_ - keep, keep);
+		buf.copyout (window_ + keep, 0, len);
+		window_length_ = keep + len;
+	}
+}
+
+bool ParallelDeflateFilter::submit (Buffer& buf, int flg)
+{
+	DeflateJob* job = new DeflateJob;
+	size_t len = buf.length ();
+
+	job->owner_ = this;
+	job->length_ = len;
+	job->input_ = new uint8_t[len];
+	buf.copyout (job->input_, 0, len);
+	memcpy (job->dictionary_, window_, window_length_);
+	job->dictionary_length_ = window_length_;
+	job->level_ = (level_ != Z_NO_COMPRESSION && len >= DEFLATE_SAMPLE_MIN && incompressible (buf) ? Z_NO_COMPRESSION : level_);
+	job->flags_ = flg;
+
+	if (! deflate_pool.submit (job, threads_))
+	{
+		delete job;
+		return false;
+	}
+
+	jobs_.push_back (job);
+	resync_ = true;
+	return true;
+}
+
+// a block compressed here waits as a finished job for those ahead of it
+void ParallelDeflateFilter::queue (Buffer& buf, int flg)
+{
+	DeflateJob* job = new DeflateJob;
+
+	job->owner_ = this;
+	job->output_length_ = buf.length ();
+	job->output_ = new uint8_t[job->output_length_];
+	buf.copyout (job->output_, 0, job->output_length_);
+	job->flags_ = flg;
+	job->done_ = true;
+	buf.clear ();
+	jobs_.push_back (job);
+}
+
+void ParallelDeflateFilter::weigh ()
+{
+	intmax_t n = 0;
+
+	for (std::deque<DeflateJob*>::const_iterator it = jobs_.begin (); it != jobs_.end (); ++it)
+		n += ((*it)->input_ ? (*it)->length_ : (*it)->output_length_);
+	hold (held_, n);
+}
+
+void ParallelDeflateFilter::conclude ()
+{
+	uint8_t trl[4];
+
+	if (! started_)
+		start ();
+
+	pending_.clear ();
+	pending_.append (header_), header_.clear ();
+	if (! failed_)
+	{
+		finish ();
+		trl[0] = adler_ >> 24, trl[1] = adler_ >> 16;
+		trl[2] = adler_ >> 8, trl[3] = adler_;
+		pending_.append (trl, 4);
+		produce (pending_);
+	}
+
+	Filter::flush (flush_flags_);
+}
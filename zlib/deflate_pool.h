@@ -0,0 +1,149 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// File:           deflate_pool.h                                             //
+// Description:    block-parallel deflate on a pool of worker threads         //
+// Project:        WANProxy XTech                                             //
+// Author:         Andreu Vidal Bramfeld-Software                             //
+// Last modified:  2026-10-19                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef	ZLIB_DEFLATE_POOL_H
+#define	ZLIB_DEFLATE_POOL_H
+
+#include <deque>
+#include <vector>
+#include <time.h>
+#include <pthread.h>
+#include <common/thread/thread.h>
+#include <event/action.h>
+#include <event/event.h>
+#include <zlib/zlib_filter.h>
+
+#define	DEFLATE_POOL_MAX_THREADS	64
+#define	DEFLATE_POOL_BACKLOG		2		// blocks per thread a filter may have out at once
+
+class ParallelDeflateFilter;
+
+/*
+ * A block of input handed to the workers, with the data preceding it as
+ * dictionary. Input and output are plain memory since buffer segments are
+ * not meant to be shared between threads.
+ */
+struct DeflateJob
+{
+	ParallelDeflateFilter* owner_;
+	uint8_t* input_;
+	size_t length_;
+	uint8_t dictionary_[DEFLATE_DICTIONARY_SIZE];
+	size_t dictionary_length_;
+	int level_;
+	int flags_;
+	uint8_t* output_;
+	size_t output_length_;
+	bool done_;
+	bool failed_;
+
+	DeflateJob () : owner_(0), input_(0), length_(0), dictionary_length_(0), level_(0), flags_(0), output_(0), output_length_(0), done_(false), failed_(false)   { }
+	~DeflateJob ()   { delete[] input_; delete[] output_; }
+};
+
+class DeflatePool;
+
+class DeflateWorker : public Thread
+{
+	DeflatePool* pool_;
+	z_stream stream_;
+
+public:
+	DeflateWorker (DeflatePool* pool);
+	~DeflateWorker ();
+
+	virtual void main ();
+
+private:
+	void compress (DeflateJob* job);
+};
+
+class DeflatePool
+{
+	friend class DeflateWorker;
+
+	LogHandle log_;
+	pthread_mutex_t mutex_;
+	pthread_cond_t ready_;
+	std::deque<DeflateJob*> queue_;
+	std::deque<DeflateJob*> finished_;
+	std::vector<DeflateWorker*> workers_;
+	Action* read_action_;
+	Action* stop_action_;
+	int rfd_, wfd_;
+	bool stopping_;
+
+public:
+	DeflatePool ();
+	~DeflatePool ();
+
+	bool submit (DeflateJob* job, int threads);
+	void abandon (DeflateJob* job);
+
+private:
+	bool launch (int threads);
+	DeflateJob* next ();
+	void finish (DeflateJob* job);
+	void on_finished (Event e);
+	void shutdown ();
+};
+
+extern DeflatePool deflate_pool;
+
+/*
+ * Produces a regular zlib stream, so the peer needs nothing new to read
+ * it, but while the input rate stays above the threshold the data is cut
+ * in blocks compressed at the same time by the pool. Each block ends on
+ * a byte boundary and is chained to the previous one through its
+ * dictionary, and the checksums of all of them are combined for the
+ * trailer. When the workers fall behind, the filter compresses the next
+ * blocks itself and queues them after those still out, which slows down
+ * its intake, and the bytes waiting are charged to its chain.
+ */
+class ParallelDeflateFilter : public DeflateFilter
+{
+	int threads_;
+	size_t threshold_;
+	std::deque<DeflateJob*> jobs_;
+	intmax_t held_;
+	Buffer header_;
+	uint8_t window_[DEFLATE_DICTIONARY_SIZE];
+	size_t window_length_;
+	uLong adler_;
+	uLong dictid_;
+	bool started_;
+	bool primed_;
+	bool resync_;
+	bool failed_;
+	time_t second_;
+	size_t rate_bytes_;
+	bool bulk_;
+
+public:
+   ParallelDeflateFilter (int level, int threads, size_t threshold);
+   virtual ~ParallelDeflateFilter ();
+
+   virtual bool prime (const Buffer& dict);
+   virtual bool consume (Buffer& buf, int flg = 0);
+   virtual void flush (int flg);
+
+	void complete ();
+
+private:
+	void start ();
+	void measure (size_t len);
+	void remember (const Buffer& buf);
+	bool submit (Buffer& buf, int flg);
+	void queue (Buffer& buf, int flg);
+	void weigh ();
+	void conclude ();
+};
+
+#endif /* !ZLIB_DEFLATE_POOL_H */
@@ -1,5 +1,6 @@
 VPATH+=	${TOPDIR}/zlib
 
 SRCS+=	zlib_filter.cc
+SRCS+=	deflate_pool.cc
 
 LDADD+=	-lz
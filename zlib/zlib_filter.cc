@@ -8,37 +8,200 @@
 //                                                                            //
 ////////////////////////////////////////////////////////////////////////////////
 
+#include <math.h>
+#include <common/count_filter.h>
+#include <event/event_callback.h>
+#include <event/event_system.h>
 #include "zlib_filter.h"
 
+/*
+ * zlib writes its output straight into the free space of a buffer
+ * segment, which joins the pending data once full or when the output is
+ * complete, instead of going through an intermediate array.
+ */
+static void reserve (z_stream& strm, BufferSegment*& seg)
+{
+	if (! seg)
+		seg = BufferSegment::create ();
+	strm.next_out = seg->tail ();
+	strm.avail_out = seg->avail ();
+}
+
+static void release (BufferSegment*& seg, Buffer& trg)
+{
+	if (seg && seg->length () > 0)
+	{
+		trg.append (seg);
+		seg->unref ();
+		seg = 0;
+	}
+}
+
+static void settle (z_stream& strm, BufferSegment*& seg, Buffer& trg)
+{
+	seg->set_length (BUFFER_SEGMENT_SIZE - strm.avail_out);
+	if (seg->avail () == 0)
+		release (seg, trg);
+}
+
 // Deflate
 
-DeflateFilter::DeflateFilter (int level) : BufferedFilter ("/zlib/deflate")
+DeflateFilter::DeflateFilter (int level, bool raw) : BufferedFilter ("/zlib/deflate")
 {
 	stream_.zalloc = Z_NULL;
 	stream_.zfree = Z_NULL;
 	stream_.opaque = Z_NULL;
 	stream_.next_in = Z_NULL;
 	stream_.avail_in = 0;
-	stream_.next_out = outbuf;
-	stream_.avail_out = sizeof outbuf;
+	stream_.next_out = Z_NULL;
+	stream_.avail_out = 0;
+	out_ = 0;
+	wait_action_ = 0;
+	level_ = level;
+	stored_ = false;
+	hold_ = 0;
 
-	if (deflateInit (&stream_, level) != Z_OK)
+	if (deflateInit2 (&stream_, level, Z_DEFLATED, (raw ? -MAX_WBITS : MAX_WBITS), 8, Z_DEFAULT_STRATEGY) != Z_OK)
 		CRITICAL(log_) << "Could not initialize deflate stream.";
 }
 
 DeflateFilter::~DeflateFilter ()
 {
+	if (wait_action_)
+		wait_action_->cancel ();
+	if (out_)
+		out_->unref ();
 	if (deflateEnd (&stream_) != Z_OK)
 		ERROR(log_) << "Deflate stream did not end cleanly.";
 }
 
+/*
+ * A preset dictionary lets the very first bytes of the stream refer to
+ * data both sides already hold. Only the last window's worth is of any use.
+ */
+bool DeflateFilter::prime (const Buffer& dict)
+{
+	uint8_t data[DEFLATE_DICTIONARY_SIZE];
+	size_t len = dict.length (), n = (len < sizeof data ? len : sizeof data);
+	int rv;
+	
+	dict.copyout (data, len - n, n);
+	rv = deflateSetDictionary (&stream_, data, n);
+	if (rv != Z_OK)
+	{
+		ERROR(log_) << "deflateSetDictionary(): " << zError(rv);
+		return false;
+	}
+	
+	return true;
+}
+
+/*
+ * Data which is already compressed or encrypted gains nothing from deflate
+ * but still costs its full CPU time. A sample of the input spread over the
+ * whole buffer gives an estimate of its entropy, and buffers close to
+ * 8 bits per byte are sent in stored blocks instead. The decoder needs no
+ * notice since stored blocks are part of the deflate format itself.
+ */
+bool DeflateFilter::incompressible (Buffer& buf)
+{
+	unsigned count[256] = {0};
+	size_t len = buf.length (), step = len / DEFLATE_SAMPLE_SIZE + 1, n = 0;
+	double bits = 0;
+	
+	for (Buffer::SegmentIterator it = buf.segments (); ! it.end (); it.next ())
+	{
+		const BufferSegment* seg = *it;
+		for (size_t pos = (step - n % step) % step; pos < seg->length (); pos += step)
+			count[seg->data ()[pos]]++;
+		n += seg->length ();
+	}
+	
+	n = 0;
+	for (int c = 0; c < 256; ++c)
+		n += count[c];
+	for (int c = 0; c < 256; ++c)
+		if (count[c] > 0)
+			bits -= count[c] * log2 ((double) count[c] / n);
+	
+	return (bits / n >= DEFLATE_STORE_ENTROPY);
+}
+
+bool DeflateFilter::select (bool store)
+{
+	int rv;
+	
+	if (store == stored_)
+		return true;
+	
+	// data held back since the last flush must first end its block
+	stream_.avail_in = 0;
+	drain (Z_BLOCK);
+	reserve (stream_, out_);
+	rv = deflateParams (&stream_, (store ? Z_NO_COMPRESSION : level_), Z_DEFAULT_STRATEGY);
+	settle (stream_, out_, pending_);
+	if (rv != Z_OK)
+	{
+		ERROR(log_) << "deflateParams(): " << zError(rv);
+		return false;
+	}
+	
+	DEBUG(log_) << (store ? "Storing incompressible data." : "Compressing data again.");
+	stored_ = store;
+	return true;
+}
+
+/*
+ * A sync flush at the end of each call lets the peer decode everything
+ * received so far, at the cost of a few bytes and of a new block. When the
+ * source announces more data to follow, deflate keeps it until then,
+ * though never for longer than a short wait.
+ */
 bool DeflateFilter::consume (Buffer& buf, int flg)
+{
+	bool sync = ! (flg & TO_BE_CONTINUED);
+	
+	if (wait_action_)
+		wait_action_->cancel (), wait_action_ = 0;
+	
+	pending_.clear ();
+	if (! compress (buf, sync))
+		return false;
+	if (! sync)
+		wait_action_ = event_system.track (DEFLATE_FLUSH_WAIT, StreamModeWait, callback (this, &DeflateFilter::on_flush_timeout));
+	
+	return (pending_.empty () || produce (pending_, flg));
+}
+
+int DeflateFilter::drain (int mode)
+{
+	int rv;
+	
+	do
+	{
+		reserve (stream_, out_);
+		rv = deflate (&stream_, mode);
+		settle (stream_, out_, pending_);
+	}
+	while (rv == Z_OK && (stream_.avail_in > 0 || stream_.avail_out == 0));
+	
+	return rv;
+}
+
+bool DeflateFilter::compress (Buffer& buf, bool sync)
 {
 	const BufferSegment* seg;
 	int cnt = 0, i = 0, rv;
+	size_t len = buf.length (), out;
 	
 	for (Buffer::SegmentIterator it = buf.segments (); ! it.end (); it.next (), ++cnt);
-	pending_.clear ();
+
+	// after a poor result keep storing for a while without sampling again
+	if (hold_ > 0)
+		hold_ = (hold_ > len ? hold_ - len : 0);
+	else if (level_ != Z_NO_COMPRESSION && len >= DEFLATE_SAMPLE_MIN && ! select (incompressible (buf)))
+		return false;
+	out = pending_.length ();
 
 	for (Buffer::SegmentIterator it = buf.segments (); ! it.end (); it.next (), ++i) 
 	{
@@ -46,44 +209,62 @@ bool DeflateFilter::consume (Buffer& buf, int flg)
 		stream_.next_in = (Bytef*) (uintptr_t) seg->data ();
 		stream_.avail_in = seg->length ();
 
-		while (stream_.avail_in > 0) 
+		rv = drain (i < cnt - 1 || ! sync ? Z_NO_FLUSH : Z_SYNC_FLUSH);
+		if (rv == Z_STREAM_ERROR || rv == Z_DATA_ERROR || rv == Z_MEM_ERROR) 
 		{
-			rv = deflate (&stream_, (i < cnt - 1 ? Z_NO_FLUSH : Z_SYNC_FLUSH));
-			if (rv == Z_STREAM_ERROR || rv == Z_DATA_ERROR || rv == Z_MEM_ERROR) 
-			{
-				ERROR(log_) << "deflate(): " << zError(rv);
-				return false;
-			}
-
-			if (stream_.avail_out < sizeof outbuf)
-			{
-				pending_.append (outbuf, sizeof outbuf - stream_.avail_out);
-				stream_.next_out = outbuf;
-				stream_.avail_out = sizeof outbuf;
-			}
+			ERROR(log_) << "deflate(): " << zError(rv);
+			return false;
 		}
 	}
+	release (out_, pending_);
 	
-	return produce (pending_, flg);
+	// the estimate missed data deflate could not reduce, so stop trying it
+	if (! stored_ && len >= DEFLATE_SAMPLE_MIN && pending_.length () - out >= len * DEFLATE_STORE_RATIO)
+	{
+		if (! select (true))
+			return false;
+		hold_ = DEFLATE_STORE_HOLD;
+	}
+	
+	return true;
 }
 
 void DeflateFilter::flush (int flg)
 {
+	if (wait_action_)
+		wait_action_->cancel (), wait_action_ = 0;
+	
 	pending_.clear ();
+	finish ();
+	
+	if (! pending_.empty ())
+		produce (pending_);
+
+	Filter::flush (flg);
+}
+
+void DeflateFilter::finish ()
+{
 	stream_.next_in = Z_NULL;
 	stream_.avail_in = 0;
+	drain (Z_FINISH);
+	release (out_, pending_);
+}
+
+void DeflateFilter::on_flush_timeout (Event e)
+{
+	if (wait_action_)
+		wait_action_->cancel (), wait_action_ = 0;
 	
-	while (deflate (&stream_, Z_FINISH) == Z_OK && stream_.avail_out < sizeof outbuf)
-	{	
-		pending_.append (outbuf, sizeof outbuf - stream_.avail_out);
-		stream_.next_out = outbuf;
-		stream_.avail_out = sizeof outbuf;
-	}
+	trace (TraceTimer, 0, 1);
+	pending_.clear ();
+	stream_.next_in = Z_NULL;
+	stream_.avail_in = 0;
+	drain (Z_SYNC_FLUSH);
+	release (out_, pending_);
 	
 	if (! pending_.empty ())
 		produce (pending_);
-
-	Filter::flush (flg);
 }
 
 // Inflate
@@ -95,8 +276,9 @@ InflateFilter::InflateFilter () : BufferedFilter ("/zlib/inflate")
 	stream_.opaque = Z_NULL;
 	stream_.next_in = Z_NULL;
 	stream_.avail_in = 0;
-	stream_.next_out = outbuf;
-	stream_.avail_out = sizeof outbuf;
+	stream_.next_out = Z_NULL;
+	stream_.avail_out = 0;
+	out_ = 0;
 
 	if (inflateInit (&stream_) != Z_OK)
 		CRITICAL(log_) << "Could not initialize inflate stream.";
@@ -104,6 +286,8 @@ InflateFilter::InflateFilter () : BufferedFilter ("/zlib/inflate")
 
 InflateFilter::~InflateFilter()
 {
+	if (out_)
+		out_->unref ();
 	if (inflateEnd (&stream_) != Z_OK)
 		ERROR(log_) << "Inflate stream did not end cleanly.";
 }
@@ -122,39 +306,49 @@ bool InflateFilter::consume (Buffer& buf, int flg)
 		stream_.next_in = (Bytef*) (uintptr_t) seg->data ();
 		stream_.avail_in = seg->length ();
 
-		while (stream_.avail_in > 0) 
+		// a full output segment may still hold back decoded data
+		do
 		{
+			reserve (stream_, out_);
 			rv = inflate (&stream_, (i < cnt - 1 ? Z_NO_FLUSH : Z_SYNC_FLUSH));
+			settle (stream_, out_, pending_);
+			if (rv == Z_NEED_DICT && ! dictionary_.empty ())
+			{
+				uint8_t data[DEFLATE_DICTIONARY_SIZE];
+				size_t len = dictionary_.length (), n = (len < sizeof data ? len : sizeof data);
+				dictionary_.copyout (data, len - n, n);
+				dictionary_.clear ();
+				rv = inflateSetDictionary (&stream_, data, n);
+			}
 			if (rv == Z_NEED_DICT || rv == Z_DATA_ERROR || rv == Z_MEM_ERROR) 
 			{
 				ERROR(log_) << "inflate(): " << zError(rv);
 				return false;
 			}
-
-			if (stream_.avail_out < sizeof outbuf)
-			{
-				pending_.append (outbuf, sizeof outbuf - stream_.avail_out);
-				stream_.next_out = outbuf;
-				stream_.avail_out = sizeof outbuf;
-			}
 		}
+		while (rv == Z_OK && (stream_.avail_in > 0 || stream_.avail_out == 0));
 	}
+	release (out_, pending_);
 	
 	return produce (pending_, flg);
 }
 
 void InflateFilter::flush (int flg)
 {
+	int rv;
+	
 	pending_.clear ();
 	stream_.next_in = Z_NULL;
 	stream_.avail_in = 0;
 	
-	while (inflate (&stream_, Z_FINISH) == Z_OK && stream_.avail_out < sizeof outbuf)
-	{	
-		pending_.append (outbuf, sizeof outbuf - stream_.avail_out);
-		stream_.next_out = outbuf;
-		stream_.avail_out = sizeof outbuf;
+	do
+	{
+		reserve (stream_, out_);
+		rv = inflate (&stream_, Z_FINISH);
+		settle (stream_, out_, pending_);
 	}
+	while (rv == Z_OK || (rv == Z_BUF_ERROR && stream_.avail_out == 0));
+	release (out_, pending_);
 	
 	if (! pending_.empty ())
 		produce (pending_);
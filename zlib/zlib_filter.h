@@ -12,21 +12,42 @@
 #define	ZLIB_DEFLATE_FILTER_H
 
 #include <common/filter.h>
+#include <event/action.h>
+#include <event/event.h>
 #include <zlib.h>
 
-#define	DEFLATE_CHUNK_SIZE	0x10000
-#define	INFLATE_CHUNK_SIZE	0x10000
+#define	DEFLATE_DICTIONARY_SIZE	0x8000
+#define	DEFLATE_FLUSH_WAIT	50
+
+#define	DEFLATE_SAMPLE_MIN	512
+#define	DEFLATE_SAMPLE_SIZE	4096
+#define	DEFLATE_STORE_ENTROPY	7.5
+#define	DEFLATE_STORE_RATIO	0.97
+#define	DEFLATE_STORE_HOLD	0x40000
 
 class DeflateFilter : public BufferedFilter
 {
-private:
+protected:
 	z_stream stream_;
-	uint8_t outbuf[DEFLATE_CHUNK_SIZE];
+	BufferSegment* out_;
+	Action* wait_action_;
+	int level_;
+	bool stored_;
+	size_t hold_;
+	
+	bool incompressible (Buffer& buf);
+	bool select (bool store);
+	int drain (int mode);
+	bool compress (Buffer& buf, bool sync = true);
+	void finish ();
+	void on_flush_timeout (Event e);
 	
 public:
-   DeflateFilter (int level = 0);
+   DeflateFilter (int level = 0, bool raw = false);
    virtual ~DeflateFilter ();
 
+   virtual bool prime (const Buffer& dict);
+
    virtual bool consume (Buffer& buf, int flg = 0);
    virtual void flush (int flg);
 };
@@ -35,12 +56,15 @@ class InflateFilter : public BufferedFilter
 {
 private:
 	z_stream stream_;
-	uint8_t outbuf[INFLATE_CHUNK_SIZE];
+	BufferSegment* out_;
+	Buffer dictionary_;
 	
 public:
    InflateFilter ();
   ~InflateFilter ();
 
+   bool prime (const Buffer& dict)   { dictionary_ = dict; return true; }
+
    virtual bool consume (Buffer& buf, int flg = 0);
    virtual void flush (int flg);
 };
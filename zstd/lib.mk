@@ -0,0 +1,10 @@
+# Build with NO_ZSTD=1 where libzstd is not installed.
+ifdef NO_ZSTD
+CPPFLAGS+=-DNO_ZSTD=1
+else
+VPATH+=	${TOPDIR}/zstd
+
+SRCS+=	zstd_filter.cc
+
+LDADD+=	-lzstd
+endif
@@ -0,0 +1,178 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// File:           zstd_filter.cc                                             //
+// Description:    data filters for zstd compression streams                  //
+// Project:        WANProxy XTech                                             //
+// Author:         Andreu Vidal Bramfeld-Software                             //
+// Last modified:  2026-10-19                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include "zstd_filter.h"
+
+// Compress
+
+ZstdCompressFilter::ZstdCompressFilter (int level, bool lng) : BufferedFilter ("/zstd/compress")
+{
+	if (! (stream_ = ZSTD_createCCtx ()))
+		CRITICAL(log_) << "Could not initialize zstd compression stream.";
+	else if (level > 0)
+		ZSTD_CCtx_setParameter (stream_, ZSTD_c_compressionLevel, level);
+
+	/*
+	 * Long distance matching finds repetitions far behind the current
+	 * position, which the default window would miss. The decoder accepts
+	 * this window size without further settings.
+	 */
+	if (stream_ && lng)
+	{
+		ZSTD_CCtx_setParameter (stream_, ZSTD_c_enableLongDistanceMatching, 1);
+		ZSTD_CCtx_setParameter (stream_, ZSTD_c_windowLog, ZSTD_LONG_WINDOW_LOG);
+	}
+}
+
+ZstdCompressFilter::~ZstdCompressFilter ()
+{
+	ZSTD_freeCCtx (stream_);
+}
+
+bool ZstdCompressFilter::prime (const Buffer& dict)
+{
+	uint8_t* data = new uint8_t[dict.length ()];
+	size_t rv;
+	
+	dict.copyout (data, dict.length ());
+	rv = (stream_ ? ZSTD_CCtx_loadDictionary (stream_, data, dict.length ()) : 0);
+	delete[] data;
+	if (ZSTD_isError (rv))
+	{
+		ERROR(log_) << "ZSTD_CCtx_loadDictionary(): " << ZSTD_getErrorName (rv);
+		return false;
+	}
+	
+	return true;
+}
+
+bool ZstdCompressFilter::compress (ZSTD_inBuffer& in, ZSTD_EndDirective op)
+{
+	size_t rv;
+
+	do
+	{
+		ZSTD_outBuffer out = {outbuf, sizeof outbuf, 0};
+		rv = ZSTD_compressStream2 (stream_, &out, &in, op);
+		if (ZSTD_isError (rv))
+		{
+			ERROR(log_) << "ZSTD_compressStream2(): " << ZSTD_getErrorName (rv);
+			return false;
+		}
+		if (out.pos > 0)
+			pending_.append (outbuf, out.pos);
+	}
+	while (in.pos < in.size || (op != ZSTD_e_continue && rv > 0));
+
+	return true;
+}
+
+bool ZstdCompressFilter::consume (Buffer& buf, int flg)
+{
+	const BufferSegment* seg;
+	int cnt = 0, i = 0;
+
+	if (! stream_)
+		return false;
+
+	for (Buffer::SegmentIterator it = buf.segments (); ! it.end (); it.next (), ++cnt);
+	pending_.clear ();
+
+	for (Buffer::SegmentIterator it = buf.segments (); ! it.end (); it.next (), ++i)
+	{
+		seg = *it;
+		ZSTD_inBuffer in = {seg->data (), seg->length (), 0};
+		if (! compress (in, (i < cnt - 1 ? ZSTD_e_continue : ZSTD_e_flush)))
+			return false;
+	}
+
+	return produce (pending_, flg);
+}
+
+void ZstdCompressFilter::flush (int flg)
+{
+	pending_.clear ();
+
+	ZSTD_inBuffer in = {0, 0, 0};
+	if (stream_ && compress (in, ZSTD_e_end) && ! pending_.empty ())
+		produce (pending_);
+
+	Filter::flush (flg);
+}
+
+// Decompress
+
+ZstdDecompressFilter::ZstdDecompressFilter () : BufferedFilter ("/zstd/decompress")
+{
+	if (! (stream_ = ZSTD_createDCtx ()))
+		CRITICAL(log_) << "Could not initialize zstd decompression stream.";
+}
+
+ZstdDecompressFilter::~ZstdDecompressFilter()
+{
+	ZSTD_freeDCtx (stream_);
+}
+
+bool ZstdDecompressFilter::prime (const Buffer& dict)
+{
+	uint8_t* data = new uint8_t[dict.length ()];
+	size_t rv;
+	
+	dict.copyout (data, dict.length ());
+	rv = (stream_ ? ZSTD_DCtx_loadDictionary (stream_, data, dict.length ()) : 0);
+	delete[] data;
+	if (ZSTD_isError (rv))
+	{
+		ERROR(log_) << "ZSTD_DCtx_loadDictionary(): " << ZSTD_getErrorName (rv);
+		return false;
+	}
+	
+	return true;
+}
+
+bool ZstdDecompressFilter::consume (Buffer& buf, int flg)
+{
+	const BufferSegment* seg;
+	size_t rv;
+
+	if (! stream_)
+		return false;
+
+	pending_.clear ();
+
+	for (Buffer::SegmentIterator it = buf.segments (); ! it.end (); it.next ())
+	{
+		seg = *it;
+		ZSTD_inBuffer in = {seg->data (), seg->length (), 0};
+		ZSTD_outBuffer out;
+
+		// a full output buffer may still hold back decoded data
+		do
+		{
+			out.dst = outbuf, out.size = sizeof outbuf, out.pos = 0;
+			rv = ZSTD_decompressStream (stream_, &out, &in);
+			if (ZSTD_isError (rv))
+			{
+				ERROR(log_) << "ZSTD_decompressStream(): " << ZSTD_getErrorName (rv);
+				return false;
+			}
+			if (out.pos > 0)
+				pending_.append (outbuf, out.pos);
+		}
+		while (in.pos < in.size || out.pos == out.size);
+	}
+
+	return produce (pending_, flg);
+}
+
+void ZstdDecompressFilter::flush (int flg)
+{
+	Filter::flush (flg);
+}
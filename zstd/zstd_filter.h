@@ -0,0 +1,54 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// File:           zstd_filter.h                                              //
+// Description:    data filters for zstd compression streams                  //
+// Project:        WANProxy XTech                                             //
+// Author:         Andreu Vidal Bramfeld-Software                             //
+// Last modified:  2026-10-19                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef	ZSTD_ZSTD_FILTER_H
+#define	ZSTD_ZSTD_FILTER_H
+
+#include <common/filter.h>
+#include <zstd.h>
+
+#define	ZSTD_CHUNK_SIZE		0x10000
+#define	ZSTD_LONG_WINDOW_LOG	27
+
+class ZstdCompressFilter : public BufferedFilter
+{
+private:
+	ZSTD_CCtx* stream_;
+	uint8_t outbuf[ZSTD_CHUNK_SIZE];
+
+	bool compress (ZSTD_inBuffer& in, ZSTD_EndDirective op);
+
+public:
+   ZstdCompressFilter (int level = 0, bool lng = false);
+   virtual ~ZstdCompressFilter ();
+
+   bool prime (const Buffer& dict);
+
+   virtual bool consume (Buffer& buf, int flg = 0);
+   virtual void flush (int flg);
+};
+
+class ZstdDecompressFilter : public BufferedFilter
+{
+private:
+	ZSTD_DCtx* stream_;
+	uint8_t outbuf[ZSTD_CHUNK_SIZE];
+
+public:
+   ZstdDecompressFilter ();
+  ~ZstdDecompressFilter ();
+
+   bool prime (const Buffer& dict);
+
+   virtual bool consume (Buffer& buf, int flg = 0);
+   virtual void flush (int flg);
+};
+
+#endif /* !ZSTD_ZSTD_FILTER_H */